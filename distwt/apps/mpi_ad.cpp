@@ -0,0 +1,5 @@
+#include "mpi_ad.hpp"
+
+int main(int argc, char** argv) {
+    return mpi_launch<mpi_ad>(argc, argv);
+}
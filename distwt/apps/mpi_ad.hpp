@@ -0,0 +1,364 @@
+#pragma once
+
+#include "mpi_launcher.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <utility>
+#include <vector>
+
+#include <distwt/mpi/alphabet_split.hpp>
+#include <distwt/mpi/bucket_exchange.hpp>
+#include <distwt/mpi/file_partition_reader.hpp>
+#include <distwt/mpi/level_rounds.hpp>
+#include <distwt/mpi/node_prefix_sums.hpp>
+
+#include <distwt/common/wt.hpp>
+#include <distwt/common/wt_sequential.hpp>
+#include <distwt/mpi/histogram.hpp>
+#include <distwt/mpi/effective_alphabet.hpp>
+#include <distwt/mpi/wt_levelwise.hpp>
+
+#include <distwt/mpi/result.hpp>
+
+//#define DBG_AD 1
+
+// WT construction using alphabet decomposition
+//
+// the alphabet is split into one contiguous symbol range per worker (see
+// AlphabetSplit). the levels above the split level are computed by locally
+// bucket sorting the text partitions. the text is then routed to the range
+// owners in a single all-to-all exchange and each owner constructs the
+// subtrees of its range locally. finally, the bits of all levels are sent
+// to the workers holding their global positions in one round
+class mpi_ad {
+public:
+
+template<typename sym_t>
+static void start(
+    MPIContext& ctx,
+    const std::string& input_filename,
+    const size_t prefix,
+    const size_t in_rdbufsize,
+    const bool /* eff_input */,
+    const std::string& output) {
+
+    Result::Time time;
+    double t0 = ctx.time();
+
+    auto dt = [&](){
+        const double t = ctx.time();
+        const double dt = t - t0;
+        t0 = t;
+        return dt;
+    };
+
+    // Determine input partition
+    FilePartitionReader<sym_t> input(ctx, input_filename, prefix);
+    const size_t local_num = input.local_num();
+    const size_t rdbufsize = (in_rdbufsize > 0) ? in_rdbufsize : local_num;
+    input.buffer(rdbufsize);
+
+    time.input = dt();
+
+    // Compute histogram
+    ctx.cout_master() << "Compute histogram ..." << std::endl;
+    Histogram<sym_t> hist(ctx, input, rdbufsize);
+
+    time.hist = dt();
+
+    run(ctx, input, hist, rdbufsize, output, time);
+}
+
+// constructs the WT of an input partition whose histogram has already been
+// computed (e.g., by mpi-auto)
+template<typename sym_t>
+static void run(
+    MPIContext& ctx,
+    FilePartitionReader<sym_t>& input,
+    const Histogram<sym_t>& hist,
+    const size_t rdbufsize,
+    const std::string& output,
+    Result::Time time) {
+
+    double t0 = ctx.time();
+
+    auto dt = [&](){
+        const double t = ctx.time();
+        const double dt = t - t0;
+        t0 = t;
+        return dt;
+    };
+
+    const size_t local_num = input.local_num();
+
+    // Compute effective alphabet
+    EffectiveAlphabet<sym_t> ea(hist);
+
+    // Transform text and cache in RAM
+    ctx.cout_master() << "Compute effective transformation ..." << std::endl;
+    std::vector<sym_t> etext(local_num);
+    {
+        size_t i = 0;
+        ea.transform(input, [&](sym_t x){ etext[i++] = x; }, rdbufsize);
+    }
+
+    input.free();
+    time.eff = dt();
+
+    auto wt = WaveletTreeLevelwise(hist,
+    [&](WaveletTree::bits_t& bits, const WaveletTreeBase& wt){
+
+        const size_t height = wt.height();
+        const size_t size_per_worker = input.size_per_worker();
+        const auto node_sizes = WaveletTreeBase::node_sizes(hist);
+
+        bits.resize(height);
+        if(height == 0) return;
+
+        const AlphabetSplit<idx_t> split(
+            node_sizes, height, size_per_worker, ctx.num_workers());
+        const size_t split_level = split.level();
+
+        ctx.cout_master() << "Splitting alphabet on level "
+            << (split_level+1) << " ..." << std::endl;
+
+        // the first level is the text itself
+        bits[0].resize(local_num);
+        for(size_t i = 0; i < local_num; i++) {
+            bits[0][i] = bool((etext[i] >> (height - 1)) & 1);
+        }
+
+        BucketExchange<sym_t> exchange(ctx, size_per_worker);
+
+        // compute the levels above the split level by stably sorting the
+        // local text into the nodes of each level
+        //
+        // the bits are packed right away and sent along with the bits of
+        // the lower levels
+        const size_t num_top = std::max(split_level, size_t(1));
+        if(num_top > 1) {
+            ctx.cout_master() << "Compute levels 2 to " << num_top
+                << " ..." << std::endl;
+
+            // count local node sizes on the deepest level in one scan and
+            // sum them up for the levels above
+            std::vector<std::vector<size_t>> sizes(num_top);
+            {
+                const size_t deepest = num_top - 1;
+                const size_t rsh = height - deepest;
+
+                sizes[deepest].resize(1ULL << deepest);
+                for(size_t i = 0; i < local_num; i++) {
+                    ++sizes[deepest][size_t(etext[i] >> rsh)];
+                }
+
+                for(size_t level = deepest - 1; level > 0; level--) {
+                    sizes[level].resize(1ULL << level);
+                    for(size_t k = 0; k < sizes[level].size(); k++) {
+                        sizes[level][k] =
+                            sizes[level+1][2*k] + sizes[level+1][2*k+1];
+                    }
+                }
+            }
+
+            // determine the items of each node held by lower ranks
+            std::vector<std::pair<size_t, size_t>> lower;
+            for(size_t level = 1; level < num_top; level++) {
+                for(size_t k = 0; k < sizes[level].size(); k++) {
+                    if(sizes[level][k] > 0) {
+                        lower.emplace_back((1ULL << level) + k,
+                            sizes[level][k]);
+                    }
+                }
+            }
+            node_prefix_sums(ctx, node_sizes, size_per_worker, lower);
+
+            auto lower_it = lower.begin();
+            std::vector<size_t> bucket_pos;
+            bv_t level_bits(local_num);
+            for(size_t level = 1; level < num_top; level++) {
+                const size_t rsh = height - 1 - level;
+                round_bucket_sort(etext, sizes[level], bucket_pos,
+                    [&](const sym_t x){ return size_t(x >> (rsh + 1)); },
+                    [&](const size_t i, const sym_t x){
+                        level_bits[i] = bool((x >> rsh) & 1);
+                    });
+
+                for(size_t k = 0; k < sizes[level].size(); k++) {
+                    if(sizes[level][k] == 0) continue;
+
+                    const size_t node_id = (1ULL << level) + k;
+                    const size_t glob_offs =
+                        node_sizes.offset(node_id) + (lower_it++)->second;
+
+                    exchange.add_bits(level, level_bits, bucket_pos[k],
+                        glob_offs, sizes[level][k]);
+                }
+            }
+        }
+
+        // route the text to the range owners and construct the subtrees
+        // below the split level locally
+        if(split_level < height) {
+            ctx.cout_master() << "Route text to range owners ..."
+                << std::endl;
+
+            const size_t first_level_node = 1ULL << split_level;
+            const size_t rsh = height - split_level;
+            {
+                const size_t num_workers = ctx.num_workers();
+                auto owner = [&](const sym_t x){
+                    return split.owner(first_level_node + size_t(x >> rsh));
+                };
+
+                // stably sort the local text by owner
+                std::vector<size_t> num_to(num_workers, 0);
+                for(const sym_t x : etext) ++num_to[owner(x)];
+
+                std::vector<size_t> send_pos;
+                std::vector<sym_t> routed(local_num);
+                round_bucket_sort(etext, num_to, send_pos, owner,
+                    [&](const size_t i, const sym_t x){ routed[i] = x; });
+
+                etext.clear();
+                etext.shrink_to_fit();
+
+                // exchange the counts and send each owner its items in a
+                // single point-to-point message, which supports counts
+                // beyond the range of int
+                std::vector<std::vector<size_t>> counts(num_workers);
+                for(size_t j = 0; j < num_workers; j++) {
+                    counts[j].assign(1, num_to[j]);
+                }
+                const auto num_from = ctx.all_to_all(counts);
+
+                for(size_t j = 0; j < num_workers; j++) {
+                    if(num_to[j] == 0) continue;
+
+                    MPI_Request req = ctx.isend(
+                        routed.data() + send_pos[j], num_to[j], j);
+                    MPI_Request_free(&req);
+                }
+
+                // the items are received directly into place, ordered by
+                // source, so the items of each node are in the text order
+                // because every source sends them in that order
+                size_t num_recv = 0;
+                for(const auto& v : num_from) num_recv += v[0];
+                etext.resize(num_recv);
+
+                size_t offs = 0;
+                for(size_t j = 0; j < num_workers; j++) {
+                    const size_t num = num_from[j][0];
+                    if(num > 0) ctx.recv(etext.data() + offs, num, j);
+                    offs += num;
+                }
+
+                // synchronize before releasing the send buffer!
+                ctx.synchronize();
+            }
+
+            // the range of split level nodes assigned to this worker
+            const auto ranges = split.ranges();
+            const size_t first = ranges[ctx.rank()];
+            const size_t last = ranges[ctx.rank() + 1];
+
+            const size_t glob_offs = split.offset(first);
+            const size_t num = etext.size();
+            assert(num == split.offset(last) - glob_offs);
+
+            #ifdef DBG_AD
+            ctx.cout() << "nodes [" << first << "," << last << ") of level "
+                << (split_level+1) << ": " << num << " items at global offset "
+                << glob_offs << std::endl;
+            #endif
+
+            // stably sort received items by node
+            std::vector<size_t> sizes(last - first);
+            for(size_t k = 0; k < sizes.size(); k++) {
+                sizes[k] = node_sizes.size(first_level_node + first + k);
+            }
+
+            std::vector<size_t> node_pos;
+            {
+                std::vector<sym_t> sorted(num);
+                round_bucket_sort(etext, sizes, node_pos,
+                    [&](const sym_t x){ return size_t(x >> rsh) - first; },
+                    [&](const size_t i, const sym_t x){ sorted[i] = x; });
+                std::swap(etext, sorted);
+            }
+
+            // construct subtrees
+            WaveletTree::bits_t local_bits(height);
+            for(size_t level = split_level; level < height; level++) {
+                local_bits[level].resize(num);
+            }
+
+            for(size_t k = 0; k < sizes.size(); k++) {
+                if(sizes[k] == 0) continue;
+                wt_pc_levelwise<sym_t, idx_t>(local_bits,
+                    etext.data() + node_pos[k], sizes[k],
+                    first_level_node + first + k, height - split_level,
+                    node_pos[k]);
+            }
+
+            etext.clear();
+            etext.shrink_to_fit();
+
+            // the subtrees occupy the same global interval on every level,
+            // the first level is already in place
+            for(size_t level = std::max(split_level, size_t(1));
+                level < height; level++) {
+
+                if(num > 0) {
+                    exchange.add_bits(
+                        level, local_bits[level], 0, glob_offs, num);
+                }
+
+                local_bits[level].clear();
+                local_bits[level].shrink_to_fit();
+            }
+        }
+
+        // send and receive the bits of all levels but the first
+        ctx.cout_master() << "Distribute level bit vectors ..." << std::endl;
+        for(size_t level = 1; level < height; level++) {
+            bits[level].resize(local_num);
+        }
+
+        exchange.send(0);
+        exchange.receive(etext, 0, input.local_offset(), 0,
+            &bits, (height - 1) * local_num);
+
+        // synchronize before cleaning!
+        ctx.synchronize();
+        exchange.clear();
+    });
+
+    time.construct = dt();
+    time.merge = 0;
+
+    // write to disk if needed
+    if(output.length() > 0) {
+        ctx.synchronize();
+        ctx.cout_master() << "Writing WT to disk ..." << std::endl;
+
+        if(ctx.rank() == 0) {
+            hist.save(output + "." + WaveletTreeBase::histogram_extension());
+        }
+
+        wt.save(ctx, output);
+    }
+
+    // Synchronize for exit
+    ctx.cout_master() << "Waiting for exit signals ..." << std::endl;
+    ctx.synchronize();
+
+    // gather stats
+    Result result("mpi-ad", ctx, input, wt.sigma(), time);
+
+    ctx.cout_master() << result.readable() << std::endl
+                      << result.sqlplot() << std::endl;
+}
+};
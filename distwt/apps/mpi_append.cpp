@@ -0,0 +1,18 @@
+#include "mpi_append.hpp"
+
+int main(int argc, char** argv) {
+    const int ret = mpi_launch<mpi_append>(argc, argv,
+    [](tlx::CmdlineParser& cp){
+        cp.add_string('i', "existing", mpi_append::existing(),
+            "Output prefix of the existing WT or WM to append the input "
+            "to (required).");
+        cp.add_flag('M', "matrix", mpi_append::matrix(),
+            "The existing structure is a WM rather than a WT.");
+        cp.add_size_t('t', "levels-per-round", mpi_bsort::levels_per_round(),
+            "Number of levels to resolve per communication round when "
+            "constructing the appended text's structure "
+            "(default: automatic).");
+    });
+
+    return (ret == 0 && mpi_append::failed()) ? 1 : ret;
+}
@@ -0,0 +1,237 @@
+#pragma once
+
+#include "mpi_launcher.hpp"
+
+#include <string>
+#include <vector>
+
+#include <distwt/mpi/append.hpp>
+#include <distwt/mpi/even_partition.hpp>
+#include <distwt/mpi/file_partition_reader.hpp>
+
+#include <distwt/mpi/histogram.hpp>
+#include <distwt/mpi/effective_alphabet.hpp>
+#include <distwt/mpi/wm.hpp>
+#include <distwt/mpi/wt_levelwise.hpp>
+
+#include <distwt/mpi/result.hpp>
+
+#include "mpi_bsort.hpp"
+#include "mpi_wm_concat.hpp"
+
+// extends an existing levelwise WT or WM by a text appended to it
+//
+// the structure of the appended text is constructed with the code of the
+// existing one (using mpi-bsort or mpi-wm-concat, respectively) and then
+// merged into the existing levels, which are read in one streaming pass.
+// on each level, every node's bits are the existing node's bits followed
+// by the new node's bits. in the WM, the nodes of a level are the intervals
+// of items sharing the same bit-reversed prefix
+class mpi_append {
+public:
+    // the output prefix of the existing WT or WM
+    static std::string& existing() {
+        static std::string s_existing;
+        return s_existing;
+    }
+
+    // whether the existing structure is a wavelet matrix
+    static bool& matrix() {
+        static bool s_matrix = false;
+        return s_matrix;
+    }
+
+    // set if the suffix could not be appended, for the exit status
+    static bool& failed() {
+        static bool s_failed = false;
+        return s_failed;
+    }
+
+template<typename sym_t>
+static void start(
+    MPIContext& ctx,
+    const std::string& input_filename,
+    const size_t prefix,
+    const size_t in_rdbufsize,
+    const bool /* eff_input */,
+    const std::string& output) {
+
+    Result::Time time;
+    double t0 = ctx.time();
+
+    auto dt = [&](){
+        const double t = ctx.time();
+        const double dt = t - t0;
+        t0 = t;
+        return dt;
+    };
+
+    mpi_wm_concat::levels_per_round() = mpi_bsort::levels_per_round();
+
+    const std::string& old = existing();
+    if(old.empty() || output.empty() || old == output) {
+        ctx.cout_master() << "an existing output (-i) and a different "
+            "output (-o) must be given" << std::endl;
+        failed() = true;
+        return;
+    }
+
+    // Determine input partition of the appended text
+    FilePartitionReader<sym_t> input(ctx, input_filename, prefix);
+    const size_t local_num = input.local_num();
+    const size_t rdbufsize = (in_rdbufsize > 0) ? in_rdbufsize : local_num;
+    input.buffer(rdbufsize);
+
+    time.input = dt();
+
+    // Compute histogram of the appended text and merge it with the
+    // existing one
+    ctx.cout_master() << "Compute histogram ..." << std::endl;
+    Histogram<sym_t> old_hist(old + "." +
+        WaveletTreeBase::histogram_extension());
+    Histogram<sym_t> suffix_hist(ctx, input, rdbufsize);
+
+    AppendHistograms<sym_t> hists(old_hist, suffix_hist);
+    if(!hists.valid()) {
+        ctx.cout_master() << "the appended text contains symbols that are "
+            "less than existing ones, which changes the code of the "
+            "existing text - a full rebuild is required" << std::endl;
+        failed() = true;
+        return;
+    }
+
+    const auto& hist = hists.merged_hist();
+    const size_t old_num = old_hist.text_length();
+    const size_t new_num = suffix_hist.text_length();
+    const size_t old_height = WaveletTreeBase(old_hist).height();
+
+    time.hist = dt();
+
+    // Compute effective alphabet
+    EffectiveAlphabet<sym_t> ea(hist);
+
+    // Transform text and cache in RAM
+    ctx.cout_master() << "Compute effective transformation ..." << std::endl;
+    std::vector<sym_t> etext(local_num);
+    {
+        size_t i = 0;
+        ea.transform(input, [&](sym_t x){ etext[i++] = x; }, rdbufsize);
+    }
+
+    input.free();
+    time.eff = dt();
+
+    // the merged partition and the number of levels that the existing
+    // codes are extended by
+    const EvenPartition part(ctx, old_num + new_num);
+    const WaveletTreeBase merged_base(hist);
+    const size_t height = merged_base.height();
+    const size_t shift = height - old_height;
+
+    ctx.cout_master() << "Appending " << new_num << " to " << old_num
+        << " symbols (height " << old_height << " -> " << height << ") ..."
+        << std::endl;
+
+    // Construct the appended text's structure and merge levels
+    OldLevels old_levels(
+        ctx, old, WaveletTreeBase::level_extension, old_num);
+
+    const auto old_sizes = WaveletTreeBase::node_sizes(hists.old_hist());
+    const auto new_sizes = WaveletTreeBase::node_sizes(hists.new_hist());
+
+    auto merge = [&](std::vector<bv_t>& bits, std::vector<bv_t>& new_bits){
+        bits.resize(height);
+        for(size_t level = 0; level < height; level++) {
+            ctx.cout_master() << "level " << (level+1) << " ..." << std::endl;
+
+            merge_level(ctx, part,
+                merge_segments(old_sizes, new_sizes, level, shift, matrix()),
+                old_levels, level - shift, bits, level, new_bits[level],
+                input.local_offset());
+
+            new_bits[level].clear();
+            new_bits[level].shrink_to_fit();
+        }
+    };
+
+    if(matrix()) {
+        WaveletMatrix::bits_t new_bits;
+        WaveletMatrix(hists.new_hist(),
+        [&](WaveletMatrix::bits_t& bits, WaveletMatrix::z_t& z,
+            const WaveletMatrixBase& wm){
+
+            mpi_wm_concat::construct(ctx, input, wm, bits, z, etext);
+            new_bits = std::move(bits);
+        });
+
+        time.construct = dt();
+
+        auto wm = WaveletMatrix(hist,
+        [&](WaveletMatrix::bits_t& bits, WaveletMatrix::z_t& z,
+            const WaveletMatrixBase&){
+
+            merge(bits, new_bits);
+
+            // the Z values follow from the merged histogram
+            for(size_t level = 0; level < height; level++) {
+                const size_t rsh = height - 1 - level;
+                z[level] = 0;
+                for(size_t i = 0; i < hist.size(); i++) {
+                    if(!((i >> rsh) & 1)) z[level] += hist.entries[i].second;
+                }
+            }
+        });
+
+        time.merge = dt();
+
+        // write to disk
+        ctx.synchronize();
+        ctx.cout_master() << "Writing WM to disk ..." << std::endl;
+
+        if(ctx.rank() == 0) {
+            hist.save(output + "." + WaveletMatrixBase::histogram_extension());
+            wm.save_z(output + "." + WaveletMatrixBase::z_extension());
+        }
+
+        wm.save(ctx, output);
+    } else {
+        WaveletTree::bits_t new_bits;
+        WaveletTreeLevelwise(hists.new_hist(),
+        [&](WaveletTree::bits_t& bits, const WaveletTreeBase& wt){
+            mpi_bsort::construct(
+                ctx, input, hists.new_hist(), wt, bits, etext);
+            new_bits = std::move(bits);
+        });
+
+        time.construct = dt();
+
+        auto wt = WaveletTreeLevelwise(hist,
+        [&](WaveletTree::bits_t& bits, const WaveletTreeBase&){
+            merge(bits, new_bits);
+        });
+
+        time.merge = dt();
+
+        // write to disk
+        ctx.synchronize();
+        ctx.cout_master() << "Writing WT to disk ..." << std::endl;
+
+        if(ctx.rank() == 0) {
+            hist.save(output + "." + WaveletTreeBase::histogram_extension());
+        }
+
+        wt.save(ctx, output);
+    }
+
+    // Synchronize for exit
+    ctx.cout_master() << "Waiting for exit signals ..." << std::endl;
+    ctx.synchronize();
+
+    // gather stats
+    Result::annotate("existing", std::to_string(old_num));
+    Result result("mpi-append", ctx, input, hist.size(), time);
+
+    ctx.cout_master() << result.readable() << std::endl
+                      << result.sqlplot() << std::endl;
+}
+};
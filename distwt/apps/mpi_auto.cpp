@@ -0,0 +1,146 @@
+#include "mpi_launcher.hpp"
+
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include <tlx/string/format_si_iec_units.hpp>
+
+#include <distwt/mpi/cost_model.hpp>
+#include <distwt/mpi/file_partition_reader.hpp>
+#include <distwt/mpi/histogram.hpp>
+#include <distwt/mpi/result.hpp>
+
+#include "mpi_ad.hpp"
+#include "mpi_bsort.hpp"
+#include "mpi_dd.hpp"
+#include "mpi_dsplit.hpp"
+#include "mpi_dynbsort.hpp"
+#include "mpi_wm_concat.hpp"
+#include "mpi_wm_dd.hpp"
+#include "mpi_wm_dsplit.hpp"
+
+class mpi_auto {
+public:
+    static bool s_matrix;
+    static size_t s_mem_limit;
+
+template<typename sym_t>
+static void start(
+    MPIContext& ctx,
+    const std::string& input_filename,
+    const size_t prefix,
+    const size_t in_rdbufsize,
+    const bool /* eff_input */,
+    const std::string& output) {
+
+    Result::Time time;
+    double t0 = ctx.time();
+
+    auto dt = [&](){
+        const double t = ctx.time();
+        const double dt = t - t0;
+        t0 = t;
+        return dt;
+    };
+
+    // Determine input partition
+    // -> the reader and the histogram are handed to the chosen algorithm
+    FilePartitionReader<sym_t> input(ctx, input_filename, prefix);
+    const size_t local_num = input.local_num();
+    const size_t rdbufsize = (in_rdbufsize > 0) ? in_rdbufsize : local_num;
+    input.buffer(rdbufsize);
+
+    time.input = dt();
+
+    // Compute histogram
+    ctx.cout_master() << "Compute histogram ..." << std::endl;
+    Histogram<sym_t> hist(ctx, input, rdbufsize);
+
+    time.hist = dt();
+
+    // Predict costs from the histogram
+    const std::vector<CostPrediction> costs =
+        predict_costs(hist, ctx.node_layout(), s_matrix);
+
+    // Determine memory limit
+    // by default, the physical memory is shared by the node's workers
+    size_t mem_limit = s_mem_limit;
+    if(mem_limit == 0) {
+        const size_t local_limit =
+            size_t(sysconf(_SC_PHYS_PAGES)) * size_t(sysconf(_SC_PAGE_SIZE)) /
+            ctx.num_workers_per_node();
+
+        // all workers must agree
+        ctx.all_reduce(&local_limit, &mem_limit, 1, MPI_MIN);
+    }
+
+    // Pick the fastest algorithm that fits into memory,
+    // or the one requiring the least memory if none does
+    const CostPrediction* choice = nullptr;
+    for(const auto& c : costs) {
+        ctx.cout_master() << c.algo << ": "
+            << tlx::format_iec_units(c.memory, 3) << "B per worker, "
+            << tlx::format_iec_units(c.traffic.inter, 3) << "B inter-node and "
+            << tlx::format_iec_units(c.traffic.intra, 3) << "B intra-node traffic, "
+            << "imbalance " << c.imbalance << ", ~" << c.time << "s"
+            << std::endl;
+
+        if(c.memory <= mem_limit && (!choice || c.time < choice->time)) {
+            choice = &c;
+        }
+    }
+
+    std::string reason = "fastest_within_memory_limit";
+    if(!choice) {
+        reason = "least_memory_none_fits";
+        for(const auto& c : costs) {
+            if(!choice || c.memory < choice->memory) choice = &c;
+        }
+    }
+
+    ctx.cout_master() << "Choosing " << choice->algo << " (" << reason
+        << ", memory limit " << tlx::format_iec_units(mem_limit, 3)
+        << "B per worker) ..." << std::endl;
+
+    Result::annotate("auto_choice", choice->algo);
+    Result::annotate("auto_reason", reason);
+    Result::annotate("auto_mem_limit", std::to_string(mem_limit));
+    Result::annotate("auto_pred_memory", std::to_string(choice->memory));
+    Result::annotate("auto_pred_time", std::to_string(choice->time));
+
+    // Run the chosen algorithm
+    const std::string& algo = choice->algo;
+    if(algo == "mpi-ad") {
+        mpi_ad::run(ctx, input, hist, rdbufsize, output, time);
+    } else if(algo == "mpi-bsort") {
+        mpi_bsort::run(ctx, input, hist, rdbufsize, output, time);
+    } else if(algo == "mpi-dynbsort") {
+        mpi_dynbsort::run(ctx, input, hist, rdbufsize, output, time);
+    } else if(algo == "mpi-dd") {
+        mpi_dd::run(ctx, input, hist, rdbufsize, output, time);
+    } else if(algo == "mpi-dsplit") {
+        mpi_dsplit::run(ctx, input, hist, rdbufsize, output, time);
+    } else if(algo == "mpi-wm-concat") {
+        mpi_wm_concat::run(ctx, input, hist, rdbufsize, output, time);
+    } else if(algo == "mpi-wm-dd") {
+        mpi_wm_dd::run(ctx, input, hist, rdbufsize, output, time);
+    } else if(algo == "mpi-wm-dsplit") {
+        mpi_wm_dsplit::run(ctx, input, hist, rdbufsize, output, time);
+    }
+}
+};
+
+bool mpi_auto::s_matrix = false;
+size_t mpi_auto::s_mem_limit = 0;
+
+int main(int argc, char** argv) {
+    return mpi_launch<mpi_auto>(argc, argv, [](tlx::CmdlineParser& cp){
+        cp.add_flag('M', "matrix", mpi_auto::s_matrix,
+            "Construct a wavelet matrix instead of a wavelet tree.");
+        cp.add_bytes('L', "mem-limit", mpi_auto::s_mem_limit,
+            "Memory limit per worker (default: physical memory divided "
+            "by the number of workers per node).");
+    });
+}
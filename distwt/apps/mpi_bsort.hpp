@@ -0,0 +1,1073 @@
+#pragma once
+
+#include "mpi_launcher.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <memory>
+#include <vector>
+
+#include <tlx/math/integer_log2.hpp>
+
+#include <distwt/mpi/boundary_scan.hpp>
+#include <distwt/mpi/bucket_exchange.hpp>
+#include <distwt/mpi/external.hpp>
+#include <distwt/mpi/file_partition_reader.hpp>
+#include <distwt/mpi/level_rounds.hpp>
+#include <distwt/mpi/level_stream.hpp>
+#include <distwt/mpi/mapped_levels.hpp>
+
+#include <distwt/common/wt.hpp>
+#include <distwt/common/wt_sequential.hpp>
+#include <distwt/mpi/histogram.hpp>
+#include <distwt/mpi/effective_alphabet.hpp>
+#include <distwt/mpi/multiary.hpp>
+#include <distwt/mpi/wt_levelwise.hpp>
+
+#include <distwt/mpi/result.hpp>
+
+//#define DBG_BSORT 1
+
+class mpi_bsort {
+public:
+    // number of levels to resolve per communication round (0 = automatic)
+    static size_t& levels_per_round() {
+        static size_t s_levels_per_round = 0;
+        return s_levels_per_round;
+    }
+
+    // whether to use the hybrid construction
+    static bool& hybrid() {
+        static bool s_hybrid = false;
+        return s_hybrid;
+    }
+
+    // the number of children of each node (2, 4 or 16)
+    static size_t& arity() {
+        static size_t s_arity = 2;
+        return s_arity;
+    }
+
+    // set if the given options are invalid, for the exit status
+    static bool& failed() {
+        static bool s_failed = false;
+        return s_failed;
+    }
+
+    // whether to write levels to the output as soon as they are final
+    static bool& stream() {
+        static bool s_stream = false;
+        return s_stream;
+    }
+
+    // whether to construct levels directly into mapped output files
+    static bool& mapped() {
+        static bool s_mapped = false;
+        return s_mapped;
+    }
+
+    // the memory budget per worker in bytes (0 = unlimited)
+    static size_t& memory_budget() {
+        static size_t s_memory_budget = 0;
+        return s_memory_budget;
+    }
+
+    // the bytes of the memory budget that are reserved for the buffers of
+    // a WT construction over an alphabet of size sigma whose sizes do not
+    // depend on the number of local items, i.e., the C array and those of
+    // a bucket sort round over the up to 2*sigma buckets of a level
+    static size_t budget_reserve(MPIContext& ctx, const size_t sigma) {
+        return (sigma + 1) * sizeof(size_t) +
+            external_round_reserve(2 * sigma, ctx.num_workers());
+    }
+
+    // whether the in-RAM construction of a WT with the given height over
+    // local_num items would exceed the memory budget, accounting for the
+    // text, the sort buffer, the received message and MPI's copy of an
+    // outgoing one, the levels, the level bits that are sent along in a
+    // round (sent and received) and the reserved buffers
+    template<typename sym_t>
+    static bool exceeds_budget(
+        MPIContext& ctx,
+        const size_t local_num,
+        const size_t sigma,
+        const size_t height) {
+
+        const size_t budget = memory_budget();
+        return budget > 0 &&
+            local_num * external_round_buffers * sizeof(sym_t) +
+            3 * height * local_num / 8 +
+            budget_reserve(ctx, sigma) > budget;
+    }
+
+// hybrid construction: bucket sort rounds are only performed for nodes that
+// straddle a partition boundary
+//
+// a node that lies entirely within a worker's partition occupies the same
+// global interval on all levels below, so its whole subtree is computed
+// locally using prefix counting. only the items of straddling nodes are
+// redistributed to the next level. since each partition boundary lies in
+// only one node per level, at most p-1 nodes per level take part
+template<typename sym_t, typename partition_t>
+static void construct_hybrid(
+    MPIContext& ctx,
+    const partition_t& input,
+    const Histogram<sym_t>& hist,
+    const WaveletTreeBase& wt,
+    WaveletTree::bits_t& bits,
+    std::vector<sym_t>& etext) {
+
+    const size_t height = wt.height();
+    const size_t local_num = input.local_num();
+    const size_t size_per_worker = input.size_per_worker();
+    const size_t local_offs = input.local_offset();
+    const size_t local_end = local_offs + local_num;
+
+    const auto c = hist.compute_C();
+    const auto node_sizes = WaveletTreeBase::node_sizes(hist);
+
+    for(size_t level = 0; level < height; level++) {
+        bits[level].resize(local_num);
+    }
+
+    // the node (zero-based within its level) covering global position x
+    auto node_at = [&](const size_t level, const size_t x){
+        const size_t sym =
+            std::upper_bound(c.begin(), c.end(), idx_t(x)) - c.begin() - 1;
+        return sym >> (height - level);
+    };
+
+    // the nodes of the current level whose items still need processing,
+    // i.e., the children of nodes that straddle a partition boundary
+    std::vector<size_t> open = { 1 };
+
+    std::vector<sym_t> buffer;
+    std::vector<size_t> straddling;
+    BucketExchange<sym_t> exchange(ctx, size_per_worker);
+
+    size_t num_rounds = 0;
+    for(size_t level = 0; level < height && !open.empty(); level++) {
+        const int tag = int(level);
+        const size_t rsh = height - 1 - level;
+        const bool last = (level + 1 == height);
+
+        // process local parts of open nodes
+        straddling.clear();
+        size_t expect = 0;
+        for(const size_t v : open) {
+            const size_t offs = node_sizes.offset(v);
+            const size_t size = node_sizes.size(v);
+            if(size == 0) continue;
+
+            const bool straddles = (offs / size_per_worker) !=
+                ((offs + size - 1) / size_per_worker);
+
+            const size_t a = std::max(offs, local_offs);
+            const size_t b = std::min(offs + size, local_end);
+
+            if(straddles && !last) {
+                straddling.push_back(v);
+                if(a < b) expect += b - a;
+            }
+
+            if(a >= b) continue;
+
+            if(straddles) {
+                // compute this level only
+                auto& level_bits = bits[level];
+                for(size_t i = a - local_offs; i < b - local_offs; i++) {
+                    level_bits[i] = bool((etext[i] >> rsh) & 1);
+                }
+            } else {
+                // compute the whole subtree locally
+                wt_pc_levelwise<sym_t, idx_t>(bits,
+                    etext.data() + (a - local_offs), b - a,
+                    v, height - level, a - local_offs);
+            }
+        }
+
+        if(straddling.empty()) break;
+
+        ctx.cout_master() << "level " << (level+1) << ": "
+            << straddling.size() << " straddling node(s) ..." << std::endl;
+        ++num_rounds;
+
+        // only the items of the first local node can be preceded by items
+        // on other workers - count those
+        const bool empty = (local_num == 0);
+        const size_t first_node = empty ? 0 : node_at(level, local_offs);
+        const size_t last_node = empty ? 0 : node_at(level, local_end - 1);
+        const size_t first_level_node = 1ULL << level;
+
+        // stably sort the local items of straddling nodes into the buckets
+        // of their children
+        struct LocalPart {
+            size_t node_id;
+            size_t pos;     // local position of the first item
+            size_t num[2];  // number of items in either child bucket
+        };
+        std::vector<LocalPart> parts;
+
+        buffer.resize(local_num);
+        std::vector<size_t> last_num = { 0, 0 };
+        for(const size_t v : straddling) {
+            const size_t offs = node_sizes.offset(v);
+            const size_t a = std::max(offs, local_offs);
+            const size_t b = std::min(offs + node_sizes.size(v), local_end);
+            if(a >= b) continue;
+
+            const size_t i0 = a - local_offs;
+            const size_t i1 = b - local_offs;
+
+            size_t num1 = 0;
+            for(size_t i = i0; i < i1; i++) {
+                num1 += (etext[i] >> rsh) & 1;
+            }
+
+            LocalPart part { v, i0, { (i1 - i0) - num1, num1 } };
+            if(v - first_level_node == last_node) {
+                last_num = { part.num[0], part.num[1] };
+            }
+
+            size_t pos[2] = { i0, i0 + part.num[0] };
+            for(size_t i = i0; i < i1; i++) {
+                const sym_t x = etext[i];
+                buffer[pos[(x >> rsh) & 1]++] = x;
+            }
+
+            parts.push_back(part);
+        }
+
+        const auto boundary_offs = boundary_ex_scan(
+            ctx, empty, first_node, last_node, last_num);
+
+        // send buckets away, coalesced by target
+        for(const auto& part : parts) {
+            const size_t v = part.node_id;
+            const bool first = (v - first_level_node == first_node);
+
+            size_t pos = part.pos;
+            for(size_t b = 0; b < 2; b++) {
+                if(part.num[b] > 0) {
+                    const size_t glob_bucket_offs =
+                        node_sizes.offset(2 * v + b) +
+                        (first ? boundary_offs[b] : 0);
+
+                    exchange.add(
+                        buffer.data() + pos, glob_bucket_offs, part.num[b]);
+                }
+                pos += part.num[b];
+            }
+        }
+        exchange.send(tag);
+
+        // receive the items of the children of straddling nodes
+        exchange.receive(etext, expect, local_offs, tag);
+
+        // synchronize before cleaning!
+        ctx.synchronize();
+
+        // clean up
+        exchange.clear();
+
+        // continue with the children of straddling nodes
+        open.clear();
+        for(const size_t v : straddling) {
+            open.push_back(2 * v);
+            open.push_back(2 * v + 1);
+        }
+    }
+
+    ctx.cout_master() << "Hybrid construction took " << num_rounds
+        << " communication round(s)." << std::endl;
+}
+
+// constructs the levels of the wavelet tree of the text, whose local part
+// is given in etext and is reordered in the process
+//
+// input determines the text's partition, like FilePartitionReader does.
+// if a level stream is given, each level is handed over to it as soon as
+// it is final and is not retained in bits. if mapped levels are given, one
+// level is resolved per round and written directly into them instead
+template<typename sym_t, typename partition_t>
+static void construct(
+    MPIContext& ctx,
+    const partition_t& input,
+    const Histogram<sym_t>& hist,
+    const WaveletTreeBase& wt,
+    WaveletTree::bits_t& bits,
+    std::vector<sym_t>& etext,
+    LevelStream* level_stream = nullptr,
+    MappedLevels* mapped_levels = nullptr) {
+
+    const size_t local_num = input.local_num();
+    const size_t height = wt.height();
+    const size_t sigma = wt.sigma();
+    const auto c = hist.compute_C();
+
+    bits.resize(height);
+
+    #if DBG_BSORT
+    ctx.cout() << "size per worker: " << input.size_per_worker()
+               << ", local_num: " << local_num
+               << std::endl;
+    ctx.synchronize();
+    #endif
+
+    // hands over the levels up to (excluding) the given one to the stream
+    size_t num_streamed = 0;
+    auto stream_levels = [&](const size_t end){
+        for(; level_stream && num_streamed < end; num_streamed++) {
+            level_stream->push(num_streamed, bits[num_streamed]);
+        }
+    };
+
+    if(hybrid() && !mapped_levels) {
+        // subtrees are constructed locally across all levels below, so
+        // levels are only final at the very end
+        construct_hybrid(ctx, input, hist, wt, bits, etext);
+        stream_levels(height);
+        return;
+    }
+
+    // resolve several levels per communication round
+    // -> levels received as packed slices cannot be mapped
+    const size_t tau = mapped_levels
+        ? 1 : choose_levels_per_round(height, levels_per_round());
+    ctx.cout_master() << "Resolving " << tau
+        << " level(s) per round ..." << std::endl;
+
+    std::vector<sym_t> buffer(local_num);
+    std::vector<size_t> bucket_pos;
+    bv_t round_bits;
+
+    BucketExchange<sym_t> exchange(ctx, input.size_per_worker());
+    for(size_t level = 0; level < height; level += tau) {
+        const int tag = int(level);
+
+        // afterwards, the text is sorted by the nodes of next_level
+        const size_t num_levels = std::min(tau, height - level);
+        const size_t next_level = level + num_levels;
+        const bool last = (next_level == height);
+
+        ctx.cout_master() << "levels " << (level+1) << " to "
+            << next_level << " ..." << std::endl;
+
+        if(last) {
+            // free unneeded memory on last round
+            buffer.clear();
+            buffer.shrink_to_fit();
+        }
+
+        // the local text is sorted by the nodes of the current level,
+        // so the level's bit vector can be constructed in place
+        const size_t rsh = height - 1 - level;
+        if(mapped_levels) {
+            mapped_levels->assign(level, [&](const size_t i){
+                return (etext[i] >> rsh) & 1;
+            });
+        } else {
+            auto& level_bits = bits[level];
+            level_bits.resize(local_num);
+            for(size_t i = 0; i < local_num; i++) {
+                level_bits[i] = bool((etext[i] >> rsh) & 1);
+            }
+        }
+
+        // the bits of the remaining levels of the round, as well as the
+        // text sorted by the nodes of next_level, are sent to the
+        // workers holding their global positions
+        const size_t num_sorted = last ? num_levels - 1 : num_levels;
+        if(num_sorted == 0) break;
+
+        // the local nodes form a contiguous range
+        // [first_node, last_node] of the current level, so their
+        // descendants j levels below form the contiguous range of
+        // buckets [first_node << j, (last_node+1) << j)
+        const bool empty = (local_num == 0);
+        const size_t first_node =
+            empty ? 0 : size_t(etext[0] >> (rsh+1));
+        const size_t last_node =
+            empty ? 0 : size_t(etext[local_num-1] >> (rsh+1));
+        const size_t num_nodes = empty ? 0 : last_node - first_node + 1;
+
+        // count bucket sizes on the deepest level in one scan and sum
+        // them up for the levels above
+        std::vector<std::vector<size_t>> bucket_sizes(num_sorted + 1);
+        {
+            auto& deepest = bucket_sizes[num_sorted];
+            deepest.resize(num_nodes << num_sorted);
+
+            const size_t first_bucket = first_node << num_sorted;
+            const size_t sh = rsh + 1 - num_sorted;
+            for(size_t i = 0; i < local_num; i++) {
+                ++deepest[size_t(etext[i] >> sh) - first_bucket];
+            }
+
+            for(size_t j = num_sorted - 1; j > 0; j--) {
+                auto& sizes = bucket_sizes[j];
+                sizes.resize(num_nodes << j);
+                for(size_t k = 0; k < sizes.size(); k++) {
+                    sizes[k] = bucket_sizes[j+1][2*k] +
+                        bucket_sizes[j+1][2*k+1];
+                }
+            }
+        }
+
+        // only the descendants of the first local node can be preceded
+        // by items on other workers - count those
+        // boundary counts of level j start at index 2^j - 2
+        std::vector<size_t> boundary_offs;
+        {
+            std::vector<size_t> last_num;
+            for(size_t j = 1; j <= num_sorted; j++) {
+                const size_t num_desc = 1ULL << j;
+                if(empty) {
+                    last_num.insert(last_num.end(), num_desc, 0);
+                } else {
+                    last_num.insert(last_num.end(),
+                        bucket_sizes[j].end() - num_desc,
+                        bucket_sizes[j].end());
+                }
+            }
+
+            boundary_offs = boundary_ex_scan(
+                ctx, empty, first_node, last_node, last_num);
+        }
+
+        // the global offset of bucket k of the level j levels below
+        auto glob_bucket_offs = [&](const size_t j, const size_t k){
+            const size_t v = (first_node << j) + k;
+
+            // the global node offset is determined by the
+            // symbols preceding the node's alphabet interval
+            const size_t glob_node_offs =
+                c[std::min(v << (rsh + 1 - j), sigma)];
+
+            return glob_node_offs + ((v >> j) == first_node
+                ? boundary_offs[(1ULL << j) - 2 + k] : 0);
+        };
+
+        // stably sorts the local text into the buckets of the level j
+        // levels below
+        auto bucket_sort = [&](const size_t j, auto f){
+            const size_t first_bucket = first_node << j;
+            const size_t sh = rsh + 1 - j;
+            round_bucket_sort(etext, bucket_sizes[j], bucket_pos,
+                [&](const sym_t x){
+                    return size_t(x >> sh) - first_bucket;
+                }, f);
+        };
+
+        // send the bits of the intermediate levels
+        // -> they are packed right away, so the buffer can be reused
+        round_bits.resize(local_num);
+        for(size_t j = 1; j < num_levels; j++) {
+            const size_t blevel = level + j;
+            bits[blevel].resize(local_num);
+
+            bucket_sort(j, [&](const size_t i, const sym_t x){
+                round_bits[i] = bool((x >> (rsh - j)) & 1);
+            });
+
+            const auto& sizes = bucket_sizes[j];
+            for(size_t k = 0; k < sizes.size(); k++) {
+                if(sizes[k] > 0) {
+                    exchange.add_bits(blevel, round_bits, bucket_pos[k],
+                        glob_bucket_offs(j, k), sizes[k]);
+                }
+            }
+        }
+
+        // distribute buckets of next_level
+        // -> using locality to apply merge directly unlike after DD!
+        // -> this corresponds to bucket sort with < sigma keys
+        if(!last) {
+            bucket_sort(num_levels, [&](const size_t i, const sym_t x){
+                buffer[i] = x;
+            });
+
+            // send buckets away, coalesced by target
+            const auto& sizes = bucket_sizes[num_levels];
+            for(size_t k = 0; k < sizes.size(); k++) {
+                if(sizes[k] > 0) {
+                    const size_t offs = glob_bucket_offs(num_levels, k);
+
+                    #ifdef DBG_BSORT
+                    ctx.cout() << "processing bucket " << k
+                        << " with global offset = " << offs
+                        << std::endl;
+                    #endif
+
+                    exchange.add(
+                        buffer.data() + bucket_pos[k], offs, sizes[k]);
+                }
+            }
+        }
+        exchange.send(tag);
+
+        // receive substrings and bits until filled locally
+        exchange.receive(
+            etext, last ? 0 : local_num, input.local_offset(),
+            tag, &bits, (num_levels - 1) * local_num);
+
+        // synchronize before cleaning!
+        ctx.synchronize();
+
+        // clean up
+        exchange.clear();
+
+        // the levels of this round are final
+        stream_levels(next_level);
+    }
+    stream_levels(height);
+}
+
+// constructs the levels of the wavelet tree of the text, whose local part
+// is stored in the external text, within the memory budget
+//
+// one level is resolved per round. the text is scanned in chunks to write
+// the level's bits directly to the output files (if any) and to count the
+// local bucket sizes. it is then redistributed chunk by chunk into a second
+// external text, so that only a few chunks are held in RAM at any time
+//
+// the chunk size is chosen such that the buffers of a bucket sort round,
+// which are live at the same time, fit into what is left of the memory
+// budget after the buffers whose sizes only depend on sigma
+template<typename sym_t, typename partition_t>
+static void construct_external(
+    MPIContext& ctx,
+    const partition_t& input,
+    const Histogram<sym_t>& hist,
+    const WaveletTreeBase& wt,
+    ExternalText<sym_t>& etext,
+    const std::string& output) {
+
+    const size_t local_num = input.local_num();
+    const size_t height = wt.height();
+    const size_t sigma = wt.sigma();
+    const auto c = hist.compute_C();
+
+    const size_t chunk_size = external_chunk_size(memory_budget(),
+        budget_reserve(ctx, sigma), external_round_buffers * sizeof(sym_t));
+    ctx.cout_master() << "Processing the text in chunks of " << chunk_size
+        << " symbol(s) ..." << std::endl;
+
+    ExternalText<sym_t> other(ctx, local_num, "bsort.b");
+    ExternalText<sym_t>* src = &etext;
+    ExternalText<sym_t>* dst = &other;
+
+    for(size_t level = 0; level < height; level++) {
+        ctx.cout_master() << "level " << (level+1) << " ..." << std::endl;
+
+        const size_t rsh = height - 1 - level;
+        const bool last = (level + 1 == height);
+
+        // the local nodes form a contiguous range [first_node, last_node]
+        const bool empty = (local_num == 0);
+        size_t first_node = 0, last_node = 0;
+        if(!empty) {
+            sym_t x;
+            src->read(0, 1, &x);
+            first_node = size_t(x >> (rsh + 1));
+            src->read(local_num - 1, 1, &x);
+            last_node = size_t(x >> (rsh + 1));
+        }
+        const size_t num_nodes = empty ? 0 : last_node - first_node + 1;
+        const size_t first_bucket = 2 * first_node;
+
+        // write the level's bits and count the sizes of the child buckets
+        // -> the chunk is released before the bucket round allocates its own
+        std::vector<size_t> bucket_sizes(last ? 0 : 2 * num_nodes);
+        {
+            std::vector<sym_t> chunk;
+            LevelWriter writer(LevelWriter::filename(
+                ctx, output, WaveletTreeBase::level_extension(level)));
+
+            src->scan(chunk_size, chunk,
+            [&](const size_t, const std::vector<sym_t>& text){
+                for(const sym_t x : text) {
+                    writer.push(bool((x >> rsh) & 1));
+                    if(!last) ++bucket_sizes[size_t(x >> rsh) - first_bucket];
+                }
+            });
+        }
+
+        if(last) break;
+
+        // only the children of the first local node can be preceded by
+        // items on other workers - count those
+        std::vector<size_t> boundary_offs;
+        {
+            std::vector<size_t> last_num(2, 0);
+            if(!empty) {
+                last_num.assign(bucket_sizes.end() - 2, bucket_sizes.end());
+            }
+
+            boundary_offs = boundary_ex_scan(
+                ctx, empty, first_node, last_node, last_num);
+        }
+
+        std::vector<size_t> glob_offs(bucket_sizes.size());
+        for(size_t k = 0; k < glob_offs.size(); k++) {
+            const size_t v = first_bucket + k;
+            const size_t glob_node_offs = c[std::min(v << rsh, sigma)];
+            glob_offs[k] = glob_node_offs + (k < 2 ? boundary_offs[k] : 0);
+        }
+
+        external_bucket_round(ctx, *src, *dst, input.local_offset(),
+            input.size_per_worker(), chunk_size, std::move(glob_offs),
+            [&](const sym_t x){ return size_t(x >> rsh) - first_bucket; },
+            int(level));
+
+        std::swap(src, dst);
+    }
+}
+
+// constructs the levels of the 2^k-ary wavelet tree of the text, whose
+// local part is given in etext and is reordered in the process
+//
+// each level takes one communication round, in which the local items of
+// each node are stably sorted into the 2^k buckets of its children by
+// their next digit, i.e., a k-bit radix step
+template<size_t k, typename sym_t>
+static void construct_multiary(
+    MPIContext& ctx,
+    const FilePartitionReader<sym_t>& input,
+    const Histogram<sym_t>& hist,
+    const WaveletTreeMultiary<k>& wt,
+    typename WaveletTreeMultiary<k>::levels_t& levels,
+    std::vector<sym_t>& etext) {
+
+    using layout = MultiaryLayout<k>;
+
+    const size_t local_num = input.local_num();
+    const size_t num_levels = wt.num_levels();
+    const size_t sigma = wt.sigma();
+    const size_t num_children = layout::arity;
+    const auto c = hist.compute_C();
+
+    levels.resize(num_levels);
+
+    std::vector<sym_t> buffer(local_num);
+    std::vector<size_t> bucket_sizes;
+    std::vector<size_t> bucket_pos;
+
+    BucketExchange<sym_t> exchange(ctx, input.size_per_worker());
+    for(size_t level = 0; level < num_levels; level++) {
+        const int tag = int(level);
+
+        ctx.cout_master() << "level " << (level+1) << " ..." << std::endl;
+
+        // the local text is sorted by the nodes of the current level,
+        // so the level's digits can be computed in place
+        {
+            auto& digits = levels[level];
+            digits.resize(local_num);
+            for(size_t i = 0; i < local_num; i++) {
+                digits.set(i, layout::digit(etext[i], level, num_levels));
+            }
+        }
+
+        if(level + 1 == num_levels) break;
+
+        // the local nodes form a contiguous range [first_node, last_node]
+        // of the current level, so their children form a contiguous range
+        // of buckets starting at first_node * num_children
+        const bool empty = (local_num == 0);
+        const size_t first_node = empty ? 0 :
+            layout::prefix(etext[0], level, num_levels);
+        const size_t last_node = empty ? 0 :
+            layout::prefix(etext[local_num-1], level, num_levels);
+        const size_t num_nodes = empty ? 0 : last_node - first_node + 1;
+        const size_t first_bucket = first_node * num_children;
+
+        auto bucket = [&](const sym_t x){
+            return layout::prefix(x, level + 1, num_levels) - first_bucket;
+        };
+
+        bucket_sizes.assign(num_nodes * num_children, 0);
+        for(size_t i = 0; i < local_num; i++) {
+            ++bucket_sizes[bucket(etext[i])];
+        }
+
+        // only the children of the first local node can be preceded by
+        // items on other workers - count those
+        std::vector<size_t> boundary_offs;
+        {
+            std::vector<size_t> last_num(num_children, 0);
+            if(!empty) {
+                last_num.assign(bucket_sizes.end() - num_children,
+                    bucket_sizes.end());
+            }
+
+            boundary_offs = boundary_ex_scan(
+                ctx, empty, first_node, last_node, last_num);
+        }
+
+        round_bucket_sort(etext, bucket_sizes, bucket_pos, bucket,
+            [&](const size_t i, const sym_t x){ buffer[i] = x; });
+
+        // send buckets away, coalesced by target
+        // the global offset of a bucket is determined by the symbols
+        // preceding its alphabet interval
+        const size_t lsh = k * (num_levels - 1 - level);
+        for(size_t b = 0; b < bucket_sizes.size(); b++) {
+            if(bucket_sizes[b] > 0) {
+                const size_t v = first_bucket + b;
+                const size_t glob_node_offs = c[std::min(v << lsh, sigma)];
+                const size_t offs = glob_node_offs +
+                    (b < num_children ? boundary_offs[b] : 0);
+
+                #ifdef DBG_BSORT
+                ctx.cout() << "processing bucket " << v
+                    << " with global offset = " << offs << std::endl;
+                #endif
+
+                exchange.add(
+                    buffer.data() + bucket_pos[b], offs, bucket_sizes[b]);
+            }
+        }
+        exchange.send(tag);
+
+        // receive the next level's items
+        exchange.receive(etext, local_num, input.local_offset(), tag);
+
+        // synchronize before cleaning!
+        ctx.synchronize();
+
+        // clean up
+        exchange.clear();
+    }
+}
+
+template<size_t k, typename sym_t>
+static void start_multiary(
+    MPIContext& ctx,
+    const std::string& input_filename,
+    const size_t prefix,
+    const size_t in_rdbufsize,
+    const std::string& output) {
+
+    Result::Time time;
+    double t0 = ctx.time();
+
+    auto dt = [&](){
+        const double t = ctx.time();
+        const double dt = t - t0;
+        t0 = t;
+        return dt;
+    };
+
+    // Determine input partition
+    FilePartitionReader<sym_t> input(ctx, input_filename, prefix);
+    const size_t local_num = input.local_num();
+    const size_t rdbufsize = (in_rdbufsize > 0) ? in_rdbufsize : local_num;
+    input.buffer(rdbufsize);
+
+    time.input = dt();
+
+    // Compute histogram
+    ctx.cout_master() << "Compute histogram ..." << std::endl;
+    Histogram<sym_t> hist(ctx, input, rdbufsize);
+
+    time.hist = dt();
+
+    // Compute effective alphabet
+    EffectiveAlphabet<sym_t> ea(hist);
+
+    // Transform text and cache in RAM
+    ctx.cout_master() << "Compute effective transformation ..." << std::endl;
+    std::vector<sym_t> etext(local_num);
+    {
+        size_t i = 0;
+        ea.transform(input, [&](sym_t x){ etext[i++] = x; }, rdbufsize);
+    }
+
+    input.free();
+    time.eff = dt();
+
+    using wt_t = WaveletTreeMultiary<k>;
+    auto wt = wt_t(hist,
+    [&](typename wt_t::levels_t& levels, const wt_t& wt){
+        construct_multiary<k>(ctx, input, hist, wt, levels, etext);
+    });
+
+    time.construct = dt();
+    time.merge = 0;
+
+    // write to disk if needed
+    if(output.length() > 0) {
+        ctx.synchronize();
+        ctx.cout_master() << "Writing WT to disk ..." << std::endl;
+
+        if(ctx.rank() == 0) {
+            hist.save(output + "." + WaveletTreeBase::histogram_extension());
+            wt_t::layout::save_arity(
+                output + "." + wt_t::layout::arity_extension());
+        }
+
+        wt.save(ctx, output);
+    }
+
+    // Synchronize for exit
+    ctx.cout_master() << "Waiting for exit signals ..." << std::endl;
+    ctx.synchronize();
+
+    // gather stats
+    Result::annotate("arity", std::to_string(wt_t::layout::arity));
+    Result result("mpi-bsort", ctx, input, wt.sigma(), time);
+
+    ctx.cout_master() << result.readable() << std::endl
+                      << result.sqlplot() << std::endl;
+}
+
+// the remainder of start for a construction within the memory budget
+template<typename sym_t, typename dt_f>
+static void start_external(
+    MPIContext& ctx,
+    const FilePartitionReader<sym_t>& input,
+    const Histogram<sym_t>& hist,
+    const EffectiveAlphabet<sym_t>& ea,
+    const size_t rdbufsize,
+    const std::string& output,
+    Result::Time& time,
+    dt_f& dt,
+    const BudgetCheck& budget_check) {
+
+    // Transform text and store it on disk
+    ctx.cout_master() << "Compute effective transformation (external) ..."
+        << std::endl;
+    ExternalText<sym_t> etext(ctx, input.local_num(), "bsort.a");
+    {
+        std::vector<sym_t> chunk;
+        chunk.reserve(rdbufsize);
+
+        size_t i = 0;
+        ea.transform(input, [&](sym_t x){
+            chunk.push_back(x);
+            if(chunk.size() == rdbufsize) {
+                etext.write(i, chunk.data(), chunk.size());
+                i += chunk.size();
+                chunk.clear();
+            }
+        }, rdbufsize);
+        etext.write(i, chunk.data(), chunk.size());
+    }
+
+    time.eff = dt();
+
+    // the levels are written to disk during construction
+    if(ctx.rank() == 0 && output.length() > 0) {
+        hist.save(output + "." + WaveletTreeBase::histogram_extension());
+    }
+
+    auto wt = WaveletTreeLevelwise(hist,
+    [&](WaveletTree::bits_t&, const WaveletTreeBase& wt){
+        construct_external(ctx, input, hist, wt, etext, output);
+    });
+
+    time.construct = dt();
+    time.merge = 0;
+
+    const size_t budget_used = budget_check.finish(ctx);
+
+    // Synchronize for exit
+    ctx.cout_master() << "Waiting for exit signals ..." << std::endl;
+    ctx.synchronize();
+
+    // gather stats
+    Result::annotate("budget", std::to_string(memory_budget()));
+    Result::annotate("budget_used", std::to_string(budget_used));
+    Result result("mpi-bsort", ctx, input, wt.sigma(), time);
+
+    ctx.cout_master() << result.readable() << std::endl
+                      << result.sqlplot() << std::endl;
+}
+
+template<typename sym_t>
+static void start(
+    MPIContext& ctx,
+    const std::string& input_filename,
+    const size_t prefix,
+    const size_t in_rdbufsize,
+    const bool eff_input,
+    const std::string& output) {
+
+    // the multiary construction does not support these options, and
+    // silently ignoring them would not give what was asked for
+    if(arity() != 2 && (memory_budget() > 0 || stream() || mapped())) {
+        ctx.cout_master() << "the options -m, -s and -f are only supported "
+            "for the binary WT (-a 2)" << std::endl;
+        failed() = true;
+        return;
+    }
+
+    switch(arity()) {
+        case 2: break;
+
+        case 4:
+            start_multiary<2, sym_t>(
+                ctx, input_filename, prefix, in_rdbufsize, output);
+            return;
+
+        case 16:
+            start_multiary<4, sym_t>(
+                ctx, input_filename, prefix, in_rdbufsize, output);
+            return;
+
+        default:
+            ctx.cout_master()
+                << "arity of " << arity() << " not supported" << std::endl;
+            failed() = true;
+            return;
+    }
+
+    Result::Time time;
+    double t0 = ctx.time();
+
+    auto dt = [&](){
+        const double t = ctx.time();
+        const double dt = t - t0;
+        t0 = t;
+        return dt;
+    };
+
+    // Determine input partition
+    // -> under a memory budget, the input is streamed rather than buffered
+    FilePartitionReader<sym_t> input(ctx, input_filename, prefix);
+    const size_t local_num = input.local_num();
+    size_t rdbufsize = (in_rdbufsize > 0) ? in_rdbufsize : local_num;
+    if(memory_budget() > 0) {
+        // the input buffer and a chunk of the transformed text are held
+        // at the same time, so half of the budget is left for others
+        rdbufsize = std::min(rdbufsize,
+            external_chunk_size(memory_budget(), 0, 4 * sizeof(sym_t)));
+    } else {
+        input.buffer(rdbufsize);
+    }
+    rdbufsize = std::max(rdbufsize, size_t(1));
+
+    time.input = dt();
+
+    // Compute histogram
+    ctx.cout_master() << "Compute histogram ..." << std::endl;
+    Histogram<sym_t> hist(ctx, input, rdbufsize);
+
+    time.hist = dt();
+
+    run(ctx, input, hist, rdbufsize, output, time);
+}
+
+// constructs the WT of an input partition whose histogram has already been
+// computed (e.g., by mpi-auto)
+template<typename sym_t>
+static void run(
+    MPIContext& ctx,
+    FilePartitionReader<sym_t>& input,
+    const Histogram<sym_t>& hist,
+    const size_t rdbufsize,
+    const std::string& output,
+    Result::Time time) {
+
+    double t0 = ctx.time();
+
+    auto dt = [&](){
+        const double t = ctx.time();
+        const double dt = t - t0;
+        t0 = t;
+        return dt;
+    };
+
+    const size_t local_num = input.local_num();
+
+    // Compute effective alphabet
+    EffectiveAlphabet<sym_t> ea(hist);
+
+    // Construct externally if the budget is exceeded on any worker
+    // -> the memory allocated from here on is compared with the budget
+    std::unique_ptr<BudgetCheck> budget_check;
+    if(memory_budget() > 0) {
+        budget_check.reset(new BudgetCheck(memory_budget()));
+
+        const WaveletTreeBase base(hist);
+        size_t external = exceeds_budget<sym_t>(
+            ctx, local_num, base.sigma(), base.height());
+        size_t any_external;
+        ctx.all_reduce(&external, &any_external, 1, mpi_max<size_t>::op());
+
+        if(any_external) {
+            start_external(ctx, input, hist, ea, rdbufsize, output, time, dt,
+                *budget_check);
+            return;
+        }
+    }
+
+    // Transform text and cache in RAM
+    ctx.cout_master() << "Compute effective transformation ..." << std::endl;
+    std::vector<sym_t> etext(local_num);
+    {
+        size_t i = 0;
+        ea.transform(input, [&](sym_t x){ etext[i++] = x; }, rdbufsize);
+    }
+
+    input.free();
+    time.eff = dt();
+
+    // Convert to level-wise representation
+    // -> finished levels are written while later ones are constructed
+    // -> or constructed directly into the output files
+    std::unique_ptr<LevelStream> levels;
+    std::unique_ptr<MappedLevels> mapped_levels;
+    if(mapped() && output.length() > 0) {
+        mapped_levels.reset(new MappedLevels(ctx, output,
+            WaveletTreeBase::level_extension,
+            WaveletTreeBase(hist).height(), local_num));
+    } else if(stream() && output.length() > 0) {
+        levels.reset(new LevelStream(
+            ctx, output, WaveletTreeBase::level_extension));
+    }
+
+    auto wt = WaveletTreeLevelwise(hist,
+    [&](WaveletTree::bits_t& bits, const WaveletTreeBase& wt){
+        construct(ctx, input, hist, wt, bits, etext,
+            levels.get(), mapped_levels.get());
+        if(levels) levels->finish();
+    });
+
+    time.construct = dt();
+    time.merge = 0;
+
+    // write to disk if needed
+    if(output.length() > 0) {
+        ctx.synchronize();
+        ctx.cout_master() << "Writing WT to disk ..." << std::endl;
+
+        if(ctx.rank() == 0) {
+            hist.save(output + "." + WaveletTreeBase::histogram_extension());
+        }
+
+        if(mapped_levels) {
+            mapped_levels->sync();
+        } else if(!levels) {
+            wt.save(ctx, output);
+        }
+    }
+
+    if(budget_check) {
+        const size_t budget_used = budget_check->finish(ctx);
+        Result::annotate("budget", std::to_string(memory_budget()));
+        Result::annotate("budget_used", std::to_string(budget_used));
+    }
+
+    // Synchronize for exit
+    ctx.cout_master() << "Waiting for exit signals ..." << std::endl;
+    ctx.synchronize();
+
+    // gather stats
+    Result result("mpi-bsort", ctx, input, wt.sigma(), time);
+
+    ctx.cout_master() << result.readable() << std::endl
+                      << result.sqlplot() << std::endl;
+}
+};
@@ -0,0 +1,505 @@
+#pragma once
+
+#include "mpi_launcher.hpp"
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <distwt/common/util.hpp>
+#include <distwt/common/wt_sequential.hpp>
+
+#include <distwt/mpi/external.hpp>
+#include <distwt/mpi/file_partition_reader.hpp>
+#include <distwt/mpi/mpi_max.hpp>
+#include <distwt/mpi/node_prefix_sums.hpp>
+
+#include <distwt/mpi/histogram.hpp>
+#include <distwt/mpi/effective_alphabet.hpp>
+#include <distwt/mpi/bit_vector.hpp>
+#include <distwt/mpi/wt_nodebased.hpp>
+#include <distwt/mpi/wt_levelwise.hpp>
+
+#include <distwt/mpi/result.hpp>
+
+class mpi_dd {
+public:
+    // the memory budget per worker for the local phase in bytes
+    // (0 = unlimited)
+    static size_t& memory_budget() {
+        static size_t s_memory_budget = 0;
+        return s_memory_budget;
+    }
+
+    // the bytes of the memory budget that are reserved for the buffers of
+    // the construction whose sizes do not depend on the number of local
+    // items, i.e., a few dozen words per symbol of the alphabet for the
+    // local node sizes and offsets, the counters of wt_pc and the piece
+    // headers of a sub-round, and per worker for the messages and their
+    // counts, plus the slack
+    static size_t budget_reserve(MPIContext& ctx, const size_t sigma) {
+        return sizeof(size_t) * (32 * (sigma + 1) + 32 * ctx.num_workers()) +
+            external_slack;
+    }
+
+// constructs the levels of the WT within the memory budget and writes them
+// to the output files (if any), without holding any node or level in RAM
+//
+// the local WT is built in chunks of symbols, which are taken from the
+// effective transformation on the fly. a node's bit vector in
+// the WT of a concatenation is the concatenation of the node's bit vectors
+// in the WTs of the parts, so the bits of each chunk are appended to the
+// node's region of a scratch file, which is sized exactly from the local
+// node sizes. the root is final already and written directly. the other
+// levels are merged like in WaveletTreeNodebased::merge, but every worker
+// sends a bounded number of bits per sub-round, and the received pieces are
+// written to the output level files
+//
+// the chunk size and the number of bits per sub-round are chosen such that
+// the buffers that are live at the same time fit into what is left of the
+// memory budget after the reserved buffers and the input buffer
+template<typename sym_t, typename dt_f>
+static void construct_external(
+    MPIContext& ctx,
+    const FilePartitionReader<sym_t>& input,
+    const Histogram<sym_t>& hist,
+    const EffectiveAlphabet<sym_t>& ea,
+    const size_t rdbufsize,
+    const WaveletTreeBase& wt,
+    const std::string& output,
+    Result::Time& time,
+    dt_f& dt) {
+
+    const size_t local_num = input.local_num();
+    const size_t height = wt.height();
+    const size_t sigma = wt.sigma();
+    const size_t budget = memory_budget();
+    const size_t reserved = budget_reserve(ctx, sigma);
+
+    // the input buffer, the chunk, its local WT (one bit per level) and the
+    // words of a node's bits being written are held at the same time
+    const size_t chunk_size = external_chunk_size(budget,
+        reserved + rdbufsize * sizeof(sym_t),
+        sizeof(sym_t) + tlx::div_ceil(height + 1, 8));
+
+    ctx.cout_master() << "Processing the text in chunks of " << chunk_size
+        << " symbol(s) ..." << std::endl;
+
+    // the histogram, the effective alphabet and the node sizes take a few
+    // words per symbol of the alphabet, which the chunks cannot bound
+    if(reserved > budget) {
+        ctx.cout_master() << "WARNING: the memory budget of " << budget
+            << " bytes is too small for an alphabet of " << sigma
+            << " symbols and will be exceeded" << std::endl;
+    }
+
+    // count the local occurrences of each symbol to determine the sizes of
+    // the local nodes
+    std::vector<size_t> local_c(sigma + 1, 0);
+    ea.transform(input, [&](sym_t x){ ++local_c[size_t(x) + 1]; }, rdbufsize);
+    for(size_t x = 0; x < sigma; x++) local_c[x+1] += local_c[x];
+
+    auto local_size = [&](const size_t node_id){
+        const size_t level = tlx::integer_log2_floor(node_id);
+        const size_t i = node_id - (1ULL << level);
+        const size_t lsh = height - level;
+        return local_c[std::min((i+1) << lsh, sigma)] -
+            local_c[std::min(i << lsh, sigma)];
+    };
+
+    // assign each nonempty local node below the root a region of the
+    // scratch file, in the order of node IDs
+    const auto node_sizes = WaveletTreeBase::node_sizes(hist);
+
+    std::vector<std::pair<size_t, size_t>> local_nodes;
+    std::vector<size_t> node_offs(wt.num_nodes());
+    size_t num_node_bits = 0;
+    for(size_t level = 1; level < height; level++) {
+        for(auto it = node_sizes.level_nodes(level); it.valid(); it.next()) {
+            const size_t node_id = it.node_id();
+            const size_t size = local_size(node_id);
+            if(size > 0) {
+                local_nodes.emplace_back(node_id, size);
+                node_offs[node_id-1] = num_node_bits;
+                num_node_bits += size;
+            }
+        }
+    }
+
+    ExternalBits nodes(ctx,
+        scratch_filename(ctx, "dd.nodes"), num_node_bits, true);
+
+    // construct the local WT chunk by chunk
+    ctx.cout_master() << "Compute local WTs ..." << std::endl;
+    {
+        LevelWriter root(LevelWriter::filename(
+            ctx, output, WaveletTreeBase::level_extension(0)));
+
+        std::vector<size_t> node_fill(node_offs);
+
+        std::vector<sym_t> chunk;
+        chunk.reserve(chunk_size);
+
+        auto append = [&](){
+            if(chunk.empty()) return;
+
+            // the bit vectors are allocated anew for each chunk, because
+            // growing them to the next chunk's node sizes could double them
+            WaveletTree::bits_t chunk_bits(wt.num_nodes());
+            wt_pc<sym_t, idx_t>(wt, chunk_bits, chunk);
+            for(const bool b : chunk_bits[0]) {
+                root.push(b);
+            }
+
+            for(const auto& e : local_nodes) {
+                const auto& bv = chunk_bits[e.first-1];
+                nodes.write(node_fill[e.first-1], bv, bv.size());
+                node_fill[e.first-1] += bv.size();
+            }
+            chunk.clear();
+        };
+
+        ea.transform(input, [&](sym_t x){
+            chunk.push_back(x);
+            if(chunk.size() == chunk_size) append();
+        }, rdbufsize);
+        append();
+    }
+
+    ctx.synchronize();
+    time.construct = dt();
+
+    // Distribute local offsets for nonempty nodes
+    ctx.cout_master() << "Distributing node prefix sums ..." << std::endl;
+
+    const size_t bits_per_worker = input.size_per_worker();
+    node_prefix_sums(ctx, node_sizes, bits_per_worker, local_nodes);
+
+    // Distribute bits in a balanced manner
+    ctx.cout_master() << "Distributing level bit vectors ..." << std::endl;
+
+    // per sub-round, the pieces for each target are sent in one message
+    // -> the outgoing messages (which grow by doubling), MPI's copy of one,
+    //    a received message, its unpacked piece and the words being written
+    //    are held at the same time, each of at most a sub-round's worth of
+    //    bits
+    const size_t global_offset = ctx.rank() * bits_per_worker;
+    const size_t round_bits =
+        8 * external_chunk_size(budget, reserved, 6);
+
+    std::vector<std::vector<uint64_t>> outbox(ctx.num_workers());
+    std::vector<std::vector<size_t>> num_to(ctx.num_workers());
+
+    auto local_node = local_nodes.begin();
+    for(size_t level = 1; level < height; level++) {
+        ctx.cout_master() << "level " << (level+1) << " ..." << std::endl;
+
+        // compute global offsets of the level's local nodes
+        const size_t first_level_node = 1ULL << level;
+
+        std::vector<size_t> level_node_ids;
+        for(auto it = local_node; it != local_nodes.end() &&
+            it->first < 2ULL * first_level_node; ++it) {
+
+            level_node_ids.push_back(it->first);
+        }
+        const std::vector<size_t> level_node_offs =
+            node_sizes.offsets(level, level_node_ids, false);
+
+        std::unique_ptr<ExternalBits> out;
+        if(output.length() > 0) {
+            out = std::make_unique<ExternalBits>(ctx,
+                LevelWriter::filename(
+                    ctx, output, WaveletTreeBase::level_extension(level)),
+                local_num, false);
+        }
+
+        // all workers take part in as many sub-rounds as the worker with
+        // the most bits to send
+        size_t num_rounds = tlx::div_ceil(local_num, round_bits);
+        {
+            size_t max_rounds;
+            ctx.all_reduce(&num_rounds, &max_rounds, 1,
+                mpi_max<size_t>::op());
+            num_rounds = max_rounds;
+        }
+
+        // the next bit to send is bit pos of the k-th node of the level
+        size_t k = 0;
+        size_t pos = 0;
+        for(size_t r = 0; r < num_rounds; r++) {
+            for(auto& v : num_to) v.assign(1, 0);
+
+            size_t left = round_bits;
+            while(left > 0 && k < level_node_ids.size()) {
+                const size_t node_id = level_node_ids[k];
+                const size_t size = local_size(node_id);
+                const size_t num = std::min(left, size - pos);
+
+                std::vector<bool> piece(num);
+                nodes.read(node_offs[node_id-1] + pos, num, piece);
+
+                // send the piece's global interval [g, g+num) to the
+                // workers it belongs to
+                const size_t g =
+                    level_node_offs[k] + (local_node + k)->second + pos;
+
+                size_t p = g;
+                const size_t q = g + num;
+                while(p < q) {
+                    const size_t target = p / bits_per_worker;
+                    const size_t x = std::min(
+                        (target+1) * bits_per_worker, q);
+                    const size_t mnum = x - p;
+
+                    // append the piece to the target's message
+                    auto& msg = outbox[target];
+                    const size_t m = msg.size();
+                    msg.resize(m + bv64_pack_t::required_bufsize(mnum) + 2);
+                    msg[m] = p;
+                    msg[m+1] = mnum;
+                    bv64_pack_t::pack(piece, p - g, msg.data()+m+2, mnum);
+
+                    num_to[target][0] += mnum;
+
+                    p = x;
+                }
+
+                pos += num;
+                left -= num;
+                if(pos == size) {
+                    ++k;
+                    pos = 0;
+                }
+            }
+
+            // the outbox is kept until all messages are received
+            for(size_t target = 0; target < outbox.size(); target++) {
+                if(outbox[target].empty()) continue;
+
+                MPI_Request req = ctx.isend(outbox[target].data(),
+                    outbox[target].size(), target, (int)level);
+                MPI_Request_free(&req);
+            }
+
+            size_t expect = 0;
+            for(const auto& v : ctx.all_to_all(num_to)) {
+                expect += v[0];
+            }
+
+            // receive and write the pieces of the local part of the level
+            size_t num_received = 0;
+            while(num_received < expect) {
+                auto result = ctx.template probe<uint64_t>((int)level);
+
+                std::vector<uint64_t> msg(result.size);
+                ctx.recv(msg.data(), result.size, result.sender, (int)level);
+
+                size_t i = 0;
+                while(i < result.size) {
+                    const size_t moffs = msg[i];
+                    const size_t mnum = msg[i+1];
+
+                    assert(moffs >= global_offset);
+                    assert(moffs - global_offset + mnum <= local_num);
+
+                    std::vector<bool> piece(mnum);
+                    bv64_pack_t::unpack(msg.data()+i+2, piece, 0, mnum);
+                    if(out) out->write(moffs - global_offset, piece, mnum);
+
+                    i += bv64_pack_t::required_bufsize(mnum) + 2;
+                    num_received += mnum;
+                }
+                assert(i == result.size);
+            }
+
+            // synchronize before discarding the send buffers!
+            ctx.synchronize();
+            for(auto& msg : outbox) std::vector<uint64_t>().swap(msg);
+        }
+
+        local_node += level_node_ids.size();
+    }
+
+    time.merge = dt();
+}
+
+// the remainder of run for a construction within the memory budget
+template<typename sym_t, typename dt_f>
+static void run_external(
+    MPIContext& ctx,
+    const FilePartitionReader<sym_t>& input,
+    const Histogram<sym_t>& hist,
+    const EffectiveAlphabet<sym_t>& ea,
+    const size_t rdbufsize,
+    const std::string& output,
+    Result::Time& time,
+    dt_f& dt) {
+
+    // the memory allocated from here on is compared with the budget
+    BudgetCheck budget_check(memory_budget());
+
+    // the effective transformation is computed on the fly
+    time.eff = dt();
+
+    // the levels are written to disk during construction
+    if(ctx.rank() == 0 && output.length() > 0) {
+        hist.save(output + "." + WaveletTreeBase::histogram_extension());
+    }
+
+    auto wt = WaveletTreeLevelwise(hist,
+    [&](WaveletTree::bits_t&, const WaveletTreeBase& wt){
+        construct_external(
+            ctx, input, hist, ea, rdbufsize, wt, output, time, dt);
+    });
+
+    const size_t budget_used = budget_check.finish(ctx);
+
+    // Synchronize for exit
+    ctx.cout_master() << "Waiting for exit signals ..." << std::endl;
+    ctx.synchronize();
+
+    // gather stats
+    Result::annotate("budget", std::to_string(memory_budget()));
+    Result::annotate("budget_used", std::to_string(budget_used));
+    Result result("mpi-dd", ctx, input, wt.sigma(), time);
+
+    ctx.cout_master() << result.readable() << std::endl
+                      << result.sqlplot() << std::endl;
+}
+
+template<typename sym_t>
+static void start(
+    MPIContext& ctx,
+    const std::string& input_filename,
+    const size_t prefix,
+    const size_t in_rdbufsize,
+    const bool eff_input,
+    const std::string& output) {
+
+    Result::Time time;
+    double t0 = ctx.time();
+
+    auto dt = [&](){
+        const double t = ctx.time();
+        const double dt = t - t0;
+        t0 = t;
+        return dt;
+    };
+
+    // Determine input partition
+    // -> under a memory budget, the input is streamed rather than buffered
+    // -> its buffer takes at most a quarter of the budget
+    const size_t budget = memory_budget();
+    const size_t chunk_size = external_chunk_size(budget, 0, 4 * sizeof(sym_t));
+
+    FilePartitionReader<sym_t> input(ctx, input_filename, prefix);
+    const size_t local_num = input.local_num();
+    size_t rdbufsize = (in_rdbufsize > 0) ? in_rdbufsize : local_num;
+    if(budget > 0) {
+        rdbufsize = std::max(std::min(rdbufsize, chunk_size), size_t(1));
+    } else {
+        input.buffer(rdbufsize);
+    }
+
+    time.input = dt();
+
+    // Compute histogram
+    ctx.cout_master() << "Compute histogram ..." << std::endl;
+    Histogram<sym_t> hist(ctx, input, rdbufsize);
+
+    time.hist = dt();
+
+    run(ctx, input, hist, rdbufsize, output, time);
+}
+
+// constructs the WT of an input partition whose histogram has already been
+// computed (e.g., by mpi-auto)
+template<typename sym_t>
+static void run(
+    MPIContext& ctx,
+    FilePartitionReader<sym_t>& input,
+    const Histogram<sym_t>& hist,
+    const size_t rdbufsize,
+    const std::string& output,
+    Result::Time time) {
+
+    double t0 = ctx.time();
+
+    auto dt = [&](){
+        const double t = ctx.time();
+        const double dt = t - t0;
+        t0 = t;
+        return dt;
+    };
+
+    const size_t local_num = input.local_num();
+
+    // Compute effective alphabet
+    EffectiveAlphabet<sym_t> ea(hist);
+
+    // under a memory budget, the WT is constructed on disk
+    if(memory_budget() > 0) {
+        run_external(ctx, input, hist, ea, rdbufsize, output, time, dt);
+        return;
+    }
+
+    // Transform text and cache in RAM
+    ctx.cout_master() << "Compute effective transformation ..." << std::endl;
+    std::vector<sym_t> etext(local_num);
+    {
+        size_t i = 0;
+        ea.transform(input, [&](sym_t x){ etext[i++] = x; }, rdbufsize);
+    }
+
+    time.eff = dt();
+    input.free();
+
+    // recursive WT
+    ctx.cout_master() << "Compute local WTs ..." << std::endl;
+    auto wt_nodes = WaveletTreeNodebased(hist,
+    [&](WaveletTree::bits_t& bits, const WaveletTreeBase& wt){
+        bits.resize(wt.num_nodes());
+        wt_pc<sym_t, idx_t>(wt, bits, etext);
+    });
+
+    // Clean up
+    etext.clear();
+    etext.shrink_to_fit();
+
+    // Synchronize
+    ctx.cout_master() << "Done computing " << wt_nodes.num_nodes()
+        << " nodes. Synchronizing ..." << std::endl;
+    ctx.synchronize();
+
+    time.construct = dt();
+
+    // Convert to level-wise representation
+    WaveletTreeLevelwise wt = wt_nodes.merge(ctx, input, hist, true);
+    time.merge = dt();
+
+    // write to disk if needed
+    if(output.length() > 0) {
+        ctx.synchronize();
+        ctx.cout_master() << "Writing WT to disk ..." << std::endl;
+
+        if(ctx.rank() == 0) {
+            hist.save(output + "." + WaveletTreeBase::histogram_extension());
+        }
+
+        wt.save(ctx, output);
+    }
+
+    // Synchronize for exit
+    ctx.cout_master() << "Waiting for exit signals ..." << std::endl;
+    ctx.synchronize();
+
+    // gather stats
+    Result result("mpi-dd", ctx, input, wt.sigma(), time);
+
+    ctx.cout_master() << result.readable() << std::endl
+                      << result.sqlplot() << std::endl;
+}
+
+};
@@ -0,0 +1,159 @@
+#pragma once
+
+#include "mpi_launcher.hpp"
+
+#include <vector>
+
+#include <tlx/math/integer_log2.hpp>
+
+#include <distwt/common/util.hpp>
+#include <distwt/common/wt_sequential.hpp>
+
+#include <distwt/mpi/file_partition_reader.hpp>
+
+#include <distwt/common/wt.hpp>
+#include <distwt/mpi/histogram.hpp>
+#include <distwt/mpi/dsplit_wt.hpp>
+#include <distwt/mpi/effective_alphabet.hpp>
+#include <distwt/mpi/wt_nodebased.hpp>
+#include <distwt/mpi/wt_levelwise.hpp>
+
+#include <distwt/mpi/result.hpp>
+
+class mpi_dsplit {
+public:
+
+template<typename sym_t>
+static void start(
+    MPIContext& ctx,
+    const std::string& input_filename,
+    const size_t prefix,
+    const size_t in_rdbufsize,
+    const bool eff_input,
+    const std::string& output) {
+
+    Result::Time time;
+    double t0 = ctx.time();
+
+    auto dt = [&](){
+        const double t = ctx.time();
+        const double dt = t - t0;
+        t0 = t;
+        return dt;
+    };
+
+    // Determine input partition
+    FilePartitionReader<sym_t> input(ctx, input_filename, prefix);
+    const size_t local_num = input.local_num();
+    const size_t rdbufsize = (in_rdbufsize > 0) ? in_rdbufsize : local_num;
+    input.buffer(rdbufsize);
+
+    time.input = dt();
+
+    // Compute histogram
+    ctx.cout_master() << "Compute histogram ..." << std::endl;
+    Histogram<sym_t> hist(ctx, input, rdbufsize);
+
+    time.hist = dt();
+
+    run(ctx, input, hist, rdbufsize, output, time);
+}
+
+// constructs the WT of an input partition whose histogram has already been
+// computed (e.g., by mpi-auto)
+template<typename sym_t>
+static void run(
+    MPIContext& ctx,
+    FilePartitionReader<sym_t>& input,
+    const Histogram<sym_t>& hist,
+    const size_t rdbufsize,
+    const std::string& output,
+    Result::Time time) {
+
+    double t0 = ctx.time();
+
+    auto dt = [&](){
+        const double t = ctx.time();
+        const double dt = t - t0;
+        t0 = t;
+        return dt;
+    };
+
+    const size_t local_num = input.local_num();
+
+    // Compute effective alphabet
+    EffectiveAlphabet<sym_t> ea(hist);
+
+    // Transform text and cache in RAM
+    ctx.cout_master() << "Compute effective transformation ..." << std::endl;
+    std::vector<sym_t> etext(local_num);
+    {
+        size_t i = 0;
+        ea.transform(input, [&](sym_t x){ etext[i++] = x; }, rdbufsize);
+    }
+
+    time.eff = dt();
+    input.free();
+
+    // recursive WT
+    ctx.cout_master() << "Compute WT ..." << std::endl;
+    auto wt_nodes = WaveletTreeNodebased(hist,
+    [&](WaveletTree::bits_t& bits, const WaveletTreeBase& wt){
+
+        bits.resize(wt.num_nodes());
+
+        std::vector<SubtreeTask<sym_t>> tasks;
+        recursiveWT(
+            bits,
+            tasks,
+            ctx,
+            1ULL, // root
+            etext, // text
+            0ULL, wt.num_nodes()); // alphabet interval
+
+        // the message buffers of the splits are not needed anymore
+        ctx.message_pool().release();
+
+        // compute remaining subtrees, stealing work from loaded workers
+        ctx.cout_master() << "Compute sequential subtrees ..." << std::endl;
+        compute_subtree_tasks(ctx, bits, tasks, 0);
+    });
+
+    // Clean up
+    etext.clear();
+    etext.shrink_to_fit();
+
+    // Synchronize
+    ctx.cout_master() << "Done computing " << wt_nodes.num_nodes()
+        << " nodes. Synchronizing ..." << std::endl;
+    ctx.synchronize();
+
+    time.construct = dt();
+
+    // Convert to level-wise representation
+    WaveletTreeLevelwise wt = wt_nodes.merge(ctx, input, hist, true);
+    time.merge = dt();
+
+    // write to disk if needed
+    if(output.length() > 0) {
+        ctx.synchronize();
+        ctx.cout_master() << "Writing WT to disk ..." << std::endl;
+
+        if(ctx.rank() == 0) {
+            hist.save(output + "." + WaveletTreeBase::histogram_extension());
+        }
+
+        wt.save(ctx, output);
+    }
+
+    // Synchronize for exit
+    ctx.cout_master() << "Waiting for exit signals ..." << std::endl;
+    ctx.synchronize();
+
+    // gather stats
+    Result result("mpi-dsplit", ctx, input, wt.sigma(), time);
+
+    ctx.cout_master() << result.readable() << std::endl
+                      << result.sqlplot() << std::endl;
+}
+};
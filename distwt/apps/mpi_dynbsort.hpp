@@ -0,0 +1,283 @@
+#pragma once
+
+#include "mpi_launcher.hpp"
+
+#include <cassert>
+#include <memory>
+#include <vector>
+
+#include <tlx/math/integer_log2.hpp>
+
+#include <distwt/mpi/boundary_scan.hpp>
+#include <distwt/mpi/bucket_exchange.hpp>
+#include <distwt/mpi/file_partition_reader.hpp>
+#include <distwt/mpi/level_stream.hpp>
+#include <distwt/mpi/mapped_levels.hpp>
+
+#include <distwt/common/wt.hpp>
+#include <distwt/mpi/histogram.hpp>
+#include <distwt/mpi/effective_alphabet.hpp>
+#include <distwt/mpi/wt_levelwise.hpp>
+
+#include <distwt/mpi/result.hpp>
+
+//#define DBG_BSORT 1
+
+class mpi_dynbsort {
+public:
+    // whether to write levels to the output as soon as they are final
+    static bool& stream() {
+        static bool s_stream = false;
+        return s_stream;
+    }
+
+    // whether to construct levels directly into mapped output files
+    static bool& mapped() {
+        static bool s_mapped = false;
+        return s_mapped;
+    }
+
+template<typename sym_t>
+static void start(
+    MPIContext& ctx,
+    const std::string& input_filename,
+    const size_t prefix,
+    const size_t in_rdbufsize,
+    const bool eff_input,
+    const std::string& output) {
+
+    Result::Time time;
+    double t0 = ctx.time();
+
+    auto dt = [&](){
+        const double t = ctx.time();
+        const double dt = t - t0;
+        t0 = t;
+        return dt;
+    };
+
+    // Determine input partition
+    FilePartitionReader<sym_t> input(ctx, input_filename, prefix);
+    const size_t local_num = input.local_num();
+    const size_t rdbufsize = (in_rdbufsize > 0) ? in_rdbufsize : local_num;
+    input.buffer(rdbufsize);
+    
+    time.input = dt();
+
+    // Compute histogram
+    ctx.cout_master() << "Compute histogram ..." << std::endl;
+    Histogram<sym_t> hist(ctx, input, rdbufsize);
+
+    time.hist = dt();
+
+    run(ctx, input, hist, rdbufsize, output, time);
+}
+
+// constructs the WT of an input partition whose histogram has already been
+// computed (e.g., by mpi-auto)
+template<typename sym_t>
+static void run(
+    MPIContext& ctx,
+    FilePartitionReader<sym_t>& input,
+    const Histogram<sym_t>& hist,
+    const size_t rdbufsize,
+    const std::string& output,
+    Result::Time time) {
+
+    double t0 = ctx.time();
+
+    auto dt = [&](){
+        const double t = ctx.time();
+        const double dt = t - t0;
+        t0 = t;
+        return dt;
+    };
+
+    const size_t local_num = input.local_num();
+
+    // Compute effective alphabet
+    EffectiveAlphabet<sym_t> ea(hist);
+
+    // Transform text and cache in RAM
+    ctx.cout_master() << "Compute effective transformation ..." << std::endl;
+    std::vector<sym_t> etext(local_num);
+    {
+        size_t i = 0;
+        ea.transform(input, [&](sym_t x){ etext[i++] = x; }, rdbufsize);
+    }
+
+    input.free();
+    time.eff = dt();
+
+    // Convert to level-wise representation
+    // -> finished levels are written while later ones are constructed
+    // -> or constructed directly into the output files
+    std::unique_ptr<LevelStream> levels;
+    std::unique_ptr<MappedLevels> mapped_levels;
+    if(mapped() && output.length() > 0) {
+        mapped_levels.reset(new MappedLevels(ctx, output,
+            WaveletTreeBase::level_extension,
+            WaveletTreeBase(hist).height(), local_num));
+    } else if(stream() && output.length() > 0) {
+        levels.reset(new LevelStream(
+            ctx, output, WaveletTreeBase::level_extension));
+    }
+
+    auto wt = WaveletTreeLevelwise(hist,
+    [&](WaveletTree::bits_t& bits, const WaveletTreeBase& wt){
+
+        const size_t height = wt.height();
+        const size_t sigma = wt.sigma();
+        const auto c = hist.compute_C();
+
+        bits.resize(height);
+
+        #if DBG_BSORT
+        ctx.cout() << "size per worker: " << input.size_per_worker()
+                   << ", local_num: " << local_num
+                   << std::endl;
+        ctx.synchronize();
+        #endif
+
+        
+        std::vector<std::vector<sym_t>> buckets;
+
+        BucketExchange<sym_t> exchange(ctx, input.size_per_worker());
+        for(size_t level = 0; level < height; level++) {
+            const int tag = int(level);
+            ctx.cout_master() << "level " << (level+1) << " ..." << std::endl;
+
+            if(level+1 == height) {
+                // free unneeded memory on last level
+                buckets.shrink_to_fit();
+            }
+
+            // construct bit vector
+            // -> a mapped level is written in one separate scan
+            auto& level_bits = bits[level];
+            const size_t rsh = height - 1 - level;
+            if(mapped_levels) {
+                mapped_levels->assign(level, [&](const size_t i){
+                    return (etext[i] >> rsh) & 1;
+                });
+            } else {
+                level_bits.resize(local_num);
+            }
+
+            if(level+1 == height) {
+                // this is the last level, build only the bit vector
+                for(size_t i = 0; i < local_num && !mapped_levels; i++) {
+                    level_bits[i] = bool((etext[i] >> rsh) & 1);
+                }
+            } else { // if level+1 < height
+                // the local text is sorted by the nodes of the current level,
+                // so the local buckets form a contiguous range of
+                // next level nodes [first_bucket, first_bucket + num_buckets)
+                const bool empty = (local_num == 0);
+                const size_t first_node =
+                    empty ? 0 : size_t(etext[0] >> (rsh+1));
+                const size_t last_node =
+                    empty ? 0 : size_t(etext[local_num-1] >> (rsh+1));
+
+                const size_t first_bucket = 2ULL * first_node;
+                const size_t num_buckets =
+                    empty ? 0 : 2ULL * (last_node - first_node + 1);
+
+                // while building the bit vector, also fill the sort buckets
+                buckets.resize(num_buckets);
+
+                for(size_t i = 0; i < local_num; i++) {
+                    const sym_t x = etext[i];
+                    const size_t v = x >> rsh;
+                    if(!mapped_levels) level_bits[i] = bool(v & 1);
+                    assert(v < (1ULL << (level+1)));
+                    assert(v >= first_bucket && v - first_bucket < num_buckets);
+                    buckets[v - first_bucket].push_back(x);
+                }
+
+                // distribute buckets
+                // -> using locality to apply merge directly unlike after DD!
+                // -> this corresponds to bucket sort with < sigma keys
+
+                // only the buckets of the first local node can be preceded
+                // by items on other workers - count those
+                const auto boundary_offs = boundary_ex_scan(
+                    ctx, empty, first_node, last_node,
+                    { empty ? 0 : buckets[num_buckets-2].size(),
+                      empty ? 0 : buckets[num_buckets-1].size() });
+
+                // send buckets away, coalesced by target
+                for(size_t k = 0; k < num_buckets; k++) {
+                    const size_t bsz = buckets[k].size();
+                    if(bsz > 0) {
+                        const size_t v = first_bucket + k;
+
+                        // the global node offset is determined by the
+                        // symbols preceding the node's alphabet interval
+                        const size_t glob_node_offs =
+                            c[std::min(v << rsh, sigma)];
+
+                        const size_t glob_bucket_offs = glob_node_offs +
+                            ((v >> 1) == first_node ? boundary_offs[v & 1] : 0);
+
+                        #ifdef DBG_BSORT
+                        ctx.cout() << "processing bucket " << v
+                            << " with global offset = " << glob_bucket_offs
+                            << " (glob_node_offs = " << glob_node_offs
+                            << ")" << std::endl;
+                        #endif
+
+                        exchange.add(buckets[k].data(), glob_bucket_offs, bsz);
+                    }
+                }
+                exchange.send(tag);
+
+                // receive substrings until text is filled locally
+                exchange.receive(
+                    etext, local_num, input.local_offset(), tag);
+
+                // synchronize before cleaning!
+                ctx.synchronize();
+
+                // clean up
+                buckets.clear();
+                exchange.clear();
+            }
+
+            // the level is final
+            if(levels) levels->push(level, level_bits);
+        }
+
+        if(levels) levels->finish();
+    });
+
+    time.construct = dt();
+    time.merge = 0;
+
+    // write to disk if needed
+    if(output.length() > 0) {
+        ctx.synchronize();
+        ctx.cout_master() << "Writing WT to disk ..." << std::endl;
+
+        if(ctx.rank() == 0) {
+            hist.save(output + "." + WaveletTreeBase::histogram_extension());
+        }
+
+        if(mapped_levels) {
+            mapped_levels->sync();
+        } else if(!levels) {
+            wt.save(ctx, output);
+        }
+    }
+
+    // Synchronize for exit
+    ctx.cout_master() << "Waiting for exit signals ..." << std::endl;
+    ctx.synchronize();
+
+    // gather stats
+    Result result("mpi-dynbsort", ctx, input, wt.sigma(), time);
+
+    ctx.cout_master() << result.readable() << std::endl
+                      << result.sqlplot() << std::endl;
+}
+};
@@ -0,0 +1,5 @@
+#include "mpi_huff_bsort.hpp"
+
+int main(int argc, char** argv) {
+    return mpi_launch<mpi_huff_bsort>(argc, argv);
+}
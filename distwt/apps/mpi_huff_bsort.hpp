@@ -0,0 +1,220 @@
+#pragma once
+
+#include "mpi_launcher.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <vector>
+
+#include <distwt/mpi/boundary_scan.hpp>
+#include <distwt/mpi/bucket_exchange.hpp>
+#include <distwt/mpi/file_partition_reader.hpp>
+
+#include <distwt/common/huffman.hpp>
+#include <distwt/mpi/histogram.hpp>
+#include <distwt/mpi/effective_alphabet.hpp>
+#include <distwt/mpi/wt_huffman.hpp>
+
+#include <distwt/mpi/result.hpp>
+
+//#define DBG_HUFF_BSORT 1
+
+// Huffman-shaped WT construction using stable bucket sorting
+//
+// like mpi-bsort, but on every level, the items are sorted into the
+// children of their Huffman tree node, and items whose code ends are
+// dropped. since levels shrink, each level is balanced over the workers
+// on its own
+class mpi_huff_bsort {
+public:
+
+template<typename sym_t>
+static void start(
+    MPIContext& ctx,
+    const std::string& input_filename,
+    const size_t prefix,
+    const size_t in_rdbufsize,
+    const bool /* eff_input */,
+    const std::string& output) {
+
+    Result::Time time;
+    double t0 = ctx.time();
+
+    auto dt = [&](){
+        const double t = ctx.time();
+        const double dt = t - t0;
+        t0 = t;
+        return dt;
+    };
+
+    // Determine input partition
+    FilePartitionReader<sym_t> input(ctx, input_filename, prefix);
+    const size_t local_num = input.local_num();
+    const size_t rdbufsize = (in_rdbufsize > 0) ? in_rdbufsize : local_num;
+    input.buffer(rdbufsize);
+
+    time.input = dt();
+
+    // Compute histogram
+    ctx.cout_master() << "Compute histogram ..." << std::endl;
+    Histogram<sym_t> hist(ctx, input, rdbufsize);
+
+    time.hist = dt();
+
+    // Compute effective alphabet
+    EffectiveAlphabet<sym_t> ea(hist);
+
+    // Transform text and cache in RAM
+    ctx.cout_master() << "Compute effective transformation ..." << std::endl;
+    std::vector<sym_t> etext(local_num);
+    {
+        size_t i = 0;
+        ea.transform(input, [&](sym_t x){ etext[i++] = x; }, rdbufsize);
+    }
+
+    input.free();
+    time.eff = dt();
+
+    auto wt = WaveletTreeHuffman(hist,
+    [&](WaveletTree::bits_t& bits, const HuffmanCode& code){
+
+        const size_t height = code.height();
+        const size_t num_workers = ctx.num_workers();
+
+        ctx.cout_master() << "Huffman tree has height " << height
+            << " and " << code.total_bits() << " bits" << std::endl;
+
+        bits.resize(height);
+
+        std::vector<sym_t> buffer;
+        for(size_t level = 0; level < height; level++) {
+            const int tag = int(level);
+            const size_t num = etext.size();
+
+            // the local text is sorted by the nodes of the current level,
+            // so the level's bit vector can be constructed in place
+            auto& level_bits = bits[level];
+            level_bits.resize(num);
+            for(size_t i = 0; i < num; i++) {
+                level_bits[i] = code.bit(etext[i], level);
+            }
+
+            if(level + 1 == height) break;
+
+            ctx.cout_master() << "level " << (level+1) << " ..." << std::endl;
+
+            // stably sort the items of each local node into the buckets of
+            // its children, dropping items whose code ends
+            struct LocalPart {
+                size_t node_id;
+                size_t pos;     // local position of the first item
+                size_t num[2];  // number of items in either child bucket
+            };
+            std::vector<LocalPart> parts;
+
+            buffer.resize(num);
+            size_t m = 0;
+            for(size_t i = 0; i < num;) {
+                const size_t v = code.node_id(etext[i], level);
+
+                size_t end = i;
+                LocalPart part { v, m, { 0, 0 } };
+                while(end < num && code.node_id(etext[end], level) == v) {
+                    if(code.length(etext[end]) > level + 1) {
+                        ++part.num[level_bits[end]];
+                    }
+                    ++end;
+                }
+
+                size_t pos[2] = { m, m + part.num[0] };
+                for(; i < end; i++) {
+                    const sym_t x = etext[i];
+                    if(code.length(x) > level + 1) {
+                        buffer[pos[level_bits[i]]++] = x;
+                    }
+                }
+
+                m += part.num[0] + part.num[1];
+                parts.push_back(part);
+            }
+
+            // only the items of the first local node can be preceded by
+            // items on other workers - count those
+            const bool empty = parts.empty();
+            const size_t first_node = empty ? 0 : parts.front().node_id;
+            const size_t last_node = empty ? 0 : parts.back().node_id;
+            const std::vector<size_t> last_num = empty
+                ? std::vector<size_t>{ 0, 0 }
+                : std::vector<size_t>{
+                    parts.back().num[0], parts.back().num[1] };
+
+            const auto boundary_offs = boundary_ex_scan(
+                ctx, empty, first_node, last_node, last_num);
+
+            // send buckets away, coalesced by target
+            const size_t next_spw =
+                level_size_per_worker(code, level + 1, num_workers);
+            BucketExchange<sym_t> exchange(ctx, next_spw);
+
+            for(const auto& part : parts) {
+                const size_t v = part.node_id;
+                size_t pos = part.pos;
+                for(size_t b = 0; b < 2; b++) {
+                    if(part.num[b] > 0) {
+                        const size_t glob_bucket_offs =
+                            code.offset(2 * v + b) +
+                            (v == first_node ? boundary_offs[b] : 0);
+
+                        #ifdef DBG_HUFF_BSORT
+                        ctx.cout() << "bucket " << (2 * v + b)
+                            << " with global offset = " << glob_bucket_offs
+                            << std::endl;
+                        #endif
+
+                        exchange.add(
+                            buffer.data() + pos, glob_bucket_offs, part.num[b]);
+                    }
+                    pos += part.num[b];
+                }
+            }
+            exchange.send(tag);
+
+            // receive the next level's items
+            const size_t next_num = level_local_num(
+                code, level + 1, num_workers, ctx.rank());
+            etext.resize(next_num);
+            exchange.receive(
+                etext, next_num, ctx.rank() * next_spw, tag);
+
+            // synchronize before cleaning!
+            ctx.synchronize();
+        }
+    });
+
+    time.construct = dt();
+    time.merge = 0;
+
+    // write to disk if needed
+    if(output.length() > 0) {
+        ctx.synchronize();
+        ctx.cout_master() << "Writing WT to disk ..." << std::endl;
+
+        if(ctx.rank() == 0) {
+            hist.save(output + "." + WaveletTreeBase::histogram_extension());
+            wt.code().save(output + "." + HuffmanCode::extension());
+        }
+
+        wt.save(ctx, output);
+    }
+
+    // Synchronize for exit
+    ctx.cout_master() << "Waiting for exit signals ..." << std::endl;
+    ctx.synchronize();
+
+    // gather stats
+    Result result("mpi-huff-bsort", ctx, input, wt.sigma(), time);
+
+    ctx.cout_master() << result.readable() << std::endl
+                      << result.sqlplot() << std::endl;
+}
+};
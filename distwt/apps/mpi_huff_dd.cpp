@@ -0,0 +1,5 @@
+#include "mpi_huff_dd.hpp"
+
+int main(int argc, char** argv) {
+    return mpi_launch<mpi_huff_dd>(argc, argv);
+}
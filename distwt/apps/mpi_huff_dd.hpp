@@ -0,0 +1,120 @@
+#pragma once
+
+#include "mpi_launcher.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <vector>
+
+#include <distwt/mpi/file_partition_reader.hpp>
+
+#include <distwt/common/huffman.hpp>
+#include <distwt/mpi/histogram.hpp>
+#include <distwt/mpi/effective_alphabet.hpp>
+#include <distwt/mpi/wt_huffman.hpp>
+
+#include <distwt/mpi/result.hpp>
+
+// Huffman-shaped WT construction using domain decomposition
+//
+// each worker constructs the Huffman-shaped WT of its local text, whose
+// levels are then merged
+class mpi_huff_dd {
+public:
+
+template<typename sym_t>
+static void start(
+    MPIContext& ctx,
+    const std::string& input_filename,
+    const size_t prefix,
+    const size_t in_rdbufsize,
+    const bool /* eff_input */,
+    const std::string& output) {
+
+    Result::Time time;
+    double t0 = ctx.time();
+
+    auto dt = [&](){
+        const double t = ctx.time();
+        const double dt = t - t0;
+        t0 = t;
+        return dt;
+    };
+
+    // Determine input partition
+    FilePartitionReader<sym_t> input(ctx, input_filename, prefix);
+    const size_t local_num = input.local_num();
+    const size_t rdbufsize = (in_rdbufsize > 0) ? in_rdbufsize : local_num;
+    input.buffer(rdbufsize);
+
+    time.input = dt();
+
+    // Compute histogram
+    ctx.cout_master() << "Compute histogram ..." << std::endl;
+    Histogram<sym_t> hist(ctx, input, rdbufsize);
+
+    time.hist = dt();
+
+    // Compute effective alphabet
+    EffectiveAlphabet<sym_t> ea(hist);
+
+    // Transform text and cache in RAM
+    ctx.cout_master() << "Compute effective transformation ..." << std::endl;
+    std::vector<sym_t> etext(local_num);
+    {
+        size_t i = 0;
+        ea.transform(input, [&](sym_t x){ etext[i++] = x; }, rdbufsize);
+    }
+
+    input.free();
+    time.eff = dt();
+
+    // local construction
+    ctx.cout_master() << "Compute local WTs ..." << std::endl;
+    const HuffmanCode local_code(hist);
+
+    std::vector<bv_t> local_bits;
+    wt_huffman_runs_t runs;
+    wt_huffman_local(local_bits, runs, etext, local_code);
+
+    // Clean up
+    etext.clear();
+    etext.shrink_to_fit();
+
+    // Synchronize
+    ctx.cout_master() << "Done. Synchronizing ..." << std::endl;
+    ctx.synchronize();
+
+    time.construct = dt();
+
+    // Merge
+    auto wt = WaveletTreeHuffman(hist,
+    [&](WaveletTree::bits_t& bits, const HuffmanCode& code){
+        wt_huffman_merge_local(ctx, bits, local_bits, runs, code);
+    });
+    time.merge = dt();
+
+    // write to disk if needed
+    if(output.length() > 0) {
+        ctx.synchronize();
+        ctx.cout_master() << "Writing WT to disk ..." << std::endl;
+
+        if(ctx.rank() == 0) {
+            hist.save(output + "." + WaveletTreeBase::histogram_extension());
+            wt.code().save(output + "." + HuffmanCode::extension());
+        }
+
+        wt.save(ctx, output);
+    }
+
+    // Synchronize for exit
+    ctx.cout_master() << "Waiting for exit signals ..." << std::endl;
+    ctx.synchronize();
+
+    // gather stats
+    Result result("mpi-huff-dd", ctx, input, wt.sigma(), time);
+
+    ctx.cout_master() << result.readable() << std::endl
+                      << result.sqlplot() << std::endl;
+}
+};
@@ -1,12 +1,70 @@
 #pragma once
 
+#include <functional>
+
 #include <tlx/cmdline_parser.hpp>
+#include <distwt/common/result.hpp>
 #include <distwt/mpi/context.hpp>
+#include <distwt/mpi/file_partition_reader.hpp>
+#include <distwt/mpi/histogram.hpp>
+#include <distwt/mpi/topology.hpp>
 
 #include <distwt/mpi/uint_types.hpp>
 
+template<typename sym_t>
+void mpi_simulate_topology(
+    MPIContext& ctx,
+    const std::string& input_filename,
+    const size_t prefix,
+    const size_t in_rdbufsize) {
+
+    FilePartitionReader<sym_t> input(ctx, input_filename, prefix);
+    const size_t rdbufsize =
+        (in_rdbufsize > 0) ? in_rdbufsize : input.local_num();
+
+    ctx.cout_master() << "Compute histogram ..." << std::endl;
+    Histogram<sym_t> hist(ctx, input, rdbufsize);
+
+    const auto current = predict_bsort_traffic(hist, ctx.node_layout());
+    const auto mapped = predict_bsort_traffic(hist, ctx.topology_node_layout());
+
+    ctx.cout_master()
+        << "Predicted intra-node share of bucket sort traffic: "
+        << (100.0 * current.intra_fraction()) << "% (current mapping), "
+        << (100.0 * mapped.intra_fraction()) << "% (topology mapping)"
+        << std::endl;
+}
+
+template<typename mpi_app_t, typename sym_t>
+void mpi_start(
+    MPIContext& ctx,
+    const std::string& input_filename,
+    const size_t prefix,
+    const size_t rdbufsize,
+    const bool eff_input,
+    const std::string& output,
+    const bool simulate_topology) {
+
+    if(simulate_topology) {
+        mpi_simulate_topology<sym_t>(
+            ctx, input_filename, prefix, rdbufsize);
+    } else {
+        mpi_app_t::template start<sym_t>(
+            ctx,
+            input_filename, prefix, rdbufsize, eff_input,
+            output);
+    }
+}
+
+// launches the given application
+//
+// add_options may register application-specific command-line options
 template<typename mpi_app_t>
-int mpi_launch(int argc, char** argv) {
+int mpi_launch(
+    int argc,
+    char** argv,
+    std::function<void(tlx::CmdlineParser&)> add_options = nullptr) {
+
     // Read command-line
     tlx::CmdlineParser cp;
 
@@ -26,6 +84,28 @@ int mpi_launch(int argc, char** argv) {
     cp.add_flag('e', "effective", eff_input,
         "Input is already an effective transform (skip histogram computation).");
 
+    bool topology = false;
+    cp.add_flag('T', "topology", topology,
+        "Assign neighboring text partitions to workers on the same node.");
+
+    bool simulate_topology = false;
+    cp.add_flag('S', "simulate-topology", simulate_topology,
+        "Only predict the intra-node share of bucket sort traffic.");
+
+    bool bind = false;
+    cp.add_flag('B', "bind", bind,
+        "Bind each worker to an even share of its compute node's cores, "
+        "so that its buffers are placed on the local NUMA node.");
+
+    bool huge_pages = false;
+    cp.add_flag('G', "huge-pages", huge_pages,
+        "Advise the kernel to back large buffers by transparent huge "
+        "pages.");
+
+    if(add_options) {
+        add_options(cp);
+    }
+
     std::string input_filename; // required
     cp.add_param_string("file", input_filename, "The input file.");
     if (!cp.process(argc, argv)) {
@@ -35,34 +115,59 @@ int mpi_launch(int argc, char** argv) {
     // Init MPI
     MPIContext ctx(&argc, &argv);
 
+    if(topology) {
+        ctx.map_partitions_by_topology();
+    }
+
+    // memory placement must be set up before any buffers are allocated
+    if(bind) {
+        ctx.bind_to_cores();
+        ctx.cout_master() << "Bound to " << ctx.num_bound_cpus()
+            << " core(s) on NUMA node " << ctx.numa_node() << std::endl;
+
+        ResultBase::annotate("bind", std::to_string(ctx.num_bound_cpus()));
+        ResultBase::annotate("numa", std::to_string(ctx.numa_node()));
+    }
+
+    if(huge_pages) {
+        ctx.use_huge_pages();
+    }
+
+    ResultBase::annotate("thp", MPIContext::thp_mode());
+    ResultBase::annotate("huge_pages", huge_pages ? "1" : "0");
+
+    if(!malloc_stats::tracked()) {
+        ResultBase::annotate("memory_source", "vmhwm");
+    }
+
     // start
     switch(sym_width) {
         case 1:
-            mpi_app_t::template start<uint8_t>(
+            mpi_start<mpi_app_t, uint8_t>(
                 ctx,
                 input_filename, prefix, rdbufsize, eff_input,
-                output);
+                output, simulate_topology);
             return 0;
 
         case 2:
-            mpi_app_t::template start<uint16_t>(
+            mpi_start<mpi_app_t, uint16_t>(
                 ctx,
                 input_filename, prefix, rdbufsize, eff_input,
-                output);
+                output, simulate_topology);
             return 0;
 
         case 4:
-            mpi_app_t::template start<uint32_t>(
+            mpi_start<mpi_app_t, uint32_t>(
                 ctx,
                 input_filename, prefix, rdbufsize, eff_input,
-                output);
+                output, simulate_topology);
             return 0;
 
         case 5:
-            mpi_app_t::template start<uint40_t>(
+            mpi_start<mpi_app_t, uint40_t>(
                 ctx,
                 input_filename, prefix, rdbufsize, eff_input,
-                output);
+                output, simulate_topology);
             return 0;
 
         default:
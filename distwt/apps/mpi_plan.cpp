@@ -0,0 +1,104 @@
+#include "mpi_launcher.hpp"
+
+#include <iomanip>
+#include <string>
+#include <vector>
+
+#include <tlx/string/ends_with.hpp>
+#include <tlx/string/format_si_iec_units.hpp>
+
+#include <distwt/common/wt.hpp>
+#include <distwt/mpi/cost_model.hpp>
+#include <distwt/mpi/file_partition_reader.hpp>
+#include <distwt/mpi/histogram.hpp>
+
+// predicts memory, traffic and message counts of the MPI construction
+// algorithms for a hypothetical job without constructing anything
+class mpi_plan {
+public:
+    static size_t s_workers;
+    static size_t s_workers_per_node;
+
+template<typename sym_t>
+static void start(
+    MPIContext& ctx,
+    const std::string& input_filename,
+    const size_t prefix,
+    const size_t in_rdbufsize,
+    const bool /* eff_input */,
+    const std::string& /* output */) {
+
+    // Load or compute histogram
+    Histogram<sym_t> hist;
+    const std::string hist_ext = "." + WaveletTreeBase::histogram_extension();
+    if(tlx::ends_with(input_filename, hist_ext)) {
+        ctx.cout_master() << "Load histogram ..." << std::endl;
+        hist = Histogram<sym_t>(input_filename);
+    } else {
+        FilePartitionReader<sym_t> input(ctx, input_filename, prefix);
+        const size_t rdbufsize =
+            (in_rdbufsize > 0) ? in_rdbufsize : input.local_num();
+
+        ctx.cout_master() << "Compute histogram ..." << std::endl;
+        hist = Histogram<sym_t>(ctx, input, rdbufsize);
+    }
+
+    if(!ctx.is_master()) return;
+
+    // Set up the planned job, defaulting to the current one
+    const size_t p = (s_workers > 0) ? s_workers : ctx.num_workers();
+    const size_t workers_per_node = (s_workers_per_node > 0)
+        ? s_workers_per_node : ctx.num_workers_per_node();
+
+    std::vector<size_t> node_layout(p);
+    for(size_t i = 0; i < p; i++) {
+        node_layout[i] = i / workers_per_node;
+    }
+
+    const WaveletTreeBase wt(hist);
+    ctx.cout_master() << "Plan for n=" << hist.text_length()
+        << ", sigma=" << wt.sigma() << ", height=" << wt.height()
+        << " on " << p << " worker(s), " << workers_per_node
+        << " per node" << std::endl;
+
+    auto iec = [](const size_t x){ return tlx::format_iec_units(x, 3) + "B"; };
+
+    for(const bool matrix : { false, true }) {
+        for(const auto& c : predict_costs(hist, node_layout, matrix)) {
+            ctx.cout_master() << std::endl << c.algo << ": "
+                << iec(c.memory) << " peak memory per worker, "
+                << iec(c.traffic.inter) << " inter-node and "
+                << iec(c.traffic.intra) << " intra-node traffic in "
+                << c.traffic.messages << " message(s), "
+                << "imbalance " << c.imbalance << ", ~" << c.time << "s"
+                << std::endl;
+
+            ctx.cout_master() << std::setw(8) << "level"
+                << std::setw(14) << "inter-node"
+                << std::setw(14) << "intra-node"
+                << std::setw(12) << "messages" << std::endl;
+
+            for(size_t level = 0; level < c.levels.size(); level++) {
+                const auto& lv = c.levels[level];
+                ctx.cout_master() << std::setw(8) << (level+1)
+                    << std::setw(14) << iec(lv.inter)
+                    << std::setw(14) << iec(lv.intra)
+                    << std::setw(12) << lv.messages << std::endl;
+            }
+        }
+    }
+}
+};
+
+size_t mpi_plan::s_workers = 0;
+size_t mpi_plan::s_workers_per_node = 0;
+
+int main(int argc, char** argv) {
+    return mpi_launch<mpi_plan>(argc, argv, [](tlx::CmdlineParser& cp){
+        cp.add_size_t('P', "workers", mpi_plan::s_workers,
+            "Number of workers to plan for (default: current job).");
+        cp.add_size_t('N', "workers-per-node", mpi_plan::s_workers_per_node,
+            "Number of workers per compute node to plan for "
+            "(default: current job).");
+    });
+}
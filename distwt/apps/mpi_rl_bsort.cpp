@@ -0,0 +1,12 @@
+#include "mpi_rl_bsort.hpp"
+
+int main(int argc, char** argv) {
+    return mpi_launch<mpi_rl_bsort>(argc, argv, [](tlx::CmdlineParser& cp){
+        cp.add_size_t('t', "levels-per-round", mpi_bsort::levels_per_round(),
+            "Number of levels to resolve per communication round "
+            "(default: automatic).");
+        cp.add_flag('H', "hybrid", mpi_bsort::hybrid(),
+            "Only sort nodes that straddle partition boundaries and "
+            "construct all other subtrees locally (ignores -t).");
+    });
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include "mpi_launcher.hpp"
+
+#include <string>
+#include <vector>
+
+#include <distwt/mpi/file_partition_reader.hpp>
+#include <distwt/mpi/runs.hpp>
+
+#include <distwt/mpi/histogram.hpp>
+#include <distwt/mpi/effective_alphabet.hpp>
+#include <distwt/mpi/wt_levelwise.hpp>
+
+#include <distwt/mpi/result.hpp>
+
+#include "mpi_bsort.hpp"
+
+// run-length WT construction using stable bucket sorting
+//
+// the local text is run-length encoded during the effective transformation.
+// the WT is then constructed over the run heads like in mpi-bsort, so the
+// levels and the items redistributed in each round scale with the number of
+// runs rather than the length of the text. along with it, a bit vector
+// marks the positions in the text at which a run starts
+class mpi_rl_bsort {
+public:
+
+template<typename sym_t>
+static void start(
+    MPIContext& ctx,
+    const std::string& input_filename,
+    const size_t prefix,
+    const size_t in_rdbufsize,
+    const bool /* eff_input */,
+    const std::string& output) {
+
+    Result::Time time;
+    double t0 = ctx.time();
+
+    auto dt = [&](){
+        const double t = ctx.time();
+        const double dt = t - t0;
+        t0 = t;
+        return dt;
+    };
+
+    // Determine input partition
+    FilePartitionReader<sym_t> input(ctx, input_filename, prefix);
+    const size_t local_num = input.local_num();
+    const size_t rdbufsize = (in_rdbufsize > 0) ? in_rdbufsize : local_num;
+    input.buffer(rdbufsize);
+
+    time.input = dt();
+
+    // Compute histogram
+    ctx.cout_master() << "Compute histogram ..." << std::endl;
+    Histogram<sym_t> hist(ctx, input, rdbufsize);
+
+    time.hist = dt();
+
+    // Compute effective alphabet
+    EffectiveAlphabet<sym_t> ea(hist);
+
+    // Transform text and encode runs
+    ctx.cout_master() << "Compute effective transformation and runs ..."
+        << std::endl;
+    LocalRuns<sym_t> runs(local_num);
+    ea.transform(input, [&](sym_t x){ runs.push(x); }, rdbufsize);
+    runs.join_boundary_run(ctx);
+
+    input.free();
+    time.eff = dt();
+
+    // Distribute run heads evenly
+    ctx.cout_master() << "Balance run heads ..." << std::endl;
+    auto& heads = runs.heads();
+    const EvenPartition part = balance_runs(ctx, heads);
+
+    ctx.cout_master() << "The text consists of " << part.total_size()
+        << " runs." << std::endl;
+
+    // Build wavelet tree of run heads
+    RunHeadHistogram<sym_t> head_hist(ctx, hist, heads);
+    auto wt = WaveletTreeLevelwise(head_hist,
+    [&](WaveletTree::bits_t& bits, const WaveletTreeBase& wt){
+        mpi_bsort::construct(ctx, part, head_hist, wt, bits, heads);
+    });
+
+    heads.clear();
+    heads.shrink_to_fit();
+
+    time.construct = dt();
+    time.merge = 0;
+
+    // write to disk if needed
+    if(output.length() > 0) {
+        ctx.synchronize();
+        ctx.cout_master() << "Writing WT to disk ..." << std::endl;
+
+        if(ctx.rank() == 0) {
+            hist.save(output + "." + WaveletTreeBase::histogram_extension());
+        }
+
+        wt.save(ctx, output);
+        RunStarts::save(ctx, runs.starts(), output);
+    }
+
+    // Synchronize for exit
+    ctx.cout_master() << "Waiting for exit signals ..." << std::endl;
+    ctx.synchronize();
+
+    // gather stats
+    Result::annotate("runs", std::to_string(part.total_size()));
+    Result result("mpi-rl-bsort", ctx, input, wt.sigma(), time);
+
+    ctx.cout_master() << result.readable() << std::endl
+                      << result.sqlplot() << std::endl;
+}
+};
@@ -0,0 +1,707 @@
+#pragma once
+
+#include "mpi_launcher.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <memory>
+#include <vector>
+
+#include <tlx/cmdline_parser.hpp>
+#include <tlx/math/integer_log2.hpp>
+
+#include <distwt/common/bitrev.hpp>
+#include <distwt/mpi/bucket_exchange.hpp>
+#include <distwt/mpi/context.hpp>
+#include <distwt/mpi/file_partition_reader.hpp>
+#include <distwt/mpi/level_rounds.hpp>
+#include <distwt/mpi/level_stream.hpp>
+#include <distwt/mpi/mapped_levels.hpp>
+#include <distwt/mpi/mpi_max.hpp>
+
+#include <distwt/mpi/histogram.hpp>
+#include <distwt/mpi/effective_alphabet.hpp>
+#include <distwt/mpi/multiary.hpp>
+#include <distwt/mpi/wm.hpp>
+
+#include <distwt/mpi/result.hpp>
+
+//#define DBG_CONCAT 1
+
+template<typename sym_t>
+class DummyHistogram : public Histogram<sym_t> {
+private:
+    size_t m_size;
+    
+public:
+    inline DummyHistogram(size_t size) : m_size(size) {
+    }
+
+    virtual inline size_t size() const override {
+        return m_size;
+    }
+};
+
+class mpi_wm_concat {
+public:
+    // number of levels to resolve per communication round (0 = automatic)
+    static size_t& levels_per_round() {
+        static size_t s_levels_per_round = 0;
+        return s_levels_per_round;
+    }
+
+    // set if the given options are invalid, for the exit status
+    static bool& failed() {
+        static bool s_failed = false;
+        return s_failed;
+    }
+
+    // whether to write levels to the output as soon as they are final
+    static bool& stream() {
+        static bool s_stream = false;
+        return s_stream;
+    }
+
+    // whether to construct levels directly into mapped output files
+    static bool& mapped() {
+        static bool s_mapped = false;
+        return s_mapped;
+    }
+
+    // the number of distinct digits per level (2, 4 or 16)
+    static size_t& arity() {
+        static size_t s_arity = 2;
+        return s_arity;
+    }
+
+// constructs the levels and Z values of the wavelet matrix of the text,
+// whose local part is given in etext and is reordered in the process
+//
+// if a level stream is given, each level is handed over to it as soon as
+// it is final and is not retained in bits. if mapped levels are given, one
+// level is resolved per round and written directly into them instead
+template<typename sym_t>
+static void construct(
+    MPIContext& ctx,
+    const FilePartitionReader<sym_t>& input,
+    const WaveletMatrixBase& wm,
+    WaveletMatrix::bits_t& bits,
+    WaveletMatrix::z_t& z,
+    std::vector<sym_t>& etext,
+    LevelStream* level_stream = nullptr,
+    MappedLevels* mapped_levels = nullptr) {
+
+    const size_t local_num = input.local_num();
+    const size_t height = wm.height();
+
+    bits.resize(height);
+
+    #if DBG_CONCAT
+    ctx.cout() << "size per worker: " << input.size_per_worker()
+               << ", local_num: " << local_num
+               << std::endl;
+    ctx.synchronize();
+    #endif
+
+    // resolve several levels per communication round
+    // -> levels received as packed slices cannot be mapped
+    const size_t tau = mapped_levels
+        ? 1 : choose_levels_per_round(height, levels_per_round());
+    ctx.cout_master() << "Resolving " << tau
+        << " level(s) per round ..." << std::endl;
+
+    std::vector<sym_t> buffer(local_num);
+    std::vector<size_t> bucket_pos;
+    bv_t round_bits;
+
+    // hands over the levels up to (excluding) the given one to the stream
+    size_t num_streamed = 0;
+    auto stream_levels = [&](const size_t end){
+        for(; level_stream && num_streamed < end; num_streamed++) {
+            level_stream->push(num_streamed, bits[num_streamed]);
+        }
+    };
+
+    BucketExchange<sym_t> exchange(ctx, input.size_per_worker());
+    for(size_t level = 0; level < height; level += tau) {
+        const int tag = int(level);
+
+        // afterwards, the text is in the order of next_level
+        const size_t num_levels = std::min(tau, height - level);
+        const size_t next_level = level + num_levels;
+        const bool last = (next_level == height);
+
+        ctx.cout_master() << "levels " << (level+1) << " to "
+            << next_level << " ..." << std::endl;
+
+        if(last) {
+            // we don't need the buffer anymore
+            buffer.clear();
+            buffer.shrink_to_fit();
+        }
+
+        // the local text is in the order of the current level,
+        // so the level's bit vector can be constructed in place
+        const size_t rsh = height - 1 - level;
+        if(mapped_levels) {
+            mapped_levels->assign(level, [&](const size_t i){
+                return (etext[i] >> rsh) & 1;
+            });
+        } else {
+            auto& level_bits = bits[level];
+            level_bits.resize(local_num);
+            for(size_t i = 0; i < local_num; i++) {
+                level_bits[i] = bool((etext[i] >> rsh) & 1);
+            }
+        }
+
+        // on the level j levels below, the local text is stably sorted
+        // into 2^j buckets by the bits of the levels in between, where
+        // the bit of the latest level is the most significant
+        //
+        // the bits of the remaining levels of the round, as well as the
+        // text in the order of next_level, are sent to the workers
+        // holding their global positions
+        const size_t num_sorted = last ? num_levels - 1 : num_levels;
+
+        // the bucket of x on the level j levels below
+        std::vector<std::vector<size_t>> rev(num_sorted + 1);
+        for(size_t j = 1; j <= num_sorted; j++) {
+            rev[j].resize(1ULL << j);
+            for(size_t k = 0; k < rev[j].size(); k++) {
+                rev[j][k] = bitrev(k, j);
+            }
+        }
+
+        auto bucket = [&](const size_t j, const sym_t x){
+            const size_t mask = (1ULL << j) - 1ULL;
+            return rev[j][size_t(x >> (rsh + 1 - j)) & mask];
+        };
+
+        // count zero bits of each level of the round and bucket sizes
+        // bucket sizes of level j start at index num_levels + 2^j - 2
+        std::vector<size_t> counts(num_levels + (2ULL << num_sorted) - 2);
+        {
+            // zeros
+            for(size_t i = 0; i < local_num; i++) {
+                const sym_t x = etext[i];
+                for(size_t j = 0; j < num_levels; j++) {
+                    counts[j] += ((x >> (rsh - j)) & 1) ? 0 : 1;
+                }
+            }
+
+            // bucket sizes on the deepest level, summed up for the
+            // levels above (bucket k of level j contains the buckets of
+            // level j+1 that agree with it in the lowest j bits)
+            if(num_sorted > 0) {
+                size_t* deepest =
+                    counts.data() + num_levels + (1ULL << num_sorted) - 2;
+
+                for(size_t i = 0; i < local_num; i++) {
+                    ++deepest[bucket(num_sorted, etext[i])];
+                }
+
+                for(size_t j = num_sorted - 1; j > 0; j--) {
+                    size_t* sizes =
+                        counts.data() + num_levels + (1ULL << j) - 2;
+                    const size_t* below = sizes + (1ULL << j);
+                    for(size_t k = 0; k < (1ULL << j); k++) {
+                        sizes[k] = below[k] + below[k + (1ULL << j)];
+                    }
+                }
+            }
+        }
+
+        // buckets are preceded by the items of all lower buckets and
+        // the items of the same bucket held by lower ranks
+        std::vector<size_t> glob_counts(counts.size());
+        ctx.all_reduce(counts.data(), glob_counts.data(), counts.size());
+
+        std::vector<size_t> lower_counts(counts);
+        ctx.ex_scan(lower_counts);
+        if(ctx.rank() == 0) {
+            // the result is undefined on the first worker
+            std::fill(lower_counts.begin(), lower_counts.end(), 0);
+        }
+
+        for(size_t j = 0; j < num_levels; j++) {
+            z[level + j] = glob_counts[j];
+
+            #ifdef DBG_CONCAT
+            ctx.cout_master() << "z[" << (level + j) << "] = "
+                << glob_counts[j] << std::endl;
+            #endif
+        }
+
+        if(num_sorted == 0) break;
+
+        // the local and global bucket sizes and global bucket offsets
+        // of the level j levels below
+        std::vector<std::vector<size_t>> bucket_sizes(num_sorted + 1);
+        std::vector<std::vector<size_t>> glob_bucket_offs(num_sorted + 1);
+        for(size_t j = 1; j <= num_sorted; j++) {
+            const size_t b = num_levels + (1ULL << j) - 2;
+            const size_t e = b + (1ULL << j);
+            bucket_sizes[j].assign(counts.begin() + b, counts.begin() + e);
+
+            auto& offs = glob_bucket_offs[j];
+            offs.resize(1ULL << j);
+            size_t glob_offs = 0;
+            for(size_t k = 0; k < offs.size(); k++) {
+                offs[k] = glob_offs + lower_counts[b + k];
+                glob_offs += glob_counts[b + k];
+            }
+        }
+
+        // stably sorts the local text into the buckets of the level j
+        // levels below
+        auto bucket_sort = [&](const size_t j, auto f){
+            round_bucket_sort(etext, bucket_sizes[j], bucket_pos,
+                [&](const sym_t x){ return bucket(j, x); }, f);
+        };
+
+        // send the bits of the intermediate levels
+        // -> they are packed right away, so the buffer can be reused
+        round_bits.resize(local_num);
+        for(size_t j = 1; j < num_levels; j++) {
+            const size_t blevel = level + j;
+            bits[blevel].resize(local_num);
+
+            bucket_sort(j, [&](const size_t i, const sym_t x){
+                round_bits[i] = bool((x >> (rsh - j)) & 1);
+            });
+
+            const auto& sizes = bucket_sizes[j];
+            for(size_t k = 0; k < sizes.size(); k++) {
+                if(sizes[k] > 0) {
+                    exchange.add_bits(blevel, round_bits, bucket_pos[k],
+                        glob_bucket_offs[j][k], sizes[k]);
+                }
+            }
+        }
+
+        // distribute buckets of next_level
+        if(!last) {
+            bucket_sort(num_levels, [&](const size_t i, const sym_t x){
+                buffer[i] = x;
+            });
+
+            // send buckets away, coalesced by target
+            const auto& sizes = bucket_sizes[num_levels];
+            for(size_t k = 0; k < sizes.size(); k++) {
+                if(sizes[k] > 0) {
+                    #ifdef DBG_CONCAT
+                    ctx.cout() << "processing bucket " << k
+                        << " with global offset = "
+                        << glob_bucket_offs[num_levels][k] << std::endl;
+                    #endif
+
+                    exchange.add(buffer.data() + bucket_pos[k],
+                        glob_bucket_offs[num_levels][k], sizes[k]);
+                }
+            }
+        }
+        exchange.send(tag);
+
+        // receive substrings and bits until filled locally
+        exchange.receive(
+            etext, last ? 0 : local_num, input.local_offset(),
+            tag, &bits, (num_levels - 1) * local_num);
+
+        // synchronize before cleaning!
+        ctx.synchronize();
+
+        // clean up
+        exchange.clear();
+
+        // the levels of this round are final
+        stream_levels(next_level);
+    }
+    stream_levels(height);
+}
+
+// constructs the levels and digit counts of the 2^k-ary wavelet matrix of
+// the text, whose local part is given in etext and is reordered in the
+// process
+//
+// each level takes one communication round, in which the local text is
+// stably sorted into 2^k buckets by the level's digit, i.e., a k-bit radix
+// step
+template<size_t k, typename sym_t>
+static void construct_multiary(
+    MPIContext& ctx,
+    const FilePartitionReader<sym_t>& input,
+    const WaveletMatrixMultiary<k>& wm,
+    typename WaveletMatrixMultiary<k>::levels_t& levels,
+    typename WaveletMatrixMultiary<k>::z_t& z,
+    std::vector<sym_t>& etext) {
+
+    using layout = MultiaryLayout<k>;
+
+    const size_t local_num = input.local_num();
+    const size_t num_levels = wm.num_levels();
+    const size_t num_digits = layout::arity;
+
+    levels.resize(num_levels);
+
+    std::vector<sym_t> buffer(local_num);
+    std::vector<size_t> bucket_pos;
+
+    BucketExchange<sym_t> exchange(ctx, input.size_per_worker());
+    for(size_t level = 0; level < num_levels; level++) {
+        const int tag = int(level);
+
+        ctx.cout_master() << "level " << (level+1) << " ..." << std::endl;
+
+        // the local text is in the order of the current level,
+        // so the level's digits can be computed in place
+        auto& digits = levels[level];
+        digits.resize(local_num);
+
+        std::vector<size_t> counts(num_digits, 0);
+        for(size_t i = 0; i < local_num; i++) {
+            const uint8_t d = layout::digit(etext[i], level, num_levels);
+            digits.set(i, d);
+            ++counts[d];
+        }
+
+        // buckets are preceded by the items of all lower buckets and
+        // the items of the same bucket held by lower ranks
+        std::vector<size_t> glob_counts(num_digits);
+        ctx.all_reduce(counts.data(), glob_counts.data(), num_digits);
+
+        for(size_t d = 0; d < num_digits; d++) {
+            z[level * num_digits + d] = glob_counts[d];
+        }
+
+        if(level + 1 == num_levels) break;
+
+        std::vector<size_t> lower_counts(counts);
+        ctx.ex_scan(lower_counts);
+        if(ctx.rank() == 0) {
+            // the result is undefined on the first worker
+            std::fill(lower_counts.begin(), lower_counts.end(), 0);
+        }
+
+        std::vector<size_t> glob_bucket_offs(num_digits);
+        {
+            size_t glob_offs = 0;
+            for(size_t d = 0; d < num_digits; d++) {
+                glob_bucket_offs[d] = glob_offs + lower_counts[d];
+                glob_offs += glob_counts[d];
+            }
+        }
+
+        // stably sort the local text by the level's digits
+        round_bucket_sort(etext, counts, bucket_pos,
+            [&](const sym_t x){
+                return layout::digit(x, level, num_levels);
+            },
+            [&](const size_t i, const sym_t x){ buffer[i] = x; });
+
+        // send buckets away, coalesced by target
+        for(size_t d = 0; d < num_digits; d++) {
+            if(counts[d] > 0) {
+                #ifdef DBG_CONCAT
+                ctx.cout() << "processing bucket " << d
+                    << " with global offset = " << glob_bucket_offs[d]
+                    << std::endl;
+                #endif
+
+                exchange.add(buffer.data() + bucket_pos[d],
+                    glob_bucket_offs[d], counts[d]);
+            }
+        }
+        exchange.send(tag);
+
+        // receive the text in the order of the next level
+        exchange.receive(etext, local_num, input.local_offset(), tag);
+
+        // synchronize before cleaning!
+        ctx.synchronize();
+
+        // clean up
+        exchange.clear();
+    }
+}
+
+template<size_t k, typename sym_t>
+static void start_multiary(
+    MPIContext& ctx,
+    const std::string& input_filename,
+    const size_t prefix,
+    const size_t in_rdbufsize,
+    const std::string& output) {
+
+    Result::Time time;
+    double t0 = ctx.time();
+
+    auto dt = [&](){
+        const double t = ctx.time();
+        const double dt = t - t0;
+        t0 = t;
+        return dt;
+    };
+
+    // Determine input partition
+    FilePartitionReader<sym_t> input(ctx, input_filename, prefix);
+    const size_t local_num = input.local_num();
+    const size_t rdbufsize = (in_rdbufsize > 0) ? in_rdbufsize : local_num;
+    input.buffer(rdbufsize);
+
+    time.input = dt();
+
+    // Compute histogram
+    ctx.cout_master() << "Compute histogram ..." << std::endl;
+    Histogram<sym_t> hist(ctx, input, rdbufsize);
+
+    time.hist = dt();
+
+    // Compute effective alphabet
+    EffectiveAlphabet<sym_t> ea(hist);
+
+    // Transform text and cache in RAM
+    ctx.cout_master() << "Compute effective transformation ..." << std::endl;
+    std::vector<sym_t> etext(local_num);
+    {
+        size_t i = 0;
+        ea.transform(input, [&](sym_t x){ etext[i++] = x; }, rdbufsize);
+    }
+
+    input.free();
+    time.eff = dt();
+
+    // Build wavelet matrix
+    using wm_t = WaveletMatrixMultiary<k>;
+    auto wm = wm_t(hist,
+    [&](typename wm_t::levels_t& levels, typename wm_t::z_t& z,
+        const wm_t& wm){
+
+        construct_multiary<k>(ctx, input, wm, levels, z, etext);
+    });
+
+    time.construct = dt();
+    time.merge = 0;
+
+    // write to disk if needed
+    if(output.length() > 0) {
+        ctx.synchronize();
+        ctx.cout_master() << "Writing WM to disk ..." << std::endl;
+
+        if(ctx.rank() == 0) {
+            hist.save(output + "." + WaveletMatrixBase::histogram_extension());
+            wm.save_z(output + "." + WaveletMatrixBase::z_extension());
+            wm_t::layout::save_arity(
+                output + "." + wm_t::layout::arity_extension());
+        }
+
+        wm.save(ctx, output);
+    }
+
+    // Synchronize for exit
+    ctx.cout_master() << "Waiting for exit signals ..." << std::endl;
+    ctx.synchronize();
+
+    // gather stats
+    Result::annotate("arity", std::to_string(wm_t::layout::arity));
+    Result result("mpi-wm-concat", ctx, input, wm.sigma(), time);
+
+    ctx.cout_master() << result.readable() << std::endl
+                      << result.sqlplot() << std::endl;
+}
+
+template<typename sym_t>
+static void start(
+    MPIContext& ctx,
+    const std::string& input_filename,
+    const size_t prefix,
+    const size_t in_rdbufsize,
+    const bool eff_input,
+    const std::string& output) {
+
+    // the multiary construction does not support these options, and
+    // silently ignoring them would not give what was asked for
+    if(arity() != 2 && (stream() || mapped())) {
+        ctx.cout_master() << "the options -s and -f are only supported "
+            "for the binary WM (-a 2)" << std::endl;
+        failed() = true;
+        return;
+    }
+
+    switch(arity()) {
+        case 2: break;
+
+        case 4:
+            start_multiary<2, sym_t>(
+                ctx, input_filename, prefix, in_rdbufsize, output);
+            return;
+
+        case 16:
+            start_multiary<4, sym_t>(
+                ctx, input_filename, prefix, in_rdbufsize, output);
+            return;
+
+        default:
+            ctx.cout_master()
+                << "arity of " << arity() << " not supported" << std::endl;
+            failed() = true;
+            return;
+    }
+
+    Result::Time time;
+    double t0 = ctx.time();
+
+    auto dt = [&](){
+        const double t = ctx.time();
+        const double dt = t - t0;
+        t0 = t;
+        return dt;
+    };
+
+    // Determine input partition
+    FilePartitionReader<sym_t> input(ctx, input_filename, prefix);
+    const size_t local_num = input.local_num();
+    const size_t rdbufsize = (in_rdbufsize > 0) ? in_rdbufsize : local_num;
+    input.buffer(rdbufsize);
+
+    time.input = dt();
+
+    if(eff_input) {
+        // Load input and find maximum symbol
+        ctx.cout_master() << "Loading input (skipping histogram computation) ..." << std::endl;
+        sym_t local_max = 0;
+
+        std::vector<sym_t> etext;
+        etext.reserve(local_num);
+        input.process_local([&](const sym_t x){
+            local_max = std::max(x, local_max);
+            etext.push_back(x);
+        }, rdbufsize);
+
+        // Reduce maximum symbol
+        sym_t glob_max;
+        ctx.all_reduce(&local_max, &glob_max, 1, mpi_max<sym_t>::op());
+
+        // Create dummy histogram instance
+        DummyHistogram<sym_t> hist(glob_max);
+
+        time.hist = dt();
+        time.eff = 0;
+
+        build(ctx, input, hist, etext, output, time);
+        return;
+    }
+
+    // Compute histogram
+    ctx.cout_master() << "Compute histogram ..." << std::endl;
+    Histogram<sym_t> hist(ctx, input, rdbufsize);
+
+    time.hist = dt();
+
+    run(ctx, input, hist, rdbufsize, output, time);
+}
+
+// constructs the WM of an input partition whose histogram has already been
+// computed (e.g., by mpi-auto)
+template<typename sym_t>
+static void run(
+    MPIContext& ctx,
+    FilePartitionReader<sym_t>& input,
+    const Histogram<sym_t>& hist,
+    const size_t rdbufsize,
+    const std::string& output,
+    Result::Time time) {
+
+    double t0 = ctx.time();
+
+    // Compute effective alphabet
+    EffectiveAlphabet<sym_t> ea(hist);
+
+    // Transform text and cache in RAM
+    ctx.cout_master() << "Compute effective transformation ..." << std::endl;
+    std::vector<sym_t> etext(input.local_num());
+    {
+        size_t i = 0;
+        ea.transform(input, [&](sym_t x){ etext[i++] = x; }, rdbufsize);
+    }
+
+    time.eff = ctx.time() - t0;
+
+    build(ctx, input, hist, etext, output, time);
+}
+
+// constructs the WM of the given effective text
+template<typename sym_t>
+static void build(
+    MPIContext& ctx,
+    FilePartitionReader<sym_t>& input,
+    const Histogram<sym_t>& hist,
+    std::vector<sym_t>& etext,
+    const std::string& output,
+    Result::Time time) {
+
+    double t0 = ctx.time();
+
+    auto dt = [&](){
+        const double t = ctx.time();
+        const double dt = t - t0;
+        t0 = t;
+        return dt;
+    };
+
+    const size_t local_num = input.local_num();
+
+    input.free();
+
+    // Build wavelet matrix
+    // -> finished levels are written while later ones are constructed
+    // -> or constructed directly into the output files
+    std::unique_ptr<LevelStream> levels;
+    std::unique_ptr<MappedLevels> mapped_levels;
+    if(mapped() && output.length() > 0) {
+        mapped_levels.reset(new MappedLevels(ctx, output,
+            WaveletMatrixBase::level_extension,
+            WaveletMatrixBase(hist).height(), local_num));
+    } else if(stream() && output.length() > 0) {
+        levels.reset(new LevelStream(
+            ctx, output, WaveletMatrixBase::level_extension));
+    }
+
+    auto wm = WaveletMatrix(hist,
+    [&](WaveletMatrix::bits_t& bits, WaveletMatrix::z_t& z, const WaveletMatrixBase& wm){
+        construct(ctx, input, wm, bits, z, etext,
+            levels.get(), mapped_levels.get());
+        if(levels) levels->finish();
+    });
+
+    time.construct = dt();
+    time.merge = 0;
+
+    // write to disk if needed
+    if(output.length() > 0) {
+        ctx.synchronize();
+        ctx.cout_master() << "Writing WM to disk ..." << std::endl;
+
+        if(ctx.rank() == 0) {
+            hist.save(output + "." + WaveletMatrixBase::histogram_extension());
+            wm.save_z(output + "." + WaveletMatrixBase::z_extension());
+        }
+
+        if(mapped_levels) {
+            mapped_levels->sync();
+        } else if(!levels) {
+            wm.save(ctx, output);
+        }
+    }
+
+    // Synchronize for exit
+    ctx.cout_master() << "Waiting for exit signals ..." << std::endl;
+    ctx.synchronize();
+
+    // gather stats
+    Result result("mpi-wm-concat", ctx, input, wm.sigma(), time);
+
+    ctx.cout_master() << result.readable() << std::endl
+                      << result.sqlplot() << std::endl;
+}
+};
@@ -0,0 +1,159 @@
+#pragma once
+
+#include "mpi_launcher.hpp"
+
+#include <string>
+#include <vector>
+
+#include <distwt/common/util.hpp>
+
+#include <distwt/mpi/file_partition_reader.hpp>
+
+#include <distwt/mpi/histogram.hpp>
+#include <distwt/mpi/effective_alphabet.hpp>
+#include <distwt/mpi/bit_vector.hpp>
+
+#include <distwt/mpi/wm.hpp>
+#include <distwt/mpi/wm_local.hpp>
+
+#include <distwt/mpi/result.hpp>
+
+class mpi_wm_dd {
+public:
+
+template<typename sym_t>
+static void start(
+    MPIContext& ctx,
+    const std::string& input_filename,
+    const size_t prefix,
+    const size_t in_rdbufsize,
+    const bool eff_input,
+    const std::string& output) {
+
+    Result::Time time;
+    double t0 = ctx.time();
+
+    auto dt = [&](){
+        const double t = ctx.time();
+        const double dt = t - t0;
+        t0 = t;
+        return dt;
+    };
+
+    // Determine input partition
+    FilePartitionReader<sym_t> input(ctx, input_filename, prefix);
+    const size_t local_num = input.local_num();
+    const size_t rdbufsize = (in_rdbufsize > 0) ? in_rdbufsize : local_num;
+    input.buffer(rdbufsize);
+
+    time.input = dt();
+
+    // Compute histogram
+    ctx.cout_master() << "Compute histogram ..." << std::endl;
+    Histogram<sym_t> hist(ctx, input, rdbufsize);
+
+    time.hist = dt();
+
+    run(ctx, input, hist, rdbufsize, output, time);
+}
+
+// constructs the WM of an input partition whose histogram has already been
+// computed (e.g., by mpi-auto)
+template<typename sym_t>
+static void run(
+    MPIContext& ctx,
+    FilePartitionReader<sym_t>& input,
+    const Histogram<sym_t>& hist,
+    const size_t rdbufsize,
+    const std::string& output,
+    Result::Time time) {
+
+    double t0 = ctx.time();
+
+    auto dt = [&](){
+        const double t = ctx.time();
+        const double dt = t - t0;
+        t0 = t;
+        return dt;
+    };
+
+    const size_t local_num = input.local_num();
+
+    // Compute effective alphabet
+    EffectiveAlphabet<sym_t> ea(hist);
+
+    // Transform text and cache in RAM
+    ctx.cout_master() << "Compute effective transformation ..." << std::endl;
+    std::vector<sym_t> etext(local_num);
+    {
+        size_t i = 0;
+        ea.transform(input, [&](sym_t x){ etext[i++] = x; }, rdbufsize);
+    }
+
+    time.eff = dt();
+    input.free();
+
+    // local construction
+    ctx.cout_master() << "Compute local WMs ..." << std::endl;
+    const WaveletMatrixBase wm_base(hist);
+    const size_t height = wm_base.height();
+
+    std::vector<bv_t> local_bits;
+    wm_local_runs_t runs;
+    wm_local(local_bits, runs, etext, height);
+
+    // Clean up
+    etext.clear();
+    etext.shrink_to_fit();
+
+    // Synchronize
+    ctx.cout_master() << "Done. Synchronizing ..." << std::endl;
+    ctx.synchronize();
+
+    time.construct = dt();
+
+    // Merge
+    WaveletMatrix wm(hist,
+    [&](WaveletMatrix::bits_t& bits, WaveletMatrix::z_t& z, const WaveletMatrixBase&){
+        wm_merge_local(ctx, bits, local_bits, runs,
+            WaveletTreeBase::node_sizes(hist), input.size_per_worker());
+
+        // compute Z values from histogram
+        const size_t sigma = hist.size();
+        for(size_t level = 0; level < height; level++) {
+            const size_t mask = 1ULL << (height - 1 - level);
+
+            size_t num0 = 0;
+            for(size_t i = 0; i < sigma; i++) {
+                if((i & mask) == 0) num0 += hist.entries[i].second;
+            }
+            z[level] = num0;
+        }
+    });
+    time.merge = dt();
+
+    // write to disk if needed
+    if(output.length() > 0) {
+        ctx.synchronize();
+        ctx.cout_master() << "Writing WM to disk ..." << std::endl;
+
+        if(ctx.rank() == 0) {
+            hist.save(output + "." + WaveletMatrixBase::histogram_extension());
+            wm.save_z(output +  + "." + WaveletMatrixBase::z_extension());
+        }
+
+        wm.save(ctx, output);
+    }
+
+    // Synchronize for exit
+    ctx.cout_master() << "Waiting for exit signals ..." << std::endl;
+    ctx.synchronize();
+
+    // gather stats
+    Result result("mpi-wm-dd", ctx, input, wm.sigma(), time);
+
+    ctx.cout_master() << result.readable() << std::endl
+                      << result.sqlplot() << std::endl;
+}
+
+};
@@ -0,0 +1,145 @@
+#include "mpi_launcher.hpp"
+
+#include <string>
+#include <vector>
+
+#include <distwt/mpi/file_partition_reader.hpp>
+#include <distwt/mpi/histogram.hpp>
+#include <distwt/mpi/effective_alphabet.hpp>
+#include <distwt/mpi/result.hpp>
+#include <distwt/mpi/wm.hpp>
+#include <distwt/mpi/wt_levelwise.hpp>
+
+#include "mpi_bsort.hpp"
+#include "mpi_wm_concat.hpp"
+
+// constructs both the levelwise WT (using mpi-bsort) and the WM (using
+// mpi-wm-concat) of the same text, reading the input and computing the
+// histogram and effective transformation only once
+class mpi_wt_wm {
+public:
+    // number of levels to resolve per communication round (0 = automatic)
+    static size_t& levels_per_round() {
+        static size_t s_levels_per_round = 0;
+        return s_levels_per_round;
+    }
+
+template<typename sym_t>
+static void start(
+    MPIContext& ctx,
+    const std::string& input_filename,
+    const size_t prefix,
+    const size_t in_rdbufsize,
+    const bool /* eff_input */,
+    const std::string& output) {
+
+    Result::Time time;
+    double t0 = ctx.time();
+
+    auto dt = [&](){
+        const double t = ctx.time();
+        const double dt = t - t0;
+        t0 = t;
+        return dt;
+    };
+
+    mpi_bsort::levels_per_round() = levels_per_round();
+    mpi_wm_concat::levels_per_round() = levels_per_round();
+
+    // Determine input partition
+    FilePartitionReader<sym_t> input(ctx, input_filename, prefix);
+    const size_t local_num = input.local_num();
+    const size_t rdbufsize = (in_rdbufsize > 0) ? in_rdbufsize : local_num;
+    input.buffer(rdbufsize);
+
+    time.input = dt();
+
+    // Compute histogram
+    ctx.cout_master() << "Compute histogram ..." << std::endl;
+    Histogram<sym_t> hist(ctx, input, rdbufsize);
+
+    time.hist = dt();
+
+    // Compute effective alphabet
+    EffectiveAlphabet<sym_t> ea(hist);
+
+    // Transform text and cache in RAM
+    ctx.cout_master() << "Compute effective transformation ..." << std::endl;
+    std::vector<sym_t> etext(local_num);
+    {
+        size_t i = 0;
+        ea.transform(input, [&](sym_t x){ etext[i++] = x; }, rdbufsize);
+    }
+
+    input.free();
+    time.eff = dt();
+
+    // Build wavelet matrix from a copy of the text, because both
+    // constructions reorder it
+    ctx.cout_master() << "Construct WM ..." << std::endl;
+    auto wm = WaveletMatrix(hist,
+    [&](WaveletMatrix::bits_t& bits, WaveletMatrix::z_t& z, const WaveletMatrixBase& wm){
+        std::vector<sym_t> wm_text(etext);
+        mpi_wm_concat::construct(ctx, input, wm, bits, z, wm_text);
+    });
+
+    const double time_wm = dt();
+
+    // Build wavelet tree
+    ctx.cout_master() << "Construct WT ..." << std::endl;
+    auto wt = WaveletTreeLevelwise(hist,
+    [&](WaveletTree::bits_t& bits, const WaveletTreeBase& wt){
+        mpi_bsort::construct(ctx, input, hist, wt, bits, etext);
+    });
+
+    etext.clear();
+    etext.shrink_to_fit();
+
+    const double time_wt = dt();
+    time.construct = time_wm + time_wt;
+    time.merge = 0;
+
+    // write to disk if needed
+    // the WT is written to <output>.wt and the WM to <output>.wm
+    if(output.length() > 0) {
+        ctx.synchronize();
+        ctx.cout_master() << "Writing WT and WM to disk ..." << std::endl;
+
+        const std::string wt_output = output + ".wt";
+        const std::string wm_output = output + ".wm";
+
+        if(ctx.rank() == 0) {
+            hist.save(wt_output + "." +
+                WaveletTreeBase::histogram_extension());
+            hist.save(wm_output + "." +
+                WaveletMatrixBase::histogram_extension());
+            wm.save_z(wm_output + "." + WaveletMatrixBase::z_extension());
+        }
+
+        wt.save(ctx, wt_output);
+        wm.save(ctx, wm_output);
+    }
+
+    // Synchronize for exit
+    ctx.cout_master() << "Waiting for exit signals ..." << std::endl;
+    ctx.synchronize();
+
+    // gather stats
+    Result::annotate("time_wt", std::to_string(time_wt));
+    Result::annotate("time_wm", std::to_string(time_wm));
+    Result result("mpi-wt-wm", ctx, input, wt.sigma(), time);
+
+    ctx.cout_master() << result.readable() << std::endl
+                      << result.sqlplot() << std::endl;
+}
+};
+
+int main(int argc, char** argv) {
+    return mpi_launch<mpi_wt_wm>(argc, argv, [](tlx::CmdlineParser& cp){
+        cp.add_size_t('t', "levels-per-round", mpi_wt_wm::levels_per_round(),
+            "Number of levels to resolve per communication round in both "
+            "constructions (default: automatic).");
+        cp.add_flag('H', "hybrid", mpi_bsort::hybrid(),
+            "Use the hybrid construction for the WT (see mpi-bsort).");
+    });
+}
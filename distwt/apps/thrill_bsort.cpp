@@ -146,14 +146,14 @@ int main(int argc, const char** argv) {
                         // compute alignment data structure
                         const size_t node_id = first_nlevel_node + v;
                         const size_t num_blocks = tlx::div_ceil(
-                            node_sizes[node_id-1], sym_pack_size);
+                            node_sizes.size(node_id), sym_pack_size);
 
                         blocks[v] = (v > 0)
                             ? (blocks[v-1] + num_blocks)
                             : num_blocks;
 
                         // advance
-                        glob_node_offs += node_sizes[first_nlevel_node-1+v];
+                        glob_node_offs += node_sizes.size(node_id);
                     }
 
                     // concatenate buckets
@@ -180,7 +180,7 @@ int main(int argc, const char** argv) {
                             size_t block_size;
                             if(rank+1 == blocks[i]) {
                                 const size_t sz_mod =
-                                    node_sizes[first_nlevel_node+i-1] % sym_pack_size;
+                                    node_sizes.size(first_nlevel_node+i) % sym_pack_size;
 
                                 block_size = (sz_mod == 0ULL)
                                     ? sym_pack_size
@@ -23,8 +23,13 @@ uint32_t bitrev32(uint32_t v) {
     return c;
 }
 
+uint64_t bitrev64(uint64_t v) {
+    return (uint64_t(bitrev32(uint32_t(v))) << 32ULL) |
+        uint64_t(bitrev32(uint32_t(v >> 32ULL)));
+}
+
 // custom
-uint32_t bitrev(uint32_t x, uint8_t b) {
+uint64_t bitrev(uint64_t x, uint8_t b) {
     if(!b) return 0;
-    return bitrev32(x) >> (uint8_t(32) - b);
+    return bitrev64(x) >> (uint8_t(64) - b);
 }
@@ -2,4 +2,5 @@
 
 #include <cstdint>
 
-uint32_t bitrev(uint32_t x, uint8_t b);
+// reverses the b least significant bits of x (b <= 64)
+uint64_t bitrev(uint64_t x, uint8_t b);
@@ -25,7 +25,7 @@ protected:
         m_entries.reserve(num_entries);
         for(size_t i = 0; i < num_entries; i++) {
             const auto sym = r.template read<sym_t>();
-            const auto cnt = r.template read<idx_t>();
+            const auto cnt = r.template read<size_t>(); // saved as size_t
 
             m_entries.emplace_back(sym, cnt);
         }
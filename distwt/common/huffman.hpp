@@ -0,0 +1,231 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <queue>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <tlx/math/integer_log2.hpp>
+
+#include <distwt/common/binary_io.hpp>
+#include <distwt/common/histogram.hpp>
+
+// canonical Huffman code for the effective alphabet of a histogram, which
+// determines the shape of a Huffman-shaped wavelet tree
+//
+// symbol i of the effective alphabet is the histogram's i-th entry. level l
+// of the tree contains the occurrences of all symbols whose code is longer
+// than l, ordered by the first l bits of their code. the node of level l
+// with prefix P has ID 2^l + P, so node IDs are 1-based heap order as in a
+// balanced tree
+//
+// in a canonical code, every code is lexicographically greater than all
+// shorter codes. hence, if symbols are ordered by their code, the symbols
+// still present on a level form a suffix of that order, and the symbols of
+// each node form a contiguous range
+class HuffmanCode {
+public:
+    // codes are limited so that node IDs fit into 64 bits
+    static constexpr size_t max_length = 63;
+
+    static inline std::string extension() {
+        return "huff";
+    }
+
+private:
+    std::vector<uint8_t> m_length;  // code length of each symbol
+    std::vector<uint64_t> m_code;   // code of each symbol, right-aligned
+
+    std::vector<size_t> m_order;    // symbols ordered by their code
+    std::vector<size_t> m_c;        // occurrences of the first k symbols
+                                    // in code order
+    std::vector<size_t> m_first;    // number of symbols whose code is not
+                                    // longer than l
+    size_t m_height;
+
+    // computes Huffman code lengths for the given symbol counts
+    static std::vector<uint8_t> code_lengths(const std::vector<size_t>& cnt) {
+        const size_t sigma = cnt.size();
+        std::vector<uint8_t> length(sigma, 0);
+        if(sigma < 2) return length;
+
+        // merge the two least frequent trees until one is left
+        // tree nodes 0 to sigma-1 are the leaves
+        using item_t = std::pair<size_t, size_t>; // (count, tree node)
+        std::priority_queue<item_t, std::vector<item_t>,
+            std::greater<item_t>> queue;
+
+        std::vector<size_t> parent(2 * sigma - 1, 0);
+        for(size_t i = 0; i < sigma; i++) {
+            queue.emplace(cnt[i], i);
+        }
+
+        size_t next = sigma;
+        while(queue.size() > 1) {
+            const item_t a = queue.top(); queue.pop();
+            const item_t b = queue.top(); queue.pop();
+
+            parent[a.second] = next;
+            parent[b.second] = next;
+            queue.emplace(a.first + b.first, next++);
+        }
+
+        // inner nodes were created in order, so a node's parent has a
+        // greater index and depths can be computed top-down
+        const size_t root = next - 1;
+        std::vector<size_t> depth(2 * sigma - 1, 0);
+        for(size_t v = root; v-- > 0;) {
+            depth[v] = depth[parent[v]] + 1;
+        }
+
+        for(size_t i = 0; i < sigma; i++) {
+            length[i] = uint8_t(std::min(depth[i], max_length + 1));
+        }
+        return length;
+    }
+
+public:
+    template<typename sym_t, typename idx_t>
+    inline HuffmanCode(const HistogramBase<sym_t, idx_t>& hist) {
+        const size_t sigma = hist.size();
+
+        std::vector<size_t> cnt(sigma);
+        for(size_t i = 0; i < sigma; i++) {
+            cnt[i] = hist.entries[i].second;
+        }
+
+        // flatten the distribution until the code is short enough
+        while(true) {
+            m_length = code_lengths(cnt);
+
+            const size_t longest = sigma > 0
+                ? *std::max_element(m_length.begin(), m_length.end()) : 0;
+            if(longest <= max_length) break;
+
+            for(auto& c : cnt) c = (c >> 1) + 1;
+        }
+
+        // assign canonical codes in the order of length and symbol
+        m_order.resize(sigma);
+        for(size_t i = 0; i < sigma; i++) {
+            m_order[i] = i;
+        }
+        std::stable_sort(m_order.begin(), m_order.end(),
+            [&](const size_t a, const size_t b){
+                return m_length[a] < m_length[b];
+            });
+
+        m_code.resize(sigma);
+        m_c.resize(sigma + 1);
+        m_c[0] = 0;
+        {
+            uint64_t code = 0;
+            size_t len = sigma > 0 ? m_length[m_order[0]] : 0;
+            for(size_t k = 0; k < sigma; k++) {
+                const size_t sym = m_order[k];
+                if(k > 0) {
+                    code = (code + 1) << (m_length[sym] - len);
+                    len = m_length[sym];
+                }
+                m_code[sym] = code;
+                m_c[k+1] = m_c[k] + hist.entries[sym].second;
+            }
+        }
+
+        m_height = sigma > 0 ? m_length[m_order[sigma - 1]] : 0;
+
+        m_first.resize(m_height + 1);
+        for(size_t level = 0, k = 0; level <= m_height; level++) {
+            while(k < sigma && m_length[m_order[k]] <= level) ++k;
+            m_first[level] = k;
+        }
+    }
+
+    inline size_t sigma() const { return m_length.size(); }
+    inline size_t height() const { return m_height; }
+
+    inline size_t length(const size_t sym) const { return m_length[sym]; }
+    inline uint64_t code(const size_t sym) const { return m_code[sym]; }
+
+    // the bit of the symbol's code on the given level
+    inline bool bit(const size_t sym, const size_t level) const {
+        return (m_code[sym] >> (m_length[sym] - 1 - level)) & 1ULL;
+    }
+
+    // the ID of the node of the given level that the symbol belongs to,
+    // provided that its code is longer than level
+    inline size_t node_id(const size_t sym, const size_t level) const {
+        return (1ULL << level) |
+            size_t(m_code[sym] >> (m_length[sym] - level));
+    }
+
+    static inline size_t level(const size_t node_id) {
+        return tlx::integer_log2_floor(node_id);
+    }
+
+    // the total number of occurrences on the given level
+    inline size_t level_size(const size_t level) const {
+        return m_c.back() - m_c[m_first[level]];
+    }
+
+    // the range [first, last) of symbols (in code order) of the given node
+    inline std::pair<size_t, size_t> symbol_range(const size_t node_id) const {
+        const size_t level = HuffmanCode::level(node_id);
+        const uint64_t prefix = node_id - (1ULL << level);
+
+        auto key = [&](const size_t k){
+            const size_t sym = m_order[k];
+            return m_code[sym] >> (m_length[sym] - level);
+        };
+
+        // the prefixes of the symbols on the level are non-decreasing
+        size_t lo = m_first[level], hi = sigma();
+        while(lo < hi) {
+            const size_t m = (lo + hi) / 2;
+            if(key(m) < prefix) lo = m + 1; else hi = m;
+        }
+
+        size_t first = lo;
+        hi = sigma();
+        while(lo < hi) {
+            const size_t m = (lo + hi) / 2;
+            if(key(m) <= prefix) lo = m + 1; else hi = m;
+        }
+        return { first, lo };
+    }
+
+    // the offset of the node's occurrences within its level
+    inline size_t offset(const size_t node_id) const {
+        const size_t level = HuffmanCode::level(node_id);
+        return m_c[symbol_range(node_id).first] - m_c[m_first[level]];
+    }
+
+    // the number of the node's occurrences
+    inline size_t size(const size_t node_id) const {
+        const auto r = symbol_range(node_id);
+        return m_c[r.second] - m_c[r.first];
+    }
+
+    // the total number of bits of the tree
+    inline size_t total_bits() const {
+        size_t bits = 0;
+        for(size_t level = 0; level < m_height; level++) {
+            bits += level_size(level);
+        }
+        return bits;
+    }
+
+    // saves the code table, i.e., the code length and code of each symbol
+    void save(const std::string& filename) const {
+        binary::FileWriter w(filename);
+
+        w.write<size_t>(sigma());
+        for(size_t i = 0; i < sigma(); i++) {
+            w.write<uint8_t>(m_length[i]);
+            w.write<uint64_t>(m_code[i]);
+        }
+    }
+};
@@ -3,6 +3,12 @@
 #include <sstream>
 #include <tlx/string/format_si_iec_units.hpp>
 
+std::string ResultBase::s_annotations;
+
+void ResultBase::annotate(const std::string& key, const std::string& value) {
+    s_annotations += " " + key + "=" + value;
+}
+
 std::string ResultBase::sqlplot() const {
     std::ostringstream oss;
     oss << "RESULT";
@@ -21,6 +27,7 @@ std::string ResultBase::sqlplot() const {
     oss << " memory=" << m_memory;
     oss << " traffic=" << m_traffic;
     oss << " traffic_asym=" << m_traffic_asym;
+    oss << s_annotations;
     return oss.str();
 }
 
@@ -29,7 +29,13 @@ protected:
     size_t m_traffic;
     size_t m_traffic_asym;
 
+    static std::string s_annotations;
+
 public:
+    // appends key=value to the sqlplot line of all results
+    // (the value must not contain whitespace)
+    static void annotate(const std::string& key, const std::string& value);
+
     std::string sqlplot() const;
     std::string readable() const;
 };
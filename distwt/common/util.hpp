@@ -14,6 +14,11 @@ inline size_t file_size(const std::string& filename) {
     return buf.st_size;
 }
 
+inline bool file_exists(const std::string& filename) {
+    struct stat buf;
+    return stat(filename.c_str(), &buf) == 0;
+}
+
 inline double time() {
     using namespace std::chrono;
     return double(duration_cast<milliseconds>(
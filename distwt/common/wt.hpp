@@ -1,10 +1,13 @@
 #pragma once
 
+#include <algorithm>
 #include <string>
 #include <vector>
 
+#include <tlx/math/div_ceil.hpp>
 #include <tlx/math/integer_log2.hpp>
 
+#include <distwt/common/bitrev.hpp>
 #include <distwt/common/histogram.hpp>
 
 class WaveletTreeBase {
@@ -13,42 +16,194 @@ protected:
     size_t m_height;
 
     static inline size_t wt_height(const size_t sigma) {
-        return tlx::integer_log2_ceil(sigma - 1);
+        // number of bits needed to represent symbols 0 to sigma-1
+        return tlx::integer_log2_ceil(sigma);
     }
 
     static inline size_t max_bintree_nodes(const size_t height) {
         return (1ULL << height) - 1ULL;
     }
 
+public:
+    // answers the sizes of the tree's nodes from the C array in constant
+    // time, without materializing all 2^h-1 nodes
+    //
+    // node i (zero-based) of level l represents the symbols
+    // [i * 2^(h-l), (i+1) * 2^(h-l)), so all nodes beyond sigma are empty
     template<typename idx_t>
-    static void recursive_node_sizes(
-        std::vector<idx_t>& sizes,
-        const std::vector<idx_t>& c,
-        size_t node_id,
-        size_t a,
-        size_t b) {
-
-        if(a < b) {
-            sizes[node_id - 1] =
-                c[std::min(b+1, c.size()-1)] -
-                c[std::min(a,   c.size()-1)];
-
-            const size_t m = (a+b)/2;
-            recursive_node_sizes(sizes, c, 2ULL * node_id, a, m);
-            recursive_node_sizes(sizes, c, 2ULL * node_id + 1ULL, m+1, b);
+    class NodeSizes {
+    private:
+        std::vector<idx_t> m_c;
+        size_t m_sigma;
+        size_t m_height;
+
+        // number of occurrences of symbols less than the given one
+        inline size_t c(const size_t sym) const {
+            return m_c[std::min(sym, m_sigma)];
         }
-    }
 
-public:
-    template<typename sym_t, typename idx_t>
-    static std::vector<idx_t> node_sizes(const HistogramBase<sym_t, idx_t>& hist) {
-        const size_t num_nodes = max_bintree_nodes(wt_height(hist.size()));
-        std::vector<idx_t> sizes(num_nodes);
+    public:
+        // iterates over the nonempty nodes of a level in natural order
+        class Cursor {
+        private:
+            const NodeSizes* m_sizes;
+            size_t m_node_id;
+            size_t m_end;
+
+            inline void skip_empty() {
+                while(m_node_id < m_end && m_sizes->size(m_node_id) == 0) {
+                    ++m_node_id;
+                }
+            }
+
+        public:
+            inline Cursor(const NodeSizes& sizes, const size_t level)
+                : m_sizes(&sizes),
+                  m_node_id(1ULL << level),
+                  m_end(m_node_id + sizes.num_level_nodes(level)) {
+
+                skip_empty();
+            }
+
+            inline bool valid() const { return m_node_id < m_end; }
+
+            inline void next() {
+                ++m_node_id;
+                skip_empty();
+            }
+
+            inline size_t node_id() const { return m_node_id; }
+            inline size_t size() const { return m_sizes->size(m_node_id); }
+            inline size_t offset() const {
+                return m_sizes->offset(m_node_id);
+            }
+        };
+
+        template<typename sym_t>
+        inline NodeSizes(const HistogramBase<sym_t, idx_t>& hist)
+            : m_c(hist.compute_C()),
+              m_sigma(hist.size()),
+              m_height(wt_height(hist.size())) {
+        }
+
+        static inline size_t level(const size_t node_id) {
+            return tlx::integer_log2_floor(node_id);
+        }
+
+        // the global offset of the node's bits in its level, in natural order
+        inline size_t offset(const size_t node_id) const {
+            const size_t level = NodeSizes::level(node_id);
+            const size_t i = node_id - (1ULL << level);
+            return c(i << (m_height - level));
+        }
+
+        inline size_t size(const size_t node_id) const {
+            const size_t level = NodeSizes::level(node_id);
+            const size_t i = node_id - (1ULL << level);
+            const size_t lsh = m_height - level;
+            return c((i+1) << lsh) - c(i << lsh);
+        }
+
+        // the number of nodes on the given level that represent at least
+        // one symbol of the alphabet
+        inline size_t num_level_nodes(const size_t level) const {
+            return std::min(size_t(1) << level, size_t(
+                tlx::div_ceil(m_sigma, size_t(1) << (m_height - level))));
+        }
+
+        inline Cursor level_nodes(const size_t level) const {
+            return Cursor(*this, level);
+        }
 
-        auto c = hist.compute_C();
-        recursive_node_sizes(sizes, c, 1, 0, num_nodes);
+        // the global offsets of the bits of the level's nodes (indexed
+        // zero-based within the level)
+        //
+        // if bit_reversal is set, the nodes are ordered by their bit-reversed
+        // index as in a wavelet matrix, otherwise they are in natural order
+        inline std::vector<size_t> level_offsets(
+            const size_t level,
+            const bool bit_reversal) const {
+
+            const size_t first_level_node = 1ULL << level;
+            const size_t num = num_level_nodes(level);
+
+            std::vector<size_t> offs(num);
+            if(bit_reversal) {
+                std::vector<size_t> order(num);
+                for(size_t i = 0; i < num; i++) {
+                    order[i] = i;
+                }
+                std::sort(order.begin(), order.end(),
+                    [&](const size_t a, const size_t b){
+                        return bitrev(a, level) < bitrev(b, level);
+                    });
+
+                size_t o = 0;
+                for(const size_t i : order) {
+                    offs[i] = o;
+                    o += size(first_level_node + i);
+                }
+            } else {
+                for(size_t i = 0; i < num; i++) {
+                    offs[i] = offset(first_level_node + i);
+                }
+            }
+            return offs;
+        }
+
+        // the global offsets of the given nodes of a level, which may be in
+        // any order, as in level_offsets
+        //
+        // in bit-reversed order, the level's nodes are visited without being
+        // materialized, so this takes time linear in the number of the
+        // level's nodes, but only space for the given nodes
+        inline std::vector<size_t> offsets(
+            const size_t level,
+            const std::vector<size_t>& node_ids,
+            const bool bit_reversal) const {
+
+            const size_t num = node_ids.size();
+            std::vector<size_t> offs(num);
+            if(!bit_reversal) {
+                for(size_t k = 0; k < num; k++) {
+                    offs[k] = offset(node_ids[k]);
+                }
+                return offs;
+            }
+
+            const size_t first_level_node = 1ULL << level;
+            auto rev = [&](const size_t k){
+                return bitrev(node_ids[k] - first_level_node, level);
+            };
+
+            std::vector<size_t> order(num);
+            for(size_t k = 0; k < num; k++) {
+                order[k] = k;
+            }
+            std::sort(order.begin(), order.end(),
+                [&](const size_t a, const size_t b){ return rev(a) < rev(b); });
+
+            const size_t num_nodes = num_level_nodes(level);
+
+            size_t o = 0;
+            auto next = order.begin();
+            for(size_t r = 0; next != order.end(); r++) {
+                while(next != order.end() && rev(*next) == r) {
+                    offs[*next++] = o;
+                }
+
+                const size_t i = bitrev(r, level);
+                if(i < num_nodes) o += size(first_level_node + i);
+            }
+            return offs;
+        }
+    };
+
+    template<typename sym_t, typename idx_t>
+    static inline NodeSizes<idx_t> node_sizes(
+        const HistogramBase<sym_t, idx_t>& hist) {
 
-        return sizes;
+        return NodeSizes<idx_t>(hist);
     }
 
     static inline std::string histogram_extension() {
@@ -90,6 +90,55 @@ inline void wt_pc(
     }
 }
 
+// prefix counting for wavelet subtree, writing level-wise bit vectors
+//
+// the subtree represents the n symbols at text, which are in the order of
+// the root's level. on each of the subtree's levels, its nodes are written
+// in order to the bits [offs, offs + n) of the respective global level
+template<typename sym_t, typename idx_t>
+inline void wt_pc_levelwise(
+    wt_bits_t& bits,
+    const sym_t* text,
+    const size_t n,
+    const size_t root_node_id, // 1-based!!
+    const size_t h,
+    const size_t offs) {
+
+    assert(root_node_id > 0);
+    assert(h >= 1);
+    const size_t root_level = tlx::integer_log2_floor(root_node_id);
+    const size_t root_rank = (root_node_id - (1ULL << root_level));
+
+    // compute histogram of the subtree's alphabet
+    std::vector<idx_t> hist(1ULL << h);
+    for(size_t i = 0; i < n; i++) {
+        ++hist[size_t(text[i]) - (root_rank << h)];
+    }
+
+    // compute levels bottom-up
+    std::vector<size_t> pos(1ULL << (h-1));
+    for(size_t level = h; level > 0; --level) {
+        const size_t l = level - 1;
+        const size_t num_level_nodes = 1ULL << l;
+
+        // compute node sizes and their starting positions
+        size_t p = offs;
+        for(size_t v = 0; v < num_level_nodes; v++) {
+            hist[v] = hist[2 * v] + hist[2 * v + 1];
+            pos[v] = p;
+            p += hist[v];
+        }
+
+        // compute level bit vector
+        auto& level_bits = bits[root_level + l];
+        for(size_t i = 0; i < n; i++) {
+            const size_t c = text[i];
+            const size_t v = (c >> (h - l)) - (root_rank << l);
+            level_bits[pos[v]++] = (c >> (h - 1 - l)) & 1ULL;
+        }
+    }
+}
+
 // prefix counting
 template<typename sym_t, typename idx_t>
 inline void wt_pc(
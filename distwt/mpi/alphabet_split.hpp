@@ -0,0 +1,106 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+#include <tlx/math/integer_log2.hpp>
+
+#include <distwt/common/wt.hpp>
+
+// splits the effective alphabet into contiguous symbol ranges, one per
+// worker, that are aligned with the nodes of a common split level
+//
+// each node of the split level is assigned to the worker whose text
+// partition contains the node's middle item in the level's order. the split
+// level is the first one with at least as many nodes as there are workers
+// on which no worker is assigned more than max_split_imbalance times its
+// share of the text. if there is no such level, the one with the smallest
+// maximum load is used
+template<typename idx_t>
+class AlphabetSplit {
+private:
+    static constexpr double max_split_imbalance = 1.125;
+
+    const WaveletTreeBase::NodeSizes<idx_t>* m_node_sizes;
+    size_t m_size_per_worker;
+    size_t m_num_workers;
+    size_t m_level;
+
+    // the maximum number of items assigned to any worker when splitting
+    // on the given level
+    size_t max_load(const size_t level) const {
+        std::vector<size_t> load(m_num_workers, 0);
+        for(auto it = m_node_sizes->level_nodes(level); it.valid(); it.next()) {
+            load[owner(it.node_id())] += it.size();
+        }
+        return *std::max_element(load.begin(), load.end());
+    }
+
+public:
+    inline AlphabetSplit(
+        const WaveletTreeBase::NodeSizes<idx_t>& node_sizes,
+        const size_t height,
+        const size_t size_per_worker,
+        const size_t num_workers)
+        : m_node_sizes(&node_sizes),
+          m_size_per_worker(std::max(size_per_worker, size_t(1))),
+          m_num_workers(num_workers),
+          m_level(std::min(
+              size_t(tlx::integer_log2_ceil(num_workers)), height)) {
+
+        const double limit = max_split_imbalance * double(size_per_worker);
+
+        size_t best = max_load(m_level);
+        for(size_t level = m_level + 1;
+            level <= height && double(best) > limit; level++) {
+
+            const size_t load = max_load(level);
+            if(load < best) {
+                best = load;
+                m_level = level;
+            }
+        }
+    }
+
+    // the level whose nodes are assigned to workers
+    inline size_t level() const {
+        return m_level;
+    }
+
+    // the worker that is assigned the given node of the split level
+    inline size_t owner(const size_t node_id) const {
+        const size_t mid = m_node_sizes->offset(node_id) +
+            m_node_sizes->size(node_id) / 2;
+        return std::min(mid / m_size_per_worker, m_num_workers - 1);
+    }
+
+    // the global offset of the i-th split level node (zero-based within
+    // the level) in the level's order, or the text length if i is the
+    // number of the level's nodes
+    inline size_t offset(const size_t i) const {
+        const size_t num = m_node_sizes->num_level_nodes(m_level);
+        const size_t first_level_node = 1ULL << m_level;
+        if(i < num) return m_node_sizes->offset(first_level_node + i);
+
+        const size_t last = first_level_node + num - 1;
+        return m_node_sizes->offset(last) + m_node_sizes->size(last);
+    }
+
+    // worker r is assigned the split level nodes [v[r], v[r+1]) (zero-based
+    // within the level), where v is the returned vector of size p+1
+    std::vector<size_t> ranges() const {
+        const size_t num = m_node_sizes->num_level_nodes(m_level);
+        const size_t first_level_node = 1ULL << m_level;
+
+        std::vector<size_t> first(m_num_workers + 1, num);
+        for(size_t i = num; i > 0; i--) {
+            first[owner(first_level_node + i - 1)] = i - 1;
+        }
+
+        // workers without nodes get an empty range
+        for(size_t r = m_num_workers; r > 0; r--) {
+            first[r-1] = std::min(first[r-1], first[r]);
+        }
+        return first;
+    }
+};
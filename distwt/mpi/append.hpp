@@ -0,0 +1,351 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <tlx/math/div_ceil.hpp>
+
+#include <distwt/common/bitrev.hpp>
+#include <distwt/common/util.hpp>
+#include <distwt/common/wt.hpp>
+#include <distwt/mpi/bit_vector.hpp>
+#include <distwt/mpi/bucket_exchange.hpp>
+#include <distwt/mpi/context.hpp>
+#include <distwt/mpi/even_partition.hpp>
+#include <distwt/mpi/histogram.hpp>
+
+//#define DBG_APPEND 1
+
+// histogram with explicitly given entries
+template<typename sym_t>
+class EntryHistogram : public Histogram<sym_t> {
+public:
+    using entries_t = std::vector<typename Histogram<sym_t>::entry_t>;
+
+    inline EntryHistogram(entries_t entries) {
+        this->m_entries = std::move(entries);
+    }
+};
+
+// the histograms of an existing text, of a suffix appended to it and of
+// their concatenation, all over the alphabet of the concatenation
+//
+// the codes of the existing text's symbols stay the same if the suffix
+// only introduces symbols greater than all existing ones. if the alphabet
+// grows beyond the next power of two, the codes merely gain leading zeros,
+// i.e., the existing tree becomes the leftmost subtree of the new one
+template<typename sym_t>
+class AppendHistograms {
+private:
+    using entries_t = typename EntryHistogram<sym_t>::entries_t;
+
+    bool m_valid;
+    EntryHistogram<sym_t> m_old, m_new, m_merged;
+
+public:
+    inline AppendHistograms(
+        const Histogram<sym_t>& old_hist,
+        const Histogram<sym_t>& suffix_hist)
+        : m_valid(true), m_old({}), m_new({}), m_merged({}) {
+
+        entries_t old_entries, new_entries, merged;
+
+        size_t i = 0;
+        for(const auto& e : old_hist.entries) {
+            while(i < suffix_hist.size() &&
+                suffix_hist.entries[i].first < e.first) {
+
+                // the suffix contains a symbol that would be inserted
+                // in between existing ones
+                m_valid = false;
+                ++i;
+            }
+
+            size_t num = 0;
+            if(i < suffix_hist.size() &&
+                suffix_hist.entries[i].first == e.first) {
+
+                num = suffix_hist.entries[i++].second;
+            }
+
+            old_entries.emplace_back(e.first, e.second);
+            new_entries.emplace_back(e.first, num);
+            merged.emplace_back(e.first, size_t(e.second) + num);
+        }
+
+        for(; i < suffix_hist.size(); i++) {
+            const auto& e = suffix_hist.entries[i];
+            old_entries.emplace_back(e.first, 0);
+            new_entries.emplace_back(e.first, e.second);
+            merged.emplace_back(e.first, e.second);
+        }
+
+        m_old = EntryHistogram<sym_t>(std::move(old_entries));
+        m_new = EntryHistogram<sym_t>(std::move(new_entries));
+        m_merged = EntryHistogram<sym_t>(std::move(merged));
+    }
+
+    // whether the codes of the existing symbols are retained
+    inline bool valid() const { return m_valid; }
+
+    inline const Histogram<sym_t>& old_hist() const { return m_old; }
+    inline const Histogram<sym_t>& new_hist() const { return m_new; }
+    inline const Histogram<sym_t>& merged_hist() const { return m_merged; }
+};
+
+// reads intervals of the levels of an existing output, which was written by
+// an unknown number of workers
+//
+// the files of a level are kept open until another level is read. a missing
+// or truncated file is fatal, because it would silently corrupt the merged
+// structure
+class OldLevels {
+private:
+    const MPIContext& m_ctx;
+    std::string m_prefix;
+    std::string (*m_level_extension)(size_t);
+    size_t m_num_workers, m_size_per_worker;
+
+    // the open files of level m_level by rank
+    size_t m_level;
+    std::map<size_t, std::ifstream> m_files;
+
+    inline std::string filename(const size_t rank, const size_t level) const {
+        std::ostringstream ss;
+        ss << m_prefix << std::setw(4) << std::setfill('0')
+            << rank << '.' << m_level_extension(level);
+        return ss.str();
+    }
+
+    void fail(const std::string& what) const {
+        m_ctx.cout() << what << " - the existing output is incomplete"
+            << std::endl;
+        std::abort();
+    }
+
+    std::ifstream& file(const size_t rank, const size_t level) {
+        if(level != m_level) {
+            m_files.clear();
+            m_level = level;
+        }
+
+        auto& in = m_files[rank];
+        if(!in.is_open()) {
+            in.open(filename(rank, level), std::ios::binary);
+            if(!in) fail("failed to open " + filename(rank, level));
+        }
+        return in;
+    }
+
+public:
+    // n is the length of the existing text
+    inline OldLevels(
+        const MPIContext& ctx,
+        const std::string& prefix,
+        std::string (*level_extension)(size_t),
+        const size_t n)
+        : m_ctx(ctx),
+          m_prefix(prefix),
+          m_level_extension(level_extension),
+          m_level(SIZE_MAX) {
+
+        // count the files of the first level
+        m_num_workers = 0;
+        while(util::file_exists(filename(m_num_workers, 0))) {
+            ++m_num_workers;
+        }
+
+        m_size_per_worker = std::max(
+            tlx::div_ceil(n, std::max(m_num_workers, size_t(1))), size_t(1));
+    }
+
+    inline size_t num_workers() const { return m_num_workers; }
+
+    // reads num bits of the given level starting at global offset offs
+    // into dst, starting at dst_offs
+    void read(
+        const size_t level,
+        size_t offs,
+        size_t num,
+        bv_t& dst,
+        size_t dst_offs) {
+
+        while(num > 0) {
+            const size_t rank = offs / m_size_per_worker;
+            const size_t i = offs - rank * m_size_per_worker;
+            const size_t k = std::min(num, m_size_per_worker - i);
+
+            std::ifstream& in = file(rank, level);
+            in.seekg((i / 64ULL) * sizeof(uint64_t));
+
+            auto read_word = [&](uint64_t& word){
+                if(!in.read((char*)&word, sizeof(uint64_t))) {
+                    fail("failed to read " + filename(rank, level));
+                }
+            };
+
+            uint64_t word = 0;
+            read_word(word);
+            for(size_t j = i; j < i + k; j++) {
+                if(j > i && j % 64ULL == 0) read_word(word);
+                dst[dst_offs++] = bool((word >> (63ULL - (j % 64ULL))) & 1);
+            }
+
+            offs += k;
+            num -= k;
+        }
+    }
+};
+
+// an interval of a merged level, which is taken from the existing level,
+// from the level of the suffix or consists of zeros only
+struct merge_segment_t {
+    enum source_t { old_level, new_level, zeros };
+
+    source_t source;
+    size_t offs; // offset in the source level
+    size_t num;
+};
+
+// the segments of a merged level: each node's existing items followed by
+// its new items, where nodes are in natural order for a wavelet tree and in
+// bit-reversed order for a wavelet matrix
+//
+// the existing items are zeros on the first shift levels, by which the
+// existing codes have been extended
+template<typename idx_t>
+std::vector<merge_segment_t> merge_segments(
+    const WaveletTreeBase::NodeSizes<idx_t>& old_sizes,
+    const WaveletTreeBase::NodeSizes<idx_t>& new_sizes,
+    const size_t level,
+    const size_t shift,
+    const bool bit_reversal) {
+
+    const auto src = (level < shift)
+        ? merge_segment_t::zeros : merge_segment_t::old_level;
+
+    const auto old_offs = old_sizes.level_offsets(level, bit_reversal);
+    const auto new_offs = new_sizes.level_offsets(level, bit_reversal);
+
+    const size_t num = old_offs.size();
+    std::vector<size_t> order(num);
+    for(size_t i = 0; i < num; i++) {
+        order[i] = i;
+    }
+    if(bit_reversal) {
+        std::sort(order.begin(), order.end(),
+            [&](const size_t a, const size_t b){
+                return bitrev(a, level) < bitrev(b, level);
+            });
+    }
+
+    const size_t first_level_node = 1ULL << level;
+
+    std::vector<merge_segment_t> segments;
+    segments.reserve(2 * num);
+    for(const size_t i : order) {
+        const size_t v = first_level_node + i;
+        segments.push_back({ src, old_offs[i], old_sizes.size(v) });
+        segments.push_back({ merge_segment_t::new_level,
+            new_offs[i], new_sizes.size(v) });
+    }
+    return segments;
+}
+
+// merges one level of the existing structure and the suffix's structure,
+// whose segments are given in the order of the merged level
+//
+// the local part of the merged level, given by part, is filled by reading
+// the existing level's bits (one contiguous interval) and by receiving the
+// suffix's bits from the workers holding them. new_offs is the global
+// offset of the local part of the suffix's level
+inline void merge_level(
+    MPIContext& ctx,
+    const EvenPartition& part,
+    const std::vector<merge_segment_t>& segments,
+    OldLevels& old_levels,
+    const size_t old_level,
+    std::vector<bv_t>& bits,
+    const size_t level,
+    const bv_t& new_bits,
+    const size_t new_offs) {
+
+    const size_t a = part.local_offset();
+    const size_t b = a + part.local_num();
+    const size_t new_end = new_offs + new_bits.size();
+
+    auto& level_bits = bits[level];
+    level_bits.assign(part.local_num(), false);
+
+    BucketExchange<uint8_t> exchange(ctx, part.size_per_worker());
+
+    // the interval of the existing level needed locally
+    size_t old_lo = SIZE_MAX, old_hi = 0;
+
+    size_t expect = 0;
+    size_t m = 0; // offset in the merged level
+    for(const auto& seg : segments) {
+        // local part of the segment within the merged level
+        const size_t x = std::max(m, a);
+        const size_t y = std::min(m + seg.num, b);
+
+        if(seg.source == merge_segment_t::new_level) {
+            if(x < y) expect += y - x;
+
+            // send the suffix's bits held locally
+            const size_t s = std::max(seg.offs, new_offs);
+            const size_t t = std::min(seg.offs + seg.num, new_end);
+            if(s < t) {
+                #ifdef DBG_APPEND
+                ctx.cout() << "level " << (level+1) << ": send " << (t - s)
+                    << " bits to [" << (m + s - seg.offs) << ","
+                    << (m + t - seg.offs) << ")" << std::endl;
+                #endif
+
+                exchange.add_bits(level, new_bits, s - new_offs,
+                    m + (s - seg.offs), t - s);
+            }
+        } else if(seg.source == merge_segment_t::old_level && x < y) {
+            old_lo = std::min(old_lo, seg.offs + (x - m));
+            old_hi = std::max(old_hi, seg.offs + (y - m));
+        }
+
+        m += seg.num;
+    }
+    exchange.send((int)level);
+
+    // read the needed interval of the existing level
+    bv_t old_bits;
+    if(old_lo < old_hi) {
+        old_bits.resize(old_hi - old_lo);
+        old_levels.read(old_level, old_lo, old_hi - old_lo, old_bits, 0);
+
+        m = 0;
+        for(const auto& seg : segments) {
+            const size_t x = std::max(m, a);
+            const size_t y = std::min(m + seg.num, b);
+            if(seg.source == merge_segment_t::old_level && x < y) {
+                const size_t src = seg.offs + (x - m) - old_lo;
+                for(size_t i = 0; i < y - x; i++) {
+                    level_bits[x - a + i] = old_bits[src + i];
+                }
+            }
+            m += seg.num;
+        }
+    }
+
+    std::vector<uint8_t> no_items;
+    exchange.receive(no_items, 0, a, (int)level, &bits, expect);
+
+    // this synchronization is necessary in order to maintain the
+    // outbox buffer until all messages have been received
+    ctx.synchronize();
+}
@@ -0,0 +1,34 @@
+#include <distwt/mpi/boundary_scan.hpp>
+
+bool mpi_type<boundary_counts_t>::s_init = false;
+MPI_Datatype mpi_type<boundary_counts_t>::s_mpi_type;
+
+void mpi_type<boundary_counts_t>::init_type() {
+    if(!s_init) {
+        MPI_Type_contiguous(3, MPI_UINT64_T, &s_mpi_type);
+        MPI_Type_commit(&s_mpi_type);
+        s_init = true;
+    }
+}
+
+bool mpi_boundary_sum::s_init = false;
+MPI_Op mpi_boundary_sum::s_mpi_op;
+
+void mpi_boundary_sum_fn(void* _a, void* _b, int* len, MPI_Datatype* type) {
+    // b[i] = a[i] + b[i], where a[i] stems from the lower ranks
+    boundary_counts_t* a = (boundary_counts_t*)_a;
+    boundary_counts_t* b = (boundary_counts_t*)_b;
+    for(int i = 0; i < *len; i++) {
+        if(a[i].node == b[i].node) {
+            b[i].num[0] += a[i].num[0];
+            b[i].num[1] += a[i].num[1];
+        }
+    }
+}
+
+void mpi_boundary_sum::init_op() {
+    if(!s_init) {
+        MPI_Op_create(mpi_boundary_sum_fn, 0, &s_mpi_op); // not commutative
+        s_init = true;
+    }
+}
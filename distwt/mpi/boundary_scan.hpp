@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <vector>
+
+#include <mpi.h>
+
+#include <distwt/mpi/context.hpp>
+#include <distwt/mpi/mpi_type.hpp>
+
+// the amount of items a worker holds in the children of the last node of
+// its (sorted) local text
+struct boundary_counts_t {
+    uint64_t node; // UINT64_MAX if the worker holds no items
+    uint64_t num[2];
+};
+
+template<> struct mpi_type<boundary_counts_t> {
+private:
+    static bool s_init;
+    static MPI_Datatype s_mpi_type;
+
+    static void init_type();
+
+public:
+    static MPI_Datatype id() {
+        init_type();
+        return s_mpi_type;
+    }
+};
+
+// segmented sum over boundary counts: counts are summed up only for
+// consecutive workers sharing the same last node
+//
+// this is associative only because the last nodes are non-decreasing in
+// rank order, which holds for text sorted by node
+struct mpi_boundary_sum {
+private:
+    static bool s_init;
+    static MPI_Op s_mpi_op;
+
+    static void init_op();
+
+public:
+    static MPI_Op op() {
+        init_op();
+        return s_mpi_op;
+    }
+};
+
+// given that the text is sorted by the nodes of the current level, computes
+// how many items of the descendants of first_node are held by workers with
+// a lower rank
+//
+// first_node and last_node are the first and last node of the local text,
+// last_num contains the local amount of items in each of the considered
+// descendants of last_node (e.g., its two children) and must have an even
+// size, which is the same on all workers. the result is in the same order
+inline std::vector<size_t> boundary_ex_scan(
+    MPIContext& ctx,
+    const bool empty,
+    const size_t first_node,
+    const size_t last_node,
+    const std::vector<size_t>& last_num) {
+
+    assert(last_num.size() % 2 == 0);
+
+    // pairs of counts are scanned as independent boundary counts that
+    // all refer to the same last node
+    const size_t num_pairs = last_num.size() / 2;
+    std::vector<boundary_counts_t> v(num_pairs);
+    for(size_t i = 0; i < num_pairs; i++) {
+        v[i].node = empty ? UINT64_MAX : last_node;
+        v[i].num[0] = empty ? 0 : last_num[2*i];
+        v[i].num[1] = empty ? 0 : last_num[2*i+1];
+    }
+
+    ctx.ex_scan(v, mpi_boundary_sum::op());
+
+    // note that the result is undefined on the first worker
+    std::vector<size_t> result(last_num.size(), 0);
+    if(ctx.rank() > 0 && !empty && num_pairs > 0 && v[0].node == first_node) {
+        for(size_t i = 0; i < num_pairs; i++) {
+            result[2*i] = v[i].num[0];
+            result[2*i+1] = v[i].num[1];
+        }
+    }
+    return result;
+}
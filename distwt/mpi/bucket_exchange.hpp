@@ -0,0 +1,307 @@
+#pragma once
+
+#include <cassert>
+#include <cstring>
+#include <vector>
+
+#include <distwt/mpi/bit_vector.hpp>
+#include <distwt/mpi/context.hpp>
+#include <distwt/mpi/uint64_pack_bv64.hpp>
+
+//#define DBG_BUCKET_EXCHANGE 1
+
+// redistributes bucket contents to their target workers according to their
+// global offsets (in a layout where each worker holds size_per_worker items)
+//
+// besides items, slices of level bit vectors can be sent along, which are
+// distributed in the same layout. this allows computing several levels in
+// one round
+//
+// all slices going from this worker to the same target are coalesced into a
+// single message, so that exactly one message is sent per (source, target)
+// pair and round. each message starts with an inline directory
+//
+//     [k, offs_1, num_1, ..., offs_k, num_k,
+//      kb, level_1, offs_1, num_1, ..., level_kb, offs_kb, num_kb]
+//
+// of uint64_t values, followed by the k item slices and the kb bit slices,
+// which are packed into uint64_t words each
+template<typename sym_t>
+class BucketExchange {
+private:
+    struct Message {
+        std::vector<uint64_t> directory;
+        std::vector<const void*> blocks;
+        std::vector<size_t> sizes;
+
+        std::vector<uint64_t> bit_directory;
+        std::vector<uint64_t> words; // packed bit slices
+    };
+
+    MPIContext* m_ctx;
+    size_t m_size_per_worker;
+
+    std::vector<Message> m_outbox; // one message per target
+    std::vector<uint8_t> m_inbox;  // receive buffer, only grows
+    std::vector<uint64_t> m_words; // aligned copy of received bit slices
+
+    inline void add_slice(
+        const size_t target,
+        const sym_t* data,
+        const size_t glob_offs,
+        const size_t num) {
+
+        #ifdef DBG_BUCKET_EXCHANGE
+        m_ctx->cout() << "slice [" << glob_offs << ","
+            << glob_offs + num << ") goes to " << target << std::endl;
+        #endif
+
+        auto& msg = m_outbox[target];
+        if(msg.directory.empty()) {
+            msg.directory.push_back(0);
+        }
+
+        ++msg.directory[0];
+        msg.directory.push_back(glob_offs);
+        msg.directory.push_back(num);
+
+        msg.blocks.push_back(data);
+        msg.sizes.push_back(num * sizeof(sym_t));
+    }
+
+    inline void add_bit_slice(
+        const size_t target,
+        const size_t level,
+        const bv_t& bv,
+        const size_t local_offs,
+        const size_t glob_offs,
+        const size_t num) {
+
+        #ifdef DBG_BUCKET_EXCHANGE
+        m_ctx->cout() << "bit slice [" << glob_offs << ","
+            << glob_offs + num << ") of level " << (level+1)
+            << " goes to " << target << std::endl;
+        #endif
+
+        auto& msg = m_outbox[target];
+        if(msg.bit_directory.empty()) {
+            msg.bit_directory.push_back(0);
+        }
+
+        ++msg.bit_directory[0];
+        msg.bit_directory.push_back(level);
+        msg.bit_directory.push_back(glob_offs);
+        msg.bit_directory.push_back(num);
+
+        const size_t w = msg.words.size();
+        msg.words.resize(w + bv64_pack_t::required_bufsize(num));
+        bv64_pack_t::pack(bv, local_offs, msg.words.data() + w, num);
+    }
+
+public:
+    inline BucketExchange(MPIContext& ctx, const size_t size_per_worker)
+        : m_ctx(&ctx),
+          m_size_per_worker(size_per_worker),
+          m_outbox(ctx.num_workers()) {
+    }
+
+    // schedules num items, which are located at the given global offset,
+    // to be sent to their target(s)
+    //
+    // the data must remain valid until clear is called
+    void add(const sym_t* data, const size_t glob_offs, const size_t num) {
+        size_t p = glob_offs;
+        const size_t q = glob_offs + num;
+
+        while(p < q) {
+            const size_t target = p / m_size_per_worker;
+            const size_t x = std::min((target+1) * m_size_per_worker, q);
+
+            add_slice(target, data + (p - glob_offs), p, x - p);
+            p = x;
+        }
+    }
+
+    // schedules the bits [local_offs, local_offs + num) of bv, which belong
+    // to the given level at the given global offset, to be sent to their
+    // target(s)
+    //
+    // the bits are packed immediately, so bv may be discarded afterwards
+    void add_bits(
+        const size_t level,
+        const bv_t& bv,
+        const size_t local_offs,
+        const size_t glob_offs,
+        const size_t num) {
+
+        size_t p = glob_offs;
+        const size_t q = glob_offs + num;
+
+        while(p < q) {
+            const size_t target = p / m_size_per_worker;
+            const size_t x = std::min((target+1) * m_size_per_worker, q);
+
+            add_bit_slice(
+                target, level, bv, local_offs + (p - glob_offs), p, x - p);
+            p = x;
+        }
+    }
+
+    // sends one message to each target that has at least one slice
+    void send(const int tag) {
+        for(size_t target = 0; target < m_outbox.size(); target++) {
+            auto& msg = m_outbox[target];
+            if(msg.directory.empty() && msg.bit_directory.empty()) continue;
+
+            // complete directory and prepend it to blocks
+            if(msg.directory.empty()) msg.directory.push_back(0);
+            if(msg.bit_directory.empty()) msg.bit_directory.push_back(0);
+
+            msg.directory.insert(msg.directory.end(),
+                msg.bit_directory.begin(), msg.bit_directory.end());
+
+            msg.blocks.insert(msg.blocks.begin(), msg.directory.data());
+            msg.sizes.insert(msg.sizes.begin(),
+                msg.directory.size() * sizeof(uint64_t));
+
+            // append packed bit slices
+            if(!msg.words.empty()) {
+                msg.blocks.push_back(msg.words.data());
+                msg.sizes.push_back(msg.words.size() * sizeof(uint64_t));
+            }
+
+            // the request is released right away, otherwise it and its
+            // datatype would be kept by MPI -> the send buffers are only
+            // reused after all messages have been received (see clear)
+            MPI_Request req =
+                m_ctx->isend_blocks(msg.blocks, msg.sizes, target, tag);
+            MPI_Request_free(&req);
+        }
+    }
+
+    // receives messages until num_items items have been written into dst,
+    // which represents the global interval starting at global_offset
+    //
+    // if num_bits is nonzero, messages are received until num_bits bits have
+    // also been written into the level bit vectors in bits, which must
+    // already have the local size
+    void receive(
+        std::vector<sym_t>& dst,
+        const size_t num_items,
+        const size_t global_offset,
+        const int tag,
+        std::vector<bv_t>* bits = nullptr,
+        const size_t num_bits = 0) {
+
+        receive_slices(num_items, tag,
+        [&](const size_t glob_offs, const void* data, const size_t num){
+            assert(glob_offs >= global_offset);
+            assert(glob_offs - global_offset + num <= dst.size());
+
+            std::memcpy(
+                dst.data() + (glob_offs - global_offset),
+                data,
+                num * sizeof(sym_t));
+        }, global_offset, bits, num_bits);
+    }
+
+    // receives messages until num_items items have been received, calling
+    // f(glob_offs, data, num) for each slice instead of copying it into a
+    // local vector
+    //
+    // data points into the receive buffer and is only guaranteed to be
+    // byte-aligned
+    template<typename slice_f>
+    void receive_slices(
+        const size_t num_items,
+        const int tag,
+        slice_f f,
+        const size_t global_offset = 0,
+        std::vector<bv_t>* bits = nullptr,
+        const size_t num_bits = 0) {
+
+        size_t num_received = 0;
+        size_t num_bits_received = 0;
+        while(num_received < num_items || num_bits_received < num_bits) {
+            // probe for message (blocking)
+            auto result = m_ctx->template probe<uint8_t>(tag);
+
+            if(m_inbox.size() < result.size) {
+                // grow to exactly the message size, releasing the old
+                // buffer first so that both are never held at once
+                std::vector<uint8_t>().swap(m_inbox);
+                m_inbox.resize(result.size);
+            }
+            m_ctx->recv(m_inbox.data(), result.size, result.sender, tag);
+
+            // read directory and hand slices to their destinations
+            const uint64_t* directory = (const uint64_t*)m_inbox.data();
+            const size_t k = directory[0];
+
+            const uint64_t* bit_directory = directory + 1 + 2 * k;
+            const size_t kb = bit_directory[0];
+
+            const uint8_t* payload =
+                m_inbox.data() + (2 + 2 * k + 3 * kb) * sizeof(uint64_t);
+
+            for(size_t i = 0; i < k; i++) {
+                const size_t glob_offs = directory[1 + 2 * i];
+                const size_t num = directory[2 + 2 * i];
+
+                #ifdef DBG_BUCKET_EXCHANGE
+                m_ctx->cout() << "receive [" << glob_offs << ","
+                    << glob_offs + num << ") from " << result.sender
+                    << std::endl;
+                #endif
+
+                f(glob_offs, (const void*)payload, num);
+
+                payload += num * sizeof(sym_t);
+                num_received += num;
+            }
+
+            for(size_t i = 0; i < kb; i++) {
+                const size_t level = bit_directory[1 + 3 * i];
+                const size_t glob_offs = bit_directory[2 + 3 * i];
+                const size_t num = bit_directory[3 + 3 * i];
+
+                #ifdef DBG_BUCKET_EXCHANGE
+                m_ctx->cout() << "receive bits [" << glob_offs << ","
+                    << glob_offs + num << ") of level " << (level+1)
+                    << " from " << result.sender << std::endl;
+                #endif
+
+                assert(bits != nullptr && level < bits->size());
+                assert(glob_offs >= global_offset);
+                assert(glob_offs - global_offset + num <=
+                    (*bits)[level].size());
+
+                // the payload is only guaranteed to be byte-aligned
+                const size_t num_words = bv64_pack_t::required_bufsize(num);
+                m_words.resize(num_words);
+                std::memcpy(m_words.data(), payload,
+                    num_words * sizeof(uint64_t));
+
+                bv64_pack_t::unpack(m_words.data(), (*bits)[level],
+                    glob_offs - global_offset, num);
+
+                payload += num_words * sizeof(uint64_t);
+                num_bits_received += num;
+            }
+        }
+        assert(num_received == num_items);
+        assert(num_bits_received == num_bits);
+    }
+
+    // discards all scheduled messages
+    // only call this after all messages have been received!
+    void clear() {
+        for(auto& msg : m_outbox) {
+            msg.directory.clear();
+            msg.blocks.clear();
+            msg.sizes.clear();
+            msg.bit_directory.clear();
+            msg.words.clear();
+        }
+    }
+};
@@ -1,5 +1,13 @@
+#include <algorithm>
 #include <cassert>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
 #include <iomanip>
+
+#include <dirent.h>
+#include <sched.h>
+
 #include <distwt/common/util.hpp>
 #include <distwt/mpi/context.hpp>
 #include <distwt/mpi/malloc.hpp>
@@ -7,29 +15,17 @@
 util::devnull MPIContext::m_devnull;
 MPIContext* MPIContext::m_current = nullptr;
 
-void MPIContext::on_alloc(size_t size) {
-    if(m_current) m_current->track_alloc(size);
-}
-
-void MPIContext::on_free(size_t size) {
-    if(m_current) m_current->track_free(size);
-}
-
 MPIContext::MPIContext(int* argc, char*** argv)
     : m_comm(MPI_COMM_WORLD),
-      m_alloc_current(0),
-      m_alloc_max(0),
-      m_local_traffic({0,0,0,0,0,0}) {
+      m_mapped_comm(MPI_COMM_NULL),
+      m_local_traffic({0,0,0,0,0,0}),
+      m_num_bound_cpus(0),
+      m_numa_node(-1) {
 
     assert(!m_current);
-    {
-        m_current = this;
-        malloc_callback::on_alloc = MPIContext::on_alloc;
-        malloc_callback::on_free = MPIContext::on_free;
-    }
+    m_current = this;
 
     MPI_Init(argc, argv);
-    set_comm(MPI_COMM_WORLD);
 
     // determine workers per node via shared memory group size
     // we expect that this is the same on each node
@@ -38,14 +34,54 @@ MPIContext::MPIContext(int* argc, char*** argv)
         MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, 0,
                             MPI_INFO_NULL, &shmcomm);
 
-        int shmsize;
+        int shmsize, shmrank;
         MPI_Comm_size(shmcomm, &shmsize);
+        MPI_Comm_rank(shmcomm, &shmrank);
 
         m_workers_per_node = (size_t)shmsize;
+        m_node_local_rank = (size_t)shmrank;
+
+        // identify node by the lowest world rank running on it
+        int world_rank, leader;
+        MPI_Comm_rank(MPI_COMM_WORLD, &world_rank);
+        MPI_Allreduce(&world_rank, &leader, 1, MPI_INT, MPI_MIN, shmcomm);
 
         MPI_Comm_free(&shmcomm);
+
+        // gather node leaders of all workers
+        int world_size;
+        MPI_Comm_size(MPI_COMM_WORLD, &world_size);
+
+        std::vector<int> leaders(world_size);
+        MPI_Allgather(&leader, 1, MPI_INT,
+            leaders.data(), 1, MPI_INT, MPI_COMM_WORLD);
+
+        // number nodes consecutively in order of their leaders
+        std::vector<int> sorted_leaders = leaders;
+        std::sort(sorted_leaders.begin(), sorted_leaders.end());
+        sorted_leaders.erase(
+            std::unique(sorted_leaders.begin(), sorted_leaders.end()),
+            sorted_leaders.end());
+
+        m_num_nodes = sorted_leaders.size();
+        m_world_nodes.resize(world_size);
+        for(int i = 0; i < world_size; i++) {
+            m_world_nodes[i] = std::lower_bound(
+                sorted_leaders.begin(), sorted_leaders.end(), leaders[i])
+                - sorted_leaders.begin();
+        }
     }
 
+    // determine largest supported message tag
+    {
+        int* tag_ub;
+        int flag;
+        MPI_Comm_get_attr(MPI_COMM_WORLD, MPI_TAG_UB, &tag_ub, &flag);
+        m_tag_ub = flag ? *tag_ub : 32767; // guaranteed by the standard
+    }
+
+    set_comm(MPI_COMM_WORLD);
+
     // initial synchronization
     MPI_Barrier(MPI_COMM_WORLD);
     m_start_time = time();
@@ -58,10 +94,8 @@ MPIContext::MPIContext(int* argc, char*** argv)
 
 MPIContext::~MPIContext() {
     if(m_current == this) {
+        if(m_mapped_comm != MPI_COMM_NULL) MPI_Comm_free(&m_mapped_comm);
         MPI_Finalize();
-
-        malloc_callback::on_alloc = nullptr;
-        malloc_callback::on_free = nullptr;
         m_current = nullptr;
     }
 }
@@ -94,16 +128,6 @@ void MPIContext::count_traffic_rx_est(size_t source, size_t bytes) {
     }
 }
 
-void MPIContext::track_alloc(size_t size) {
-    m_alloc_current += size;
-    m_alloc_max = std::max(m_alloc_max, m_alloc_current);
-}
-
-void MPIContext::track_free(size_t size) {
-    assert(m_alloc_current >= size);
-    m_alloc_current -= size;
-}
-
 void MPIContext::set_comm(MPI_Comm comm) {
     m_comm = comm;
 
@@ -115,6 +139,125 @@ void MPIContext::set_comm(MPI_Comm comm) {
 
     m_rank = (size_t)irank;
     m_num_workers = (size_t)inum_workers;
+
+    // translate ranks to world ranks to look up compute nodes
+    {
+        MPI_Group group, world_group;
+        MPI_Comm_group(m_comm, &group);
+        MPI_Comm_group(MPI_COMM_WORLD, &world_group);
+
+        std::vector<int> ranks(m_num_workers), world_ranks(m_num_workers);
+        for(size_t i = 0; i < m_num_workers; i++) {
+            ranks[i] = int(i);
+        }
+
+        MPI_Group_translate_ranks(group, inum_workers, ranks.data(),
+            world_group, world_ranks.data());
+
+        m_comm_nodes.resize(m_num_workers);
+        for(size_t i = 0; i < m_num_workers; i++) {
+            m_comm_nodes[i] = m_world_nodes[world_ranks[i]];
+        }
+
+        MPI_Group_free(&group);
+        MPI_Group_free(&world_group);
+    }
+}
+
+std::vector<size_t> MPIContext::topology_node_layout() const {
+    std::vector<size_t> layout = m_world_nodes;
+    std::sort(layout.begin(), layout.end());
+    return layout;
+}
+
+void MPIContext::map_partitions_by_topology() {
+    assert(m_mapped_comm == MPI_COMM_NULL);
+
+    // the new rank is the position in the world ranks stably sorted by node
+    int world_rank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &world_rank);
+
+    const size_t node = m_world_nodes[world_rank];
+    int key = 0;
+    for(size_t i = 0; i < m_world_nodes.size(); i++) {
+        if(m_world_nodes[i] < node ||
+            (m_world_nodes[i] == node && int(i) < world_rank)) {
+
+            ++key;
+        }
+    }
+
+    MPI_Comm_split(MPI_COMM_WORLD, 0, key, &m_mapped_comm);
+    set_comm(m_mapped_comm);
+}
+
+// the NUMA node the given cpu belongs to, or -1 if unknown
+static int numa_node_of_cpu(const int cpu) {
+    const std::string path =
+        "/sys/devices/system/cpu/cpu" + std::to_string(cpu);
+
+    int node = -1;
+    if(DIR* dir = opendir(path.c_str())) {
+        while(dirent* e = readdir(dir)) {
+            if(std::strncmp(e->d_name, "node", 4) == 0 &&
+                e->d_name[4] >= '0' && e->d_name[4] <= '9') {
+
+                node = std::atoi(e->d_name + 4);
+                break;
+            }
+        }
+        closedir(dir);
+    }
+    return node;
+}
+
+void MPIContext::bind_to_cores() {
+    cpu_set_t avail;
+    CPU_ZERO(&avail);
+    sched_getaffinity(0, sizeof(cpu_set_t), &avail);
+
+    std::vector<int> cpus;
+    for(int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if(CPU_ISSET(cpu, &avail)) cpus.push_back(cpu);
+    }
+
+    if(cpus.size() >= m_workers_per_node) {
+        // split the available cores into contiguous blocks, which keeps
+        // the cores of a block on the same socket if possible
+        const size_t n = cpus.size();
+        const size_t k = m_workers_per_node;
+        const size_t first = (m_node_local_rank * n) / k;
+        const size_t last = ((m_node_local_rank + 1) * n) / k;
+
+        cpu_set_t bind;
+        CPU_ZERO(&bind);
+        for(size_t i = first; i < last; i++) {
+            CPU_SET(cpus[i], &bind);
+        }
+
+        if(sched_setaffinity(0, sizeof(cpu_set_t), &bind) == 0) {
+            cpus.assign(cpus.begin() + first, cpus.begin() + last);
+        }
+    }
+
+    m_num_bound_cpus = cpus.size();
+    m_numa_node = cpus.empty() ? -1 : numa_node_of_cpu(cpus.front());
+}
+
+void MPIContext::use_huge_pages() {
+    malloc_huge_pages::threshold = malloc_huge_pages::page_size;
+}
+
+std::string MPIContext::thp_mode() {
+    // the active mode is the one in brackets
+    std::ifstream f("/sys/kernel/mm/transparent_hugepage/enabled");
+    std::string mode;
+    while(f >> mode) {
+        if(mode.size() > 2 && mode.front() == '[' && mode.back() == ']') {
+            return mode.substr(1, mode.size() - 2);
+        }
+    }
+    return "unknown";
 }
 
 std::ostream& MPIContext::cout() const {
@@ -128,13 +271,59 @@ std::ostream& MPIContext::cout(bool b) const {
     return b ? cout() : m_devnull;
 }
 
+MPI_Request MPIContext::isend_blocks(
+    const std::vector<const void*>& blocks,
+    const std::vector<size_t>& sizes,
+    size_t target,
+    int tag) {
+
+    assert(blocks.size() == sizes.size());
+    assert(tag >= 0 && tag <= m_tag_ub);
+    const size_t num_blocks = blocks.size();
+
+    // describe blocks by their absolute addresses
+    // blocks larger than mpi_count_max bytes are described piecewise
+    std::vector<int> lengths;
+    std::vector<MPI_Aint> displs;
+    lengths.reserve(num_blocks);
+    displs.reserve(num_blocks);
+
+    size_t total = 0;
+    for(size_t i = 0; i < num_blocks; i++) {
+        MPI_Aint addr;
+        MPI_Get_address(blocks[i], &addr);
+
+        for(size_t offs = 0; offs < sizes[i]; offs += mpi_count_max) {
+            lengths.push_back(int(std::min(sizes[i] - offs, mpi_count_max)));
+            displs.push_back(addr + MPI_Aint(offs));
+        }
+        total += sizes[i];
+    }
+
+    MPI_Datatype type;
+    MPI_Type_create_hindexed(
+        int(lengths.size()), lengths.data(), displs.data(), MPI_BYTE, &type);
+    MPI_Type_commit(&type);
+
+    MPI_Request req;
+    MPI_Isend(MPI_BOTTOM, 1, type, target, tag, m_comm, &req);
+    count_traffic_tx(target, total);
+
+    // the type is only marked for deallocation and remains valid
+    // until the send has completed
+    MPI_Type_free(&type);
+    return req;
+}
+
 void MPIContext::synchronize() {
     MPI_Barrier(m_comm);
 }
 
 size_t MPIContext::gather_max_alloc() const {
+    const size_t local = malloc_stats::peak();
+
     size_t glob;
-    MPI_Allreduce(&m_alloc_max, &glob, 1,
+    MPI_Allreduce(&local, &glob, 1,
         MPI_LONG_LONG, MPI_SUM, MPI_COMM_WORLD);
 
     return glob;
@@ -1,6 +1,9 @@
 #pragma once
 
+#include <algorithm>
+#include <cassert>
 #include <iostream>
+#include <string>
 #include <vector>
 
 #include <tlx/math/integer_log2.hpp>
@@ -10,6 +13,9 @@
 #include <distwt/common/devnull.hpp>
 #include <distwt/common/util.hpp>
 
+#include <distwt/mpi/malloc.hpp>
+#include <distwt/mpi/message_pool.hpp>
+#include <distwt/mpi/mpi_count.hpp>
 #include <distwt/mpi/mpi_sum.hpp>
 #include <distwt/mpi/mpi_type.hpp>
 
@@ -20,8 +26,6 @@ private:
 
 public:
     static inline MPIContext* current() { return m_current; }
-    static void on_alloc(size_t size);
-    static void on_free(size_t size);
 
 public:
     struct ProbeResult {
@@ -37,13 +41,23 @@ public:
 
 private:
     MPI_Comm m_comm;
+    MPI_Comm m_mapped_comm;
 
     size_t m_num_workers, m_rank;
-    size_t m_workers_per_node;
+    int m_tag_ub;
+    size_t m_num_nodes, m_workers_per_node;
+    size_t m_node_local_rank; // rank among the workers on the same node
     double m_start_time;
 
+    std::vector<size_t> m_world_nodes; // compute node of each world rank
+    std::vector<size_t> m_comm_nodes;  // compute node of each rank in m_comm
+
     Traffic m_local_traffic;
-    size_t m_alloc_current, m_alloc_max;
+
+    size_t m_num_bound_cpus; // zero if not bound by bind_to_cores
+    int m_numa_node;         // NUMA node of the bound cores, -1 if unknown
+
+    MessagePool m_message_pool;
 
     void count_traffic_tx(size_t target, size_t bytes);
     void count_traffic_rx(size_t source, size_t bytes);
@@ -51,8 +65,6 @@ private:
     void count_traffic_tx_est(size_t target, size_t bytes);
     void count_traffic_rx_est(size_t source, size_t bytes);
 
-    void track_alloc(size_t size);
-    void track_free(size_t size);
 
 public:
     MPIContext(int* argc, char*** argv);
@@ -64,27 +76,71 @@ public:
     inline size_t rank() const { return m_rank; }
 
     inline size_t num_nodes() const {
-        return m_num_workers / m_workers_per_node;
+        return m_num_nodes;
     }
 
     inline size_t num_workers_per_node() const {
         return m_workers_per_node;
     }
 
-    inline size_t node_rank(size_t worker) {
-        return worker / m_workers_per_node;
+    // the compute node that the given worker of the current communicator
+    // is running on, as determined by the shared memory layout
+    inline size_t node_rank(size_t worker) const {
+        return m_comm_nodes[worker];
     }
 
-    inline size_t node_rank() {
-        node_rank(m_rank);
+    inline size_t node_rank() const {
+        return node_rank(m_rank);
     }
 
-    inline bool same_node_as(size_t other) {
+    inline bool same_node_as(size_t other) const {
         return node_rank() == node_rank(other);
     }
 
+    // the compute node of each worker, indexed by rank in the current
+    // communicator
+    inline const std::vector<size_t>& node_layout() const {
+        return m_comm_nodes;
+    }
+
+    // the node layout that map_partitions_by_topology would result in
+    std::vector<size_t> topology_node_layout() const;
+
+    // switches to a communicator in which the workers are ordered by the
+    // compute node they are running on
+    //
+    // since text partitions are assigned by rank, this places neighboring
+    // partitions on the same node, even if the job scheduler placed the
+    // ranks in a non-contiguous manner. it does not change anything if
+    // ranks are already grouped by node.
+    //
+    // must be called before any input is read
+    void map_partitions_by_topology();
+
+    // binds this worker to an even share of the cores available on its
+    // compute node, determined by its rank among the workers on the node,
+    // so that the memory it touches first is placed on the local NUMA node
+    //
+    // if the workers are already bound to fewer cores than there are
+    // workers on the node (e.g., by the MPI launcher), that binding is kept
+    void bind_to_cores();
+
+    inline size_t num_bound_cpus() const { return m_num_bound_cpus; }
+    inline int numa_node() const { return m_numa_node; }
+
+    // advises the kernel to back all allocations of at least one huge page
+    // by transparent huge pages, which reduces TLB misses for random
+    // accesses into large buffers
+    void use_huge_pages();
+
+    // the system's transparent huge page mode (always, madvise or never)
+    static std::string thp_mode();
+
     inline bool is_master() const { return m_rank == 0; }
 
+    // the largest message tag supported by the MPI implementation
+    inline int tag_ub() const { return m_tag_ub; }
+
     inline MPI_Comm comm() const { return m_comm; }
     void set_comm(MPI_Comm comm);
 
@@ -95,15 +151,31 @@ public:
         return cout(is_master());
     }
 
-    inline size_t local_alloc_current() const { return m_alloc_current; }
-    inline size_t local_alloc_max() const { return m_alloc_max; }
+    // buffers for point-to-point messages that are recycled across rounds
+    inline MessagePool& message_pool() { return m_message_pool; }
+
+    inline size_t local_alloc_current() const {
+        return malloc_stats::current();
+    }
+
+    inline size_t local_alloc_max() const { return malloc_stats::peak(); }
 
     Traffic gather_traffic() const;
     size_t gather_max_alloc() const;
 
+    // note on large counts: point-to-point transfers use the MPI-4
+    // large-count interface if available, or a derived datatype otherwise, so
+    // that they are always received as a single message
+
     template<typename T>
     void send(const T *buf, size_t num, size_t target, int tag = 0) {
-        MPI_Send(buf, num, mpi_type<T>::id(), target, tag, m_comm);
+        assert(tag >= 0 && tag <= m_tag_ub);
+        #if MPI_VERSION >= 4
+        MPI_Send_c(buf, MPI_Count(num), mpi_type<T>::id(), target, tag, m_comm);
+        #else
+        mpi_count c(mpi_type<T>::id(), num);
+        MPI_Send(buf, c.count(), c.type(), target, tag, m_comm);
+        #endif
         count_traffic_tx(target, num * sizeof(T));
     }
 
@@ -115,22 +187,34 @@ public:
     template<typename T>
     MPI_Status recv(T* buf, size_t num, size_t source, int tag = 0) {
         MPI_Status st;
-        MPI_Recv(buf, num, mpi_type<T>::id(), source, tag, m_comm, &st);
+        #if MPI_VERSION >= 4
+        MPI_Recv_c(buf, MPI_Count(num), mpi_type<T>::id(),
+            source, tag, m_comm, &st);
+        #else
+        mpi_count c(mpi_type<T>::id(), num);
+        MPI_Recv(buf, c.count(), c.type(), source, tag, m_comm, &st);
+        #endif
         count_traffic_rx(source, num * sizeof(T));
         return st;
     }
 
     template<typename T>
     inline MPI_Status recv(std::vector<T>& v, size_t num, size_t source, int tag = 0) {
-        v.resize(num);
-        v.shrink_to_fit();
+        v.resize(num); // keeps the capacity for the next message
         return recv(v.data(), num, source, tag);
     }
 
     template<typename T>
     MPI_Request isend(const T *buf, size_t num, size_t target, int tag = 0) {
+        assert(tag >= 0 && tag <= m_tag_ub);
         MPI_Request req;
-        MPI_Isend(buf, num, mpi_type<T>::id(), target, tag, m_comm, &req);
+        #if MPI_VERSION >= 4
+        MPI_Isend_c(buf, MPI_Count(num), mpi_type<T>::id(),
+            target, tag, m_comm, &req);
+        #else
+        mpi_count c(mpi_type<T>::id(), num);
+        MPI_Isend(buf, c.count(), c.type(), target, tag, m_comm, &req);
+        #endif
         count_traffic_tx(target, num * sizeof(T));
         return req;
     }
@@ -140,15 +224,43 @@ public:
         isend(v.data(), v.size(), target, tag);
     }
 
+    // sends a single message composed of the given memory blocks
+    // (addresses and sizes in bytes) without copying them into a contiguous
+    // buffer first
+    MPI_Request isend_blocks(
+        const std::vector<const void*>& blocks,
+        const std::vector<size_t>& sizes,
+        size_t target,
+        int tag = 0);
+
     template<typename T>
     ProbeResult probe(size_t source = MPI_ANY_SOURCE, int tag = 0) {
         MPI_Status st;
         MPI_Probe(source, tag, m_comm, &st);
 
-        int size;
-        MPI_Get_count(&st, mpi_type<T>::id(), &size);
+        size_t size;
+        #if MPI_VERSION >= 4
+        {
+            MPI_Count count;
+            MPI_Get_count_c(&st, mpi_type<T>::id(), &count);
+            size = (size_t)count;
+        }
+        #else
+        {
+            int count;
+            MPI_Get_count(&st, mpi_type<T>::id(), &count);
+            if(count != MPI_UNDEFINED) {
+                size = (size_t)count;
+            } else {
+                // the count does not fit into an int, retrieve byte size
+                MPI_Count bytes;
+                MPI_Get_elements_x(&st, MPI_BYTE, &bytes);
+                size = (size_t)bytes / sizeof(T);
+            }
+        }
+        #endif
 
-        return ProbeResult{ true, (size_t)size, (size_t)st.MPI_SOURCE };
+        return ProbeResult{ true, size, (size_t)st.MPI_SOURCE };
     }
 
     template<typename T>
@@ -188,21 +300,38 @@ private:
         }
     }
 
+    // calls f(offs, num) for consecutive chunks of at most mpi_count_max
+    // items covering [0, total) - used to split up collective operations,
+    // which cannot use derived datatypes with predefined reduction ops
+    //
+    // f is called at least once, even if total is zero
+    template<typename chunk_f>
+    static inline void for_each_chunk(const size_t total, chunk_f f) {
+        size_t offs = 0;
+        do {
+            const size_t num = std::min(total - offs, mpi_count_max);
+            f(offs, num);
+            offs += num;
+        } while(offs < total);
+    }
+
 public:
     template<typename T>
     inline void all_reduce(
         const T* sbuf, T* rbuf, size_t num, MPI_Op op) {
 
-        MPI_Allreduce(sbuf, rbuf, num, mpi_type<T>::id(), op, m_comm);
-        simulate_allreduce_traffic(sizeof(int) + num * sizeof(T));
+        for_each_chunk(num, [&](const size_t offs, const size_t k){
+            MPI_Allreduce(sbuf + offs, rbuf + offs, int(k),
+                mpi_type<T>::id(), op, m_comm);
+            simulate_allreduce_traffic(sizeof(int) + k * sizeof(T));
+        });
     }
 
     template<typename T>
     inline void all_reduce(
         const T* sbuf, T* rbuf, size_t num) {
 
-        MPI_Allreduce(sbuf, rbuf, num, mpi_type<T>::id(), mpi_sum<T>::op(), m_comm);
-        simulate_allreduce_traffic(sizeof(int) + num * sizeof(T));
+        all_reduce(sbuf, rbuf, num, mpi_sum<T>::op());
     }
 
     template<typename T>
@@ -252,19 +381,97 @@ public:
     template<typename T>
     inline void scan(std::vector<T>& v) {
         std::vector<T> rbuf(v.size());
-        MPI_Scan(v.data(), rbuf.data(), v.size(),
-            mpi_type<T>::id(), mpi_sum<T>::op(), m_comm);
+        for_each_chunk(v.size(), [&](const size_t offs, const size_t k){
+            MPI_Scan(v.data() + offs, rbuf.data() + offs, int(k),
+                mpi_type<T>::id(), mpi_sum<T>::op(), m_comm);
+            simulate_scan_traffic(sizeof(int) + k * sizeof(T));
+        });
         v = rbuf;
-        simulate_scan_traffic(sizeof(int) + v.size() * sizeof(T));
     }
 
     template<typename T>
-    inline void ex_scan(std::vector<T>& v) {
+    inline void ex_scan(std::vector<T>& v, MPI_Op op) {
         std::vector<T> rbuf(v.size());
-        MPI_Exscan(v.data(), rbuf.data(), v.size(),
-            mpi_type<T>::id(), mpi_sum<T>::op(), m_comm);
+        for_each_chunk(v.size(), [&](const size_t offs, const size_t k){
+            MPI_Exscan(v.data() + offs, rbuf.data() + offs, int(k),
+                mpi_type<T>::id(), op, m_comm);
+            simulate_scan_traffic(sizeof(int) + k * sizeof(T));
+        });
         v = rbuf;
-        simulate_scan_traffic(sizeof(int) + v.size() * sizeof(T));
+    }
+
+    template<typename T>
+    inline void ex_scan(std::vector<T>& v) {
+        ex_scan(v, mpi_sum<T>::op());
+    }
+
+    // personalized all-to-all exchange: send[i] is sent to worker i and the
+    // returned vector contains the data received from each worker
+    //
+    // this is meant for small amounts of data such as counts, since all data
+    // is copied twice and, before MPI 4, the total must fit into an int. bulk
+    // data is sent point-to-point instead (see isend and BucketExchange)
+    template<typename T>
+    std::vector<std::vector<T>> all_to_all(
+        const std::vector<std::vector<T>>& send) {
+
+        assert(send.size() == m_num_workers);
+
+        #if MPI_VERSION >= 4
+        using count_t = MPI_Count;
+        #else
+        using count_t = int;
+        #endif
+
+        // exchange counts
+        std::vector<count_t> send_counts(m_num_workers);
+        std::vector<count_t> recv_counts(m_num_workers);
+        for(size_t i = 0; i < m_num_workers; i++) {
+            assert(MPI_VERSION >= 4 || send[i].size() <= mpi_count_max);
+            send_counts[i] = count_t(send[i].size());
+        }
+
+        MPI_Alltoall(
+            send_counts.data(), sizeof(count_t), MPI_BYTE,
+            recv_counts.data(), sizeof(count_t), MPI_BYTE, m_comm);
+
+        // flatten send buffer
+        std::vector<count_t> send_displs(m_num_workers);
+        std::vector<count_t> recv_displs(m_num_workers);
+        std::vector<T> sbuf;
+        size_t recv_total = 0;
+        for(size_t i = 0; i < m_num_workers; i++) {
+            send_displs[i] = count_t(sbuf.size());
+            sbuf.insert(sbuf.end(), send[i].begin(), send[i].end());
+
+            assert(MPI_VERSION >= 4 || recv_total <= mpi_count_max);
+            recv_displs[i] = count_t(recv_total);
+            recv_total += size_t(recv_counts[i]);
+        }
+
+        std::vector<T> rbuf(recv_total);
+
+        #if MPI_VERSION >= 4
+        MPI_Alltoallv_c(
+        #else
+        MPI_Alltoallv(
+        #endif
+            sbuf.data(), send_counts.data(), send_displs.data(),
+            mpi_type<T>::id(),
+            rbuf.data(), recv_counts.data(), recv_displs.data(),
+            mpi_type<T>::id(), m_comm);
+
+        // unflatten receive buffer and count traffic
+        std::vector<std::vector<T>> recv(m_num_workers);
+        for(size_t i = 0; i < m_num_workers; i++) {
+            auto first = rbuf.begin() + recv_displs[i];
+            recv[i].assign(first, first + recv_counts[i]);
+
+            if(i == m_rank) continue;
+            count_traffic_tx(i, sizeof(count_t) + send[i].size() * sizeof(T));
+            count_traffic_rx(i, sizeof(count_t) + recv[i].size() * sizeof(T));
+        }
+        return recv;
     }
 
     void synchronize();
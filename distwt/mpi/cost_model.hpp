@@ -0,0 +1,569 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <tlx/math/div_ceil.hpp>
+#include <tlx/math/integer_log2.hpp>
+
+#include <distwt/common/histogram.hpp>
+#include <distwt/common/wt.hpp>
+
+#include <distwt/mpi/alphabet_split.hpp>
+#include <distwt/mpi/bit_vector.hpp>
+#include <distwt/mpi/level_rounds.hpp>
+#include <distwt/mpi/topology.hpp>
+
+// rough machine parameters used to convert predicted volumes into times
+constexpr double cost_inter_node_bandwidth = 1e9; // bytes/s per compute node
+constexpr double cost_intra_node_bandwidth = 4e9; // bytes/s per worker
+constexpr double cost_symbol_throughput = 2e8;    // symbols/s per worker
+constexpr double cost_message_latency = 5e-6;     // s per message
+
+// predicted costs of a construction algorithm
+struct CostPrediction {
+    std::string algo;
+    size_t memory;                         // peak memory per worker (bytes)
+    TrafficPrediction traffic;             // total traffic
+    std::vector<TrafficPrediction> levels; // traffic caused by each level
+    double imbalance; // maximum local work relative to the average
+    double time;      // predicted running time (in seconds)
+};
+
+// size of a message carrying a slice of a level bit vector when merging
+// node-based wavelet trees (two header words plus the packed bits)
+inline size_t predict_merge_message_size(const size_t num_bits) {
+    return (tlx::div_ceil(num_bits, 64ULL) + 2ULL) * sizeof(uint64_t);
+}
+
+// predicts the traffic of each redistribution round of mpi-wm-concat
+//
+// a round resolves levels_per_round levels: the text is stably sorted into
+// the buckets of the level that many levels below and sent to the global
+// positions of its items, and the bits of the levels in between are sorted
+// into the buckets of their own level and sent along. the last round only
+// sends bits. each bucket is assumed to hold a proportional share of every
+// worker's partition. all slices a source sends to the same target in a
+// round form one message, and a round's traffic is accounted on its first
+// level
+template<typename sym_t, typename idx_t>
+std::vector<TrafficPrediction> predict_wm_concat_level_traffic(
+    const HistogramBase<sym_t, idx_t>& hist,
+    const std::vector<size_t>& node_layout,
+    const size_t levels_per_round = 1) {
+
+    const size_t n = hist.text_length();
+    const size_t p = node_layout.size();
+
+    const WaveletTreeBase wt(hist);
+    const size_t h = wt.height();
+    std::vector<TrafficPrediction> prediction(h, { 0, 0, 0 });
+    if(n == 0 || p == 0) return prediction;
+
+    const size_t size_per_worker = tlx::div_ceil(n, p);
+    const size_t tau = std::max(levels_per_round, size_t(1));
+
+    for(size_t level = 0; level < h; level += tau) {
+        const size_t num_levels = std::min(tau, h - level);
+        const bool last = (level + num_levels == h);
+        const size_t rsh = h - 1 - level;
+        auto& lv = prediction[level];
+
+        // the (source, target) pairs of the round's coalesced messages
+        std::vector<std::pair<size_t, size_t>> pairs;
+
+        // sends each source's share of the buckets of the level j levels
+        // below, whose items take item_bits bits, with a header per slice
+        auto send_buckets = [&](
+            const size_t j,
+            const size_t item_bits,
+            const size_t header) {
+
+            // the bucket of a symbol is given by the bits of the levels in
+            // between, the bit of the latest level being the most
+            // significant (symbol i of the effective alphabet is the
+            // histogram's i-th entry)
+            std::vector<size_t> bucket_size(1ULL << j, 0);
+            for(size_t i = 0; i < hist.size(); i++) {
+                const size_t bits = (i >> (rsh + 1 - j)) & ((1ULL << j) - 1);
+                bucket_size[bitrev(bits, j)] += hist.entries[i].second;
+            }
+
+            size_t bucket_offs = 0;
+            for(const size_t size : bucket_size) {
+                const long double f = (long double)size / n;
+                for(size_t source = 0; source < p; source++) {
+                    const size_t a = std::min(source * size_per_worker, n);
+                    const size_t b = std::min(a + size_per_worker, n);
+
+                    auto send = [&](
+                        const size_t target, const size_t x, const size_t y){
+
+                        predict_message(lv, node_layout, source, target,
+                            header + tlx::div_ceil(
+                                (y - x) * item_bits, size_t(8)), 0);
+                        pairs.emplace_back(source, target);
+                    };
+
+                    for_each_target(size_per_worker,
+                        bucket_offs + size_t(f * a),
+                        bucket_offs + size_t(f * b), send);
+                }
+                bucket_offs += size;
+            }
+        };
+
+        // the bit slices of the intermediate levels (level, offset and
+        // size in the directory) and the text slices (offset and size)
+        for(size_t j = 1; j < num_levels; j++) {
+            send_buckets(j, 1, 3 * sizeof(uint64_t));
+        }
+        if(!last) {
+            send_buckets(num_levels, 8 * sizeof(sym_t), 2 * sizeof(uint64_t));
+        }
+
+        std::sort(pairs.begin(), pairs.end());
+        lv.messages += std::distance(
+            pairs.begin(), std::unique(pairs.begin(), pairs.end()));
+    }
+
+    return prediction;
+}
+
+// accounts the merge of a node's bits into the level bit vectors, where
+// source holds the node's bits [offs, offs + num)
+//
+// level_offs[l] are the global offsets of the nodes of level l as computed
+// by NodeSizes::level_offsets
+inline void predict_merge_piece(
+    std::vector<TrafficPrediction>& prediction,
+    const std::vector<std::vector<size_t>>& level_offs,
+    const std::vector<size_t>& node_layout,
+    const size_t size_per_worker,
+    const size_t node_id,
+    const size_t source,
+    const size_t offs,
+    const size_t num) {
+
+    const size_t level = tlx::integer_log2_floor(node_id);
+    if(level == 0 || num == 0) return; // the root level stays in place
+
+    const size_t glob = level_offs[level][node_id - (1ULL << level)] + offs;
+    for_each_target(size_per_worker, glob, glob + num,
+        [&](const size_t target, const size_t x, const size_t y){
+            predict_message(prediction[level], node_layout, source, target,
+                predict_merge_message_size(y - x));
+        });
+}
+
+// predicts the traffic of each level when merging the node-based wavelet
+// trees of mpi-dd, or the local wavelet matrices of mpi-wm-dd if
+// bit_reversal is set, whose slices are coalesced into one message per
+// (source, target) pair and level
+//
+// every worker is assumed to hold a share of each node proportional to
+// its partition, so a node of size s is spread evenly over min(s, p)
+// workers
+template<typename sym_t, typename idx_t>
+std::vector<TrafficPrediction> predict_dd_level_traffic(
+    const HistogramBase<sym_t, idx_t>& hist,
+    const std::vector<size_t>& node_layout,
+    const bool bit_reversal) {
+
+    const size_t n = hist.text_length();
+    const size_t p = node_layout.size();
+
+    const WaveletTreeBase wt(hist);
+    const size_t h = wt.height();
+    std::vector<TrafficPrediction> prediction(h, { 0, 0, 0 });
+    if(n == 0 || p == 0) return prediction;
+
+    const size_t size_per_worker = tlx::div_ceil(n, p);
+    const auto node_sizes = WaveletTreeBase::node_sizes(hist);
+
+    std::vector<std::vector<size_t>> level_offs(h);
+    for(size_t level = 1; level < h; level++) {
+        level_offs[level] = node_sizes.level_offsets(level, bit_reversal);
+
+        // the (source, target) pairs of the level's coalesced messages
+        std::vector<std::pair<size_t, size_t>> pairs;
+
+        for(auto it = node_sizes.level_nodes(level); it.valid(); it.next()) {
+            const size_t s = it.size();
+            const size_t q = std::min(s, p);
+            for(size_t i = 0; i < q; i++) {
+                const size_t x = s * i / q;
+                const size_t y = s * (i+1) / q;
+                const size_t source = i * p / q;
+
+                if(!bit_reversal) {
+                    predict_merge_piece(prediction, level_offs, node_layout,
+                        size_per_worker, it.node_id(), source, x, y - x);
+                    continue;
+                }
+
+                const size_t glob = level_offs[level][
+                    it.node_id() - (1ULL << level)] + x;
+                for_each_target(size_per_worker, glob, glob + (y - x),
+                    [&](const size_t target, const size_t a, const size_t b){
+                        predict_message(prediction[level], node_layout,
+                            source, target,
+                            predict_merge_message_size(b - a), 0);
+                        pairs.emplace_back(source, target);
+                    });
+            }
+        }
+
+        if(bit_reversal) {
+            std::sort(pairs.begin(), pairs.end());
+            prediction[level].messages += std::distance(
+                pairs.begin(), std::unique(pairs.begin(), pairs.end()));
+        }
+    }
+
+    return prediction;
+}
+
+// predicts the traffic of each level of mpi-dsplit and mpi-wm-dsplit by
+// replaying the recursive distributed splits on the histogram
+//
+// the traffic of a level consists of the split of its nodes and the merge
+// of its bits into the level bit vector. the redistribution of sequential
+// subtrees between workers is not accounted for
+//
+// returns the maximum number of symbols held by any worker
+template<typename sym_t, typename idx_t>
+size_t predict_dsplit_level_traffic(
+    const HistogramBase<sym_t, idx_t>& hist,
+    const std::vector<size_t>& node_layout,
+    const bool bit_reversal,
+    std::vector<TrafficPrediction>& prediction) {
+
+    const size_t n = hist.text_length();
+    const size_t p = node_layout.size();
+
+    const WaveletTreeBase wt(hist);
+    const size_t h = wt.height();
+    prediction.assign(h, { 0, 0, 0 });
+    if(n == 0 || p == 0 || h == 0) return 0;
+
+    const size_t size_per_worker = tlx::div_ceil(n, p);
+    const auto node_sizes = WaveletTreeBase::node_sizes(hist);
+
+    std::vector<std::vector<size_t>> level_offs(h);
+    for(size_t level = 1; level < h; level++) {
+        level_offs[level] = node_sizes.level_offsets(level, bit_reversal);
+    }
+
+    auto merge = [&](const size_t node_id, const size_t source,
+        const size_t offs, const size_t num) {
+
+        predict_merge_piece(prediction, level_offs, node_layout,
+            size_per_worker, node_id, source, offs, num);
+    };
+
+    size_t max_local_num = size_per_worker;
+
+    // the group of workers [base, base + g) processes the given node, whose
+    // symbols are distributed such that each worker holds per of them
+    std::function<void(size_t, size_t, size_t, size_t)> process;
+    process = [&](
+        const size_t node_id,
+        const size_t base,
+        const size_t g,
+        const size_t per) {
+
+        const size_t num = node_sizes.size(node_id);
+        if(num == 0) return;
+
+        const size_t level = tlx::integer_log2_floor(node_id);
+        if(g == 1) {
+            // sequential subtree
+            for(size_t l = level; l < h; l++) {
+                const size_t first = node_id << (l - level);
+                const size_t last = first + (1ULL << (l - level));
+                for(size_t v = first; v < last; v++) {
+                    merge(v, base, 0, node_sizes.size(v));
+                }
+            }
+            return;
+        }
+
+        for(size_t t = 0; t < g; t++) {
+            const size_t x = std::min(t * per, num);
+            merge(node_id, base + t, x, std::min(x + per, num) - x);
+        }
+
+        // no split is needed if the children are leaves
+        if(level + 2 > h) return;
+
+        // split as in dsplit_str
+        const size_t num0 = node_sizes.size(2 * node_id);
+        const size_t num1 = num - num0;
+        const size_t ceil0 = std::ceil(double(num0) / double(num) * g);
+        const size_t targets0 = (num1 > 0) ? std::min(ceil0, g-1) : ceil0;
+        const size_t targets1 = g - targets0;
+
+        const std::array<size_t, 2> num_per_target = {
+            targets0 == 0 ? 0 : tlx::div_ceil(num0, targets0),
+            targets1 == 0 ? 0 : tlx::div_ceil(num1, targets1)
+        };
+        const std::array<size_t, 2> first_target = { base, base + targets0 };
+        const std::array<size_t, 2> part_size = { num0, num1 };
+
+        for(size_t t = 0; t < g; t++) {
+            const size_t a = std::min(t * per, num);
+            const size_t b = std::min(a + per, num);
+
+            for(size_t k = 0; k < 2; k++) {
+                if(part_size[k] == 0) continue;
+
+                const long double f = (long double)part_size[k] / num;
+                for_each_target(num_per_target[k], size_t(f * a), size_t(f * b),
+                    [&](const size_t target, const size_t x, const size_t y){
+                        // header and data
+                        predict_message(prediction[level], node_layout,
+                            base + t, first_target[k] + target,
+                            2 * sizeof(uint64_t) + (y - x) * sizeof(sym_t), 2);
+                    });
+            }
+        }
+
+        max_local_num = std::max(max_local_num,
+            std::max(num_per_target[0], num_per_target[1]));
+
+        process(2 * node_id, base, targets0, num_per_target[0]);
+        process(2 * node_id + 1, base + targets0, targets1, num_per_target[1]);
+    };
+
+    process(1, 0, p, size_per_worker);
+    return max_local_num;
+}
+
+// predicts the traffic of each level of mpi-ad
+//
+// the routing of the text to the range owners is accounted on the split
+// level. the bits of all levels are sent in one round, whose messages are
+// accounted on the first level
+//
+// returns the maximum number of symbols assigned to any worker
+template<typename sym_t, typename idx_t>
+size_t predict_ad_level_traffic(
+    const HistogramBase<sym_t, idx_t>& hist,
+    const std::vector<size_t>& node_layout,
+    std::vector<TrafficPrediction>& prediction) {
+
+    const size_t n = hist.text_length();
+    const size_t p = node_layout.size();
+
+    const WaveletTreeBase wt(hist);
+    const size_t h = wt.height();
+    prediction.assign(h, { 0, 0, 0 });
+    if(n == 0 || p == 0 || h == 0) return 0;
+
+    const size_t size_per_worker = tlx::div_ceil(n, p);
+    const auto node_sizes = WaveletTreeBase::node_sizes(hist);
+    const AlphabetSplit<idx_t> split(node_sizes, h, size_per_worker, p);
+    const size_t split_level = split.level();
+
+    // the (source, target) pairs of the coalesced bit messages
+    std::vector<std::pair<size_t, size_t>> pairs;
+
+    auto send_bits = [&](const size_t level, const size_t source,
+        const size_t glob, const size_t num) {
+
+        for_each_target(size_per_worker, glob, glob + num,
+            [&](const size_t target, const size_t a, const size_t b){
+                predict_message(prediction[level], node_layout,
+                    source, target, predict_merge_message_size(b - a), 0);
+                pairs.emplace_back(source, target);
+            });
+    };
+
+    // levels above the split level, whose nodes are spread evenly over
+    // min(s, p) workers as in predict_dd_level_traffic
+    for(size_t level = 1; level < split_level; level++) {
+        for(auto it = node_sizes.level_nodes(level); it.valid(); it.next()) {
+            const size_t s = it.size();
+            const size_t q = std::min(s, p);
+            for(size_t i = 0; i < q; i++) {
+                const size_t x = s * i / q;
+                const size_t y = s * (i+1) / q;
+                send_bits(level, i * p / q, it.offset() + x, y - x);
+            }
+        }
+    }
+
+    size_t max_local_num = 0;
+    if(split_level < h) {
+        const auto ranges = split.ranges();
+        for(size_t target = 0; target < p; target++) {
+            const size_t a = split.offset(ranges[target]);
+            const size_t num = split.offset(ranges[target+1]) - a;
+            if(num == 0) continue;
+
+            max_local_num = std::max(max_local_num, num);
+
+            // every source holds a proportional share of the range
+            for(size_t source = 0; source < p; source++) {
+                const size_t x = std::min(source * size_per_worker, n);
+                const size_t y = std::min(x + size_per_worker, n);
+                const size_t share = size_t(
+                    (long double)num * (y - x) / n);
+
+                if(share > 0) {
+                    predict_message(prediction[split_level], node_layout,
+                        source, target, share * sizeof(sym_t));
+                }
+            }
+
+            // the subtree bits occupy the range on every level below
+            for(size_t level = std::max(split_level, size_t(1));
+                level < h; level++) {
+
+                send_bits(level, target, a, num);
+            }
+        }
+    }
+
+    std::sort(pairs.begin(), pairs.end());
+    prediction[0].messages += std::distance(
+        pairs.begin(), std::unique(pairs.begin(), pairs.end()));
+
+    return max_local_num;
+}
+
+// predicts the costs of the MPI construction algorithms from the histogram
+// for the given mapping of workers to compute nodes
+//
+// the wavelet matrix algorithms are considered if matrix is set, the wavelet
+// tree algorithms otherwise
+template<typename sym_t, typename idx_t>
+std::vector<CostPrediction> predict_costs(
+    const HistogramBase<sym_t, idx_t>& hist,
+    const std::vector<size_t>& node_layout,
+    const bool matrix) {
+
+    const size_t n = hist.text_length();
+    const size_t p = std::max(node_layout.size(), size_t(1));
+    const size_t num_nodes = node_layout.empty() ? 1 :
+        1 + *std::max_element(node_layout.begin(), node_layout.end());
+
+    const WaveletTreeBase wt(hist);
+    const size_t h = wt.height();
+    const size_t num_tree_nodes = wt.num_nodes();
+
+    const size_t n_local = tlx::div_ceil(n, p);
+    const size_t text = n_local * sizeof(sym_t);
+    const size_t level = tlx::div_ceil(n_local, 8ULL);
+    const size_t levels = h * level;
+
+    // local WT of the node-based algorithms and its merge into levels
+    const size_t nodes = num_tree_nodes * sizeof(bv_t);
+    const size_t counters = (3ULL << h) / 2 * sizeof(idx_t);
+    const size_t merge = levels + level;
+
+    // dsplit cannot divide leaf nodes between workers
+    double dsplit_imbalance = 1.0;
+    if(n > 0 && h > 0) {
+        const auto node_sizes = WaveletTreeBase::node_sizes(hist);
+        size_t max_leaf = 0;
+        for(auto it = node_sizes.level_nodes(h-1); it.valid(); it.next()) {
+            max_leaf = std::max(max_leaf, it.size());
+        }
+        dsplit_imbalance = std::max(1.0,
+            double(max_leaf) / (double(n) * double(h) / double(p)));
+    }
+
+    auto predict = [&](
+        const std::string& algo,
+        const size_t memory,
+        const std::vector<TrafficPrediction>& level_traffic,
+        const double imbalance,
+        const size_t extra_work) {
+
+        TrafficPrediction traffic { 0, 0, 0 };
+        for(auto& lv : level_traffic) traffic += lv;
+
+        const double compute =
+            (imbalance * double(h * n_local) + double(extra_work)) /
+            cost_symbol_throughput;
+
+        const double comm = std::max(
+            double(traffic.inter) / (num_nodes * cost_inter_node_bandwidth),
+            double(traffic.intra) / (p * cost_intra_node_bandwidth));
+
+        const double latency =
+            double(traffic.messages) / double(p) * cost_message_latency;
+
+        return CostPrediction {
+            algo, memory, traffic, level_traffic, imbalance,
+            compute + comm + latency };
+    };
+
+    std::vector<CostPrediction> result;
+    // mpi-bsort and mpi-wm-concat resolve several levels per round,
+    // scanning the text once per round to count the bucket sizes in advance
+    const size_t tau = choose_levels_per_round(h, 0);
+    const size_t num_rounds = tlx::div_ceil(h, tau);
+
+    if(matrix) {
+        result.push_back(predict("mpi-wm-concat",
+            3 * text + levels,
+            predict_wm_concat_level_traffic(hist, node_layout, tau),
+            1.0, num_rounds * n_local));
+    } else {
+        result.push_back(predict("mpi-bsort",
+            3 * text + levels,
+            predict_bsort_level_traffic(hist, node_layout, tau),
+            1.0, num_rounds * n_local));
+
+        // mpi-dynbsort saves the counting scans, but sends the text on every
+        // level, and the capacity doubling of its buckets may take up to
+        // twice the text
+        result.push_back(predict("mpi-dynbsort",
+            4 * text + levels,
+            predict_bsort_level_traffic(hist, node_layout), 1.0, 0));
+
+        // mpi-ad holds two copies of the text while routing it and while
+        // sorting the received range, plus the first level. when the bits
+        // are exchanged, it holds the levels, the packed bits it sends
+        // (whose buffers may take twice their size due to capacity
+        // doubling), the received message and an aligned copy of a slice
+        std::vector<TrafficPrediction> ad_traffic;
+        const size_t ad_local_num =
+            predict_ad_level_traffic(hist, node_layout, ad_traffic);
+        const size_t ad_text = ad_local_num * sizeof(sym_t);
+        const size_t ad_level =
+            tlx::div_ceil(std::max(ad_local_num, n_local), 8ULL);
+        const size_t ad_packed = (h > 0) ? (h - 1) * ad_level : 0;
+        result.push_back(predict("mpi-ad",
+            std::max(2 * std::max(text, ad_text) + level,
+                levels + 3 * ad_packed + ad_level),
+            ad_traffic,
+            std::max(1.0, double(ad_local_num) / double(std::max(n_local,
+                size_t(1)))),
+            0));
+    }
+
+    const std::string prefix = matrix ? "mpi-wm-" : "mpi-";
+    // mpi-wm-dd partitions a copy of the local text on every level
+    result.push_back(predict(prefix + "dd",
+        matrix ? 2 * text + merge : text + nodes + counters + merge,
+        predict_dd_level_traffic(hist, node_layout, matrix),
+        1.0, matrix ? 0 : num_tree_nodes));
+
+    std::vector<TrafficPrediction> dsplit_traffic;
+    const size_t dsplit_local_num = predict_dsplit_level_traffic(
+        hist, node_layout, matrix, dsplit_traffic);
+    result.push_back(predict(prefix + "dsplit",
+        3 * dsplit_local_num * sizeof(sym_t) + nodes + counters + merge,
+        dsplit_traffic, dsplit_imbalance, num_tree_nodes));
+
+    return result;
+}
@@ -87,8 +87,7 @@ size_t dsplit_str(
     ctx.synchronize(); // TODO DEBUG
     #endif
 
-    // allocate message buffer
-    std::vector<uint64_t*> msg_headers;
+    // allocate message buffer (headers are taken from the message pool)
     std::vector<T> msg_buf(local_num_total);
 
     // send phase
@@ -108,10 +107,9 @@ size_t dsplit_str(
 
         // split and send data
         auto send_interval = [&](const bool b, const size_t to){
-            uint64_t* header = new uint64_t[2];
+            uint64_t* header = ctx.message_pool().send_buffer(2);
             header[0] = glob[b];
             header[1] = count[b];
-            msg_headers.push_back(header);
 
             ctx.isend(header, 2, to, tag);
             ctx.isend(buf[b], count[b], to, tag);
@@ -167,20 +165,11 @@ size_t dsplit_str(
             ? (ctx.rank() - targets0) * num_per_target[1]
             : (ctx.rank()) * num_per_target[0];
 
-        size_t expect;
-        {
-            std::array<size_t, 2> last = {targets0-1, ctx.num_workers()-1};
-            if(ctx.rank() < last[b]) {
-                expect = num_per_target[b];
-            } else {
-                if(num_per_target[b] > 0) {
-                    const size_t mod = num[b] % num_per_target[b];
-                    expect = (mod == 0) ? num_per_target[b] : mod;
-                } else {
-                    expect = 0;
-                }
-            }
-        }
+        // note that trailing targets may receive nothing at all if the
+        // items do not suffice to fill all of them
+        const size_t expect = (num[b] > global_offset)
+            ? std::min(num_per_target[b], num[b] - global_offset)
+            : 0;
 
         // fit space
         data = std::vector<T>(expect);
@@ -227,9 +216,7 @@ size_t dsplit_str(
     ctx.synchronize();
 
     // clean up
-    for(uint64_t* header : msg_headers) {
-        delete[] header;
-    }
+    ctx.message_pool().recycle();
 
     // return splitter
     return targets0;
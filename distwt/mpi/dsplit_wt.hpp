@@ -0,0 +1,138 @@
+#pragma once
+
+#include <vector>
+
+#include <tlx/math/integer_log2.hpp>
+
+#include <distwt/mpi/context.hpp>
+#include <distwt/mpi/dsplit.hpp>
+#include <distwt/mpi/subtree_tasks.hpp>
+#include <distwt/mpi/wt.hpp>
+
+// computes the nodes of the subtree rooted at node_id, which represents the
+// alphabet interval [a, b], by recursively splitting the text and the group
+// of workers
+//
+// subtrees that end up with a single worker are appended to tasks
+template<typename sym_t>
+void recursiveWT(
+    WaveletTree::bits_t& bits,
+    std::vector<SubtreeTask<sym_t>>& tasks,
+    MPIContext& ctx,
+    const size_t node_id,
+    std::vector<sym_t>& text,
+    const size_t a,
+    const size_t b) {
+
+    if(a == b) return;
+
+    ctx.cout_master() << "Processing node " << node_id << " using "
+        << ctx.num_workers() << " worker(s) ..." << std::endl;
+
+    if(ctx.num_workers() == 1) {
+        // we are left with only one worker
+        // this may happen based on the balance of 0/1 bits in a bit vector
+        // the remaining subtree is computed sequentially after the work
+        // has been balanced between all workers
+        const size_t wsubtree_height = tlx::integer_log2_ceil(b-a+1);
+        tasks.push_back(SubtreeTask<sym_t> {
+            node_id,          // subtree root
+            wsubtree_height,  // subtree height
+            std::move(text)
+        });
+
+        // return
+        return;
+    }
+
+    const size_t m = (a + b) / 2;
+
+    // compute node bit vector
+    const size_t n = text.size();
+    size_t z = 0;
+    {
+        auto& bv = bits[node_id-1];
+        bv.resize(n);
+
+        for(size_t i = 0; i < n; i++) {
+            if(size_t(text[i]) <= m) {
+                bv[i] = 0;
+                ++z;
+            } else {
+                bv[i] = 1;
+            }
+        }
+    }
+
+    if(a < m || m+1 < b) {
+        // perform split
+        // the node's level is a sufficient tag, because each group of
+        // workers uses its own communicator
+        const size_t split = dsplit_str(
+            ctx,
+            text,
+            [m](const sym_t& x){return (size_t(x) > m);},
+            z, n-z,
+            int(tlx::integer_log2_floor(node_id)));
+
+        // create communicators for left and right groups
+        MPI_Comm parent_comm = ctx.comm();
+        MPI_Group target_group_l, target_group_r;
+        MPI_Comm target_comm_l, target_comm_r;
+        {
+            MPI_Group parent_group;
+            MPI_Comm_group(parent_comm, &parent_group);
+
+            const size_t num_l = split;
+            int ranks_l[num_l];
+            for(size_t i = 0; i < num_l; i++) {
+                ranks_l[i] = int(i);
+            }
+
+            // left
+            MPI_Group_incl(parent_group, num_l, ranks_l, &target_group_l);
+            MPI_Comm_create(parent_comm, target_group_l, &target_comm_l);
+
+            // right
+            MPI_Group_excl(parent_group, num_l, ranks_l, &target_group_r);
+            MPI_Comm_create(parent_comm, target_group_r, &target_comm_r);
+        }
+
+        // recurse in respective group
+        // workers that received no text still take part, because they are
+        // members of the group's communicator
+        if(ctx.rank() < split) {
+            // recurse with left child in left group
+            ctx.set_comm(target_comm_l);
+            recursiveWT(
+                bits,
+                tasks,
+                ctx,
+                2ULL * node_id,
+                text,
+                a, m);
+        } else {
+            // recurse with right child in right group
+            ctx.set_comm(target_comm_r);
+            recursiveWT(
+                bits,
+                tasks,
+                ctx,
+                2ULL * node_id + 1,
+                text,
+                m+1, b);
+        }
+
+        // restore communicator
+        ctx.set_comm(parent_comm);
+
+        // synchronize
+        ctx.synchronize();
+
+        // free temporary communicators
+        if(target_comm_l != MPI_COMM_NULL) MPI_Comm_free(&target_comm_l);
+        if(target_comm_r != MPI_COMM_NULL) MPI_Comm_free(&target_comm_r);
+        MPI_Group_free(&target_group_l);
+        MPI_Group_free(&target_group_r);
+    }
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <algorithm>
+
+#include <tlx/math/div_ceil.hpp>
+
+#include <distwt/mpi/context.hpp>
+
+// an even partition of a distributed sequence of n items, answering the
+// same queries as FilePartitionReader
+class EvenPartition {
+private:
+    size_t m_total_size, m_size_per_worker;
+    size_t m_local_offset, m_local_num;
+
+public:
+    inline EvenPartition(const MPIContext& ctx, const size_t n)
+        : m_total_size(n),
+          m_size_per_worker(std::max(
+            tlx::div_ceil(n, ctx.num_workers()), size_t(1))) {
+
+        m_local_offset = std::min(m_size_per_worker * ctx.rank(), n);
+        m_local_num =
+            std::min(m_local_offset + m_size_per_worker, n) - m_local_offset;
+    }
+
+    inline size_t total_size() const { return m_total_size; }
+    inline size_t size_per_worker() const { return m_size_per_worker; }
+
+    inline size_t local_offset() const { return m_local_offset; }
+    inline size_t local_num() const { return m_local_num; }
+};
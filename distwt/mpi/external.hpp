@@ -0,0 +1,474 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <distwt/mpi/bucket_exchange.hpp>
+#include <distwt/mpi/context.hpp>
+#include <distwt/mpi/level_rounds.hpp>
+#include <distwt/mpi/malloc.hpp>
+#include <distwt/mpi/mpi_max.hpp>
+
+//#define DBG_EXTERNAL 1
+
+// the number of items per chunk when processing a text in chunks under the
+// given memory budget (in bytes)
+//
+// the reserved bytes are taken from the budget first, e.g., for buffers
+// whose sizes do not depend on the chunk size. the rest is divided among
+// the bytes that all buffers that are live at the same time hold per item
+inline size_t external_chunk_size(
+    const size_t budget,
+    const size_t reserved,
+    const size_t bytes_per_item) {
+
+    const size_t available = (budget > reserved) ? budget - reserved : 0;
+    return std::max(available / bytes_per_item, size_t(1));
+}
+
+// the bytes of a memory budget that are left for allocations that no
+// buffer size accounts for, e.g., an output stream's buffer, the buffers that
+// MPI allocates to read the input and the granularity of the allocation
+// statistics
+constexpr size_t external_slack = size_t(3) << 16;
+
+// the number of buffers of external_bucket_round that hold up to a chunk of
+// items at the same time: the chunk, the sort buffer, the received message
+// and a copy of an outgoing message that MPI may make
+constexpr size_t external_round_buffers = 4;
+
+// the bytes that external_bucket_round takes besides its chunk buffers for
+// the given number of buckets: the bucket sizes, positions and offsets, the
+// directories of the outgoing messages, which grow by doubling, and the
+// messages and counts per worker, plus the slack
+inline size_t external_round_reserve(
+    const size_t num_buckets,
+    const size_t num_workers) {
+
+    return sizeof(size_t) * (16 * num_buckets + 32 * num_workers) +
+        external_slack;
+}
+
+// compares the memory allocated during a phase that runs under a memory
+// budget with the budget
+//
+// the budget does not cover what is already allocated when the phase
+// starts, e.g., by MPI and for the histogram. the process's peak is
+// restored afterwards, so that it is still reported correctly
+class BudgetCheck {
+private:
+    size_t m_budget;
+    size_t m_base;
+    size_t m_prev_peak;
+
+public:
+    inline BudgetCheck(const size_t budget)
+        : m_budget(budget),
+          m_base(malloc_stats::current()),
+          m_prev_peak(malloc_stats::reset_peak()) {
+    }
+
+    // returns the maximum number of bytes allocated during the phase by any
+    // worker and warns if it exceeds the budget
+    //
+    // without allocation tracking, the phase cannot be measured and zero is
+    // returned
+    size_t finish(MPIContext& ctx) const {
+        const size_t peak = malloc_stats::peak();
+        malloc_stats::raise_peak(m_prev_peak);
+
+        if(!malloc_stats::tracked()) return 0;
+
+        size_t used = (peak > m_base) ? peak - m_base : 0;
+        size_t max_used;
+        ctx.all_reduce(&used, &max_used, 1, mpi_max<size_t>::op());
+
+        if(max_used > m_budget) {
+            ctx.cout_master() << "WARNING: up to " << max_used
+                << " bytes were allocated per worker, exceeding the memory "
+                "budget of " << m_budget << " bytes" << std::endl;
+        }
+        return max_used;
+    }
+};
+
+// the name of the worker's scratch file with the given name, which is
+// placed in $TMPDIR (or /tmp)
+inline std::string scratch_filename(
+    const MPIContext& ctx,
+    const std::string& name) {
+
+    const char* tmpdir = std::getenv("TMPDIR");
+    std::ostringstream ss;
+    ss << ((tmpdir && *tmpdir) ? tmpdir : "/tmp") << "/distwt."
+        << getpid() << '.' << std::setw(4) << std::setfill('0')
+        << ctx.rank() << '.' << name;
+    return ss.str();
+}
+
+// a local text that is stored in a scratch file and accessed in blocks
+//
+// the file is placed in $TMPDIR (or /tmp) and removed on destruction
+template<typename sym_t>
+class ExternalText {
+private:
+    std::string m_filename;
+    int m_fd;
+    size_t m_size;
+
+public:
+    inline ExternalText(
+        const MPIContext& ctx,
+        const size_t size,
+        const std::string& name)
+        : m_filename(scratch_filename(ctx, name)), m_size(size) {
+
+        m_fd = open(m_filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+        if(m_fd < 0 || ftruncate(m_fd, off_t(size * sizeof(sym_t))) != 0) {
+            ctx.cout() << "failed to create scratch file "
+                << m_filename << std::endl;
+            std::abort();
+        }
+    }
+
+    inline ~ExternalText() {
+        close(m_fd);
+        unlink(m_filename.c_str());
+    }
+
+    ExternalText(const ExternalText&) = delete;
+    ExternalText& operator=(const ExternalText&) = delete;
+
+    inline size_t size() const { return m_size; }
+
+    // reads num items starting at offs into dst
+    void read(const size_t offs, const size_t num, sym_t* dst) const {
+        uint8_t* buf = (uint8_t*)dst;
+        size_t left = num * sizeof(sym_t);
+        off_t pos = off_t(offs * sizeof(sym_t));
+        while(left > 0) {
+            const ssize_t r = pread(m_fd, buf, left, pos);
+            if(r <= 0) std::abort();
+            buf += r;
+            pos += r;
+            left -= size_t(r);
+        }
+    }
+
+    // writes num items (given as raw bytes) to the positions starting at offs
+    void write(const size_t offs, const void* src, const size_t num) {
+        const uint8_t* buf = (const uint8_t*)src;
+        size_t left = num * sizeof(sym_t);
+        off_t pos = off_t(offs * sizeof(sym_t));
+        while(left > 0) {
+            const ssize_t r = pwrite(m_fd, buf, left, pos);
+            if(r <= 0) std::abort();
+            buf += r;
+            pos += r;
+            left -= size_t(r);
+        }
+    }
+
+    // calls f(offs, chunk) for consecutive chunks of at most chunk_size items
+    template<typename chunk_f>
+    void scan(
+        const size_t chunk_size,
+        std::vector<sym_t>& chunk,
+        chunk_f f) const {
+
+        for(size_t offs = 0; offs < m_size; offs += chunk_size) {
+            chunk.resize(std::min(chunk_size, m_size - offs));
+            read(offs, chunk.size(), chunk.data());
+            f(offs, chunk);
+        }
+    }
+};
+
+// a bit vector that is stored in a file in the format of a wavelet tree
+// level and accessed in intervals of bits, e.g., an output level that is
+// received in pieces
+//
+// if remove is set, the file is removed on destruction
+class ExternalBits {
+private:
+    std::string m_filename;
+    bool m_remove;
+    int m_fd;
+    size_t m_size;
+
+    void read_words(const size_t first, const size_t num, uint64_t* dst) {
+        uint8_t* buf = (uint8_t*)dst;
+        size_t left = num * sizeof(uint64_t);
+        off_t pos = off_t(first * sizeof(uint64_t));
+        while(left > 0) {
+            const ssize_t r = pread(m_fd, buf, left, pos);
+            if(r <= 0) std::abort();
+            buf += r;
+            pos += r;
+            left -= size_t(r);
+        }
+    }
+
+    void write_words(
+        const size_t first,
+        const size_t num,
+        const uint64_t* src) {
+
+        const uint8_t* buf = (const uint8_t*)src;
+        size_t left = num * sizeof(uint64_t);
+        off_t pos = off_t(first * sizeof(uint64_t));
+        while(left > 0) {
+            const ssize_t r = pwrite(m_fd, buf, left, pos);
+            if(r <= 0) std::abort();
+            buf += r;
+            pos += r;
+            left -= size_t(r);
+        }
+    }
+
+public:
+    inline ExternalBits(
+        const MPIContext& ctx,
+        const std::string& filename,
+        const size_t size,
+        const bool remove)
+        : m_filename(filename), m_remove(remove), m_size(size) {
+
+        const size_t num_words = (size + 63ULL) / 64ULL;
+
+        // output files are created like the output streams would
+        m_fd = open(m_filename.c_str(), O_RDWR | O_CREAT | O_TRUNC,
+            remove ? 0600 : 0666);
+        if(m_fd < 0 || ftruncate(m_fd,
+            off_t(num_words * sizeof(uint64_t))) != 0) {
+
+            ctx.cout() << "failed to create file " << m_filename << std::endl;
+            std::abort();
+        }
+    }
+
+    inline ~ExternalBits() {
+        close(m_fd);
+        if(m_remove) unlink(m_filename.c_str());
+    }
+
+    ExternalBits(const ExternalBits&) = delete;
+    ExternalBits& operator=(const ExternalBits&) = delete;
+
+    inline size_t size() const { return m_size; }
+
+    // reads the num bits starting at offs into dst
+    //
+    // like write, this buffers exactly the words of the interval, so that
+    // accessing an interval takes no more memory than the interval
+    void read(const size_t offs, const size_t num, std::vector<bool>& dst) {
+        assert(offs + num <= m_size);
+        dst.resize(num);
+        if(num == 0) return;
+
+        const size_t first = offs / 64ULL;
+        const size_t num_words = (offs + num - 1) / 64ULL + 1 - first;
+        std::vector<uint64_t> words(num_words);
+        read_words(first, num_words, words.data());
+
+        const size_t x = offs % 64ULL;
+        for(size_t i = 0; i < num; i++) {
+            const size_t j = x + i;
+            dst[i] = (words[j / 64ULL] >> (63ULL - j % 64ULL)) & 1ULL;
+        }
+    }
+
+    // writes the first num bits of src to the positions starting at offs
+    void write(
+        const size_t offs,
+        const std::vector<bool>& src,
+        const size_t num) {
+
+        assert(offs + num <= m_size);
+        if(num == 0) return;
+
+        const size_t first = offs / 64ULL;
+        const size_t num_words = (offs + num - 1) / 64ULL + 1 - first;
+        std::vector<uint64_t> words(num_words, 0);
+
+        // only the boundary words may contain bits outside of the interval
+        const size_t x = offs % 64ULL;
+        const size_t y = (offs + num) % 64ULL;
+        if(x > 0) {
+            read_words(first, 1, words.data());
+        }
+        if(y > 0 && (num_words > 1 || x == 0)) {
+            read_words(first + num_words - 1, 1,
+                words.data() + num_words - 1);
+        }
+
+        for(size_t i = 0; i < num; i++) {
+            const size_t j = x + i;
+            const uint64_t mask = 1ULL << (63ULL - j % 64ULL);
+            if(src[i]) {
+                words[j / 64ULL] |= mask;
+            } else {
+                words[j / 64ULL] &= ~mask;
+            }
+        }
+
+        write_words(first, num_words, words.data());
+    }
+};
+
+// writes a bit vector in the format of a wavelet tree level as it is being
+// computed, i.e., without holding it in RAM
+//
+// if the filename is empty, the bits are discarded
+class LevelWriter {
+private:
+    std::ofstream m_out;
+    uint64_t m_word;
+    size_t m_x;
+
+public:
+    inline LevelWriter(const std::string& filename) : m_word(0), m_x(0) {
+        if(!filename.empty()) {
+            m_out.open(filename, std::ios::binary | std::ios::trunc);
+        }
+    }
+
+    inline ~LevelWriter() {
+        if(m_x > 0 && m_out.is_open()) {
+            m_out.write((const char*)&m_word, sizeof(uint64_t));
+        }
+    }
+
+    inline void push(const bool b) {
+        m_word |= uint64_t(b) << (63ULL - (m_x++));
+        if(m_x >= 64ULL) {
+            if(m_out.is_open()) {
+                m_out.write((const char*)&m_word, sizeof(uint64_t));
+            }
+            m_word = 0;
+            m_x = 0;
+        }
+    }
+
+    // the local filename of the given level, or an empty string if there
+    // is no output
+    static std::string filename(
+        const MPIContext& ctx,
+        const std::string& output,
+        const std::string& extension) {
+
+        if(output.empty()) return output;
+
+        std::ostringstream ss;
+        ss << output << std::setw(4) << std::setfill('0')
+            << ctx.rank() << '.' << extension;
+        return ss.str();
+    }
+};
+
+// redistributes an external text in one bucket sort round, streaming
+// through it chunk by chunk
+//
+// key(x) determines the local bucket of x and glob_offs contains the global
+// offset of each bucket's first local item. the received items are written
+// to dst, which represents the global interval starting at global_offset.
+// since the number of chunks may differ, all workers take part in as many
+// sub-rounds as the worker with the most chunks
+template<typename sym_t, typename key_f>
+void external_bucket_round(
+    MPIContext& ctx,
+    const ExternalText<sym_t>& src,
+    ExternalText<sym_t>& dst,
+    const size_t global_offset,
+    const size_t size_per_worker,
+    const size_t chunk_size,
+    std::vector<size_t> glob_offs,
+    key_f key,
+    const int tag) {
+
+    const size_t num_buckets = glob_offs.size();
+    const size_t local_num = src.size();
+
+    size_t num_chunks = (local_num + chunk_size - 1) / chunk_size;
+    {
+        size_t max_chunks;
+        ctx.all_reduce(&num_chunks, &max_chunks, 1, mpi_max<size_t>::op());
+        num_chunks = max_chunks;
+    }
+
+    #ifdef DBG_EXTERNAL
+    ctx.cout_master() << "bucket round in " << num_chunks
+        << " chunk(s)" << std::endl;
+    #endif
+
+    std::vector<sym_t> chunk, buffer;
+    std::vector<size_t> bucket_sizes(num_buckets);
+    std::vector<size_t> bucket_pos;
+    std::vector<std::vector<size_t>> num_to(ctx.num_workers());
+
+    BucketExchange<sym_t> exchange(ctx, size_per_worker);
+    for(size_t r = 0; r < num_chunks; r++) {
+        const size_t offs = std::min(r * chunk_size, local_num);
+        const size_t num = std::min(chunk_size, local_num - offs);
+
+        chunk.resize(num);
+        src.read(offs, num, chunk.data());
+
+        // stably sort the chunk into the buckets
+        std::fill(bucket_sizes.begin(), bucket_sizes.end(), 0);
+        for(const sym_t x : chunk) {
+            ++bucket_sizes[key(x)];
+        }
+
+        buffer.resize(num);
+        round_bucket_sort(chunk, bucket_sizes, bucket_pos, key,
+            [&](const size_t i, const sym_t x){ buffer[i] = x; });
+
+        // schedule buckets and count the items sent to each worker, so
+        // that receivers know how many items to expect in this sub-round
+        for(auto& v : num_to) v.assign(1, 0);
+        for(size_t k = 0; k < num_buckets; k++) {
+            if(bucket_sizes[k] == 0) continue;
+
+            exchange.add(
+                buffer.data() + bucket_pos[k], glob_offs[k], bucket_sizes[k]);
+
+            size_t p = glob_offs[k];
+            const size_t q = p + bucket_sizes[k];
+            while(p < q) {
+                const size_t target = p / size_per_worker;
+                const size_t x = std::min((target+1) * size_per_worker, q);
+                num_to[target][0] += x - p;
+                p = x;
+            }
+
+            glob_offs[k] = q;
+        }
+
+        size_t expect = 0;
+        for(const auto& v : ctx.all_to_all(num_to)) {
+            expect += v[0];
+        }
+
+        exchange.send(tag);
+        exchange.receive_slices(expect, tag,
+        [&](const size_t g, const void* data, const size_t n){
+            assert(g >= global_offset);
+            dst.write(g - global_offset, data, n);
+        });
+
+        // synchronize before cleaning!
+        ctx.synchronize();
+        exchange.clear();
+    }
+}
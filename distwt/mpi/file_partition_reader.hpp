@@ -53,7 +53,10 @@ public:
         const size_t local_end = std::min(
             m_local_offset + m_size_per_worker, m_total_size);
 
-        m_local_num = local_end - m_local_offset;
+        // trailing workers may get no input at all for very small inputs
+        m_local_num = (local_end > m_local_offset)
+            ? local_end - m_local_offset
+            : 0;
     }
 
     inline const std::string& filename() const { return m_filename; }
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <vector>
+
+#include <tlx/math/div_ceil.hpp>
+#include <tlx/math/integer_log2.hpp>
+
+// the maximum number of buckets each node is sorted into per round when
+// resolving several levels at once, which bounds the fan-out of the
+// local counting sort
+constexpr size_t max_round_buckets = 256;
+
+// determines the number of levels to resolve per communication round
+//
+// if requested is zero, as many levels as max_round_buckets permits are
+// resolved per round, spread evenly over the rounds
+inline size_t choose_levels_per_round(
+    const size_t height,
+    const size_t requested) {
+
+    if(height == 0) return 1;
+    if(requested > 0) return std::min(requested, height);
+
+    const size_t max_levels = tlx::integer_log2_floor(max_round_buckets);
+    const size_t num_rounds = tlx::div_ceil(height, max_levels);
+    return tlx::div_ceil(height, num_rounds);
+}
+
+// stably sorts the items of text into buckets, calling f(i, x) for each
+// item x, where i is its position after sorting
+//
+// key(x) determines the bucket of x and bucket_sizes contains the number
+// of items in each bucket. bucket_pos receives the starting position of
+// each bucket
+template<typename T, typename key_f, typename out_f>
+void round_bucket_sort(
+    const std::vector<T>& text,
+    const std::vector<size_t>& bucket_sizes,
+    std::vector<size_t>& bucket_pos,
+    key_f key,
+    out_f f) {
+
+    const size_t num_buckets = bucket_sizes.size();
+    bucket_pos.resize(num_buckets);
+
+    size_t offs = 0;
+    for(size_t k = 0; k < num_buckets; k++) {
+        bucket_pos[k] = offs;
+        offs += bucket_sizes[k];
+    }
+    assert(offs == text.size());
+
+    for(const T& x : text) {
+        f(bucket_pos[key(x)]++, x);
+    }
+
+    // revert to bucket starting positions
+    for(size_t k = 0; k < num_buckets; k++) {
+        bucket_pos[k] -= bucket_sizes[k];
+    }
+}
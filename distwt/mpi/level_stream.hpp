@@ -0,0 +1,131 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <distwt/mpi/bit_vector.hpp>
+#include <distwt/mpi/context.hpp>
+
+// writes finished levels to <output><rank>.<level_extension(level)> in a
+// background thread and releases them afterwards, so that only the levels
+// still under construction are held in RAM
+//
+// the files have the same format as those written by the save functions of
+// the levelwise WT and the WM
+class LevelStream {
+private:
+    struct Job {
+        bv_t bits;
+        std::ofstream out;
+    };
+
+    std::string m_output;
+    std::string (*m_level_extension)(size_t);
+    size_t m_rank;
+
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::vector<std::unique_ptr<Job>> m_jobs; // null once written
+    size_t m_num_written;
+    bool m_stop;
+
+    std::thread m_thread;
+
+    static void write(Job& job) {
+        uint64_t word = 0;
+        size_t x = 0;
+
+        for(size_t i = 0; i < job.bits.size(); i++) {
+            word |= uint64_t(job.bits[i]) << (63ULL - (x++));
+            if(x >= 64ULL) {
+                job.out.write((const char*)&word, sizeof(uint64_t));
+                word = 0;
+                x = 0;
+            }
+        }
+
+        if(x > 0) {
+            job.out.write((const char*)&word, sizeof(uint64_t));
+        }
+        job.out.flush();
+    }
+
+    void run() {
+        while(true) {
+            std::unique_ptr<Job> job;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_cv.wait(lock, [&](){
+                    return m_stop || m_num_written < m_jobs.size();
+                });
+
+                if(m_num_written == m_jobs.size()) return; // stopped
+                job = std::move(m_jobs[m_num_written]);
+            }
+
+            // write and release the level
+            write(*job);
+            job.reset();
+
+            std::lock_guard<std::mutex> lock(m_mutex);
+            ++m_num_written;
+        }
+    }
+
+public:
+    inline LevelStream(
+        const MPIContext& ctx,
+        const std::string& output,
+        std::string (*level_extension)(size_t))
+        : m_output(output),
+          m_level_extension(level_extension),
+          m_rank(ctx.rank()),
+          m_num_written(0),
+          m_stop(false) {
+
+        m_thread = std::thread([this](){ run(); });
+    }
+
+    inline ~LevelStream() {
+        finish();
+    }
+
+    LevelStream(const LevelStream&) = delete;
+    LevelStream& operator=(const LevelStream&) = delete;
+
+    // hands over the final bit vector of the given level, which is left
+    // empty
+    void push(const size_t level, bv_t& bits) {
+        std::unique_ptr<Job> job(new Job());
+        std::swap(job->bits, bits);
+
+        std::ostringstream ss;
+        ss << m_output << std::setw(4) << std::setfill('0')
+            << m_rank << '.' << m_level_extension(level);
+        job->out.open(ss.str(), std::ios::binary | std::ios::trunc);
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_jobs.push_back(std::move(job));
+        m_cv.notify_one();
+    }
+
+    // waits until all levels have been written
+    void finish() {
+        if(!m_thread.joinable()) return;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+            m_cv.notify_one();
+        }
+        m_thread.join();
+        m_jobs.clear();
+    }
+};
@@ -1,38 +1,149 @@
 #include <distwt/mpi/malloc.hpp>
 
-#include <cassert>
-#include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <fstream>
+#include <string>
 
-void (*malloc_callback::on_alloc)(size_t) = NULL;
-void (*malloc_callback::on_free)(size_t) = NULL;
+#include <malloc.h>
+#include <sys/mman.h>
 
-constexpr size_t MEMBLOCK_MAGIC = 0xFEDCBA9876543210;
+size_t malloc_huge_pages::threshold = 0;
+size_t malloc_huge_pages::page_size = 2ULL << 20ULL;
 
-bool callback_guard = false;
+#ifndef DISTWT_NO_MALLOC_TRACKING
 
-struct block_header_t {
-    size_t magic;
-    size_t size;
+// the number of bytes a thread may allocate or free before its counter is
+// added to the global ones
+constexpr int64_t FLUSH_THRESHOLD = 1LL << 16LL;
+
+std::atomic<int64_t> g_alloc_current(0);
+std::atomic<int64_t> g_alloc_peak(0);
+
+// the bytes allocated by a thread since its last flush, and the maximum
+// thereof, which is added to the global counter to update the peak
+struct thread_alloc_t {
+    int64_t delta;
+    int64_t delta_max;
 };
 
-inline bool is_managed(block_header_t* block) {
-    return (block->magic == MEMBLOCK_MAGIC);
+// trivial and statically initialized, so that accessing it never allocates
+thread_local thread_alloc_t t_alloc __attribute__((tls_model("initial-exec")))
+    = {0, 0};
+
+inline void flush_alloc() {
+    const int64_t before =
+        g_alloc_current.fetch_add(t_alloc.delta, std::memory_order_relaxed);
+
+    const int64_t peak = before + t_alloc.delta_max;
+    int64_t p = g_alloc_peak.load(std::memory_order_relaxed);
+    while(peak > p && !g_alloc_peak.compare_exchange_weak(
+        p, peak, std::memory_order_relaxed)) {
+    }
+
+    t_alloc.delta = 0;
+    t_alloc.delta_max = 0;
+}
+
+inline void on_alloc(void* ptr) {
+    t_alloc.delta += int64_t(malloc_usable_size(ptr));
+    t_alloc.delta_max = std::max(t_alloc.delta_max, t_alloc.delta);
+    if(t_alloc.delta >= FLUSH_THRESHOLD) flush_alloc();
+}
+
+inline void on_free(void* ptr) {
+    t_alloc.delta -= int64_t(malloc_usable_size(ptr));
+    if(t_alloc.delta <= -FLUSH_THRESHOLD) flush_alloc();
+}
+
+bool malloc_stats::tracked() {
+    return true;
+}
+
+size_t malloc_stats::current() {
+    flush_alloc();
+    return size_t(std::max(
+        g_alloc_current.load(std::memory_order_relaxed), int64_t(0)));
+}
+
+size_t malloc_stats::peak() {
+    flush_alloc();
+    return size_t(g_alloc_peak.load(std::memory_order_relaxed));
 }
 
-inline void on_alloc(size_t size) {
-    if(malloc_callback::on_alloc && !callback_guard) {
-        callback_guard = true;
-        malloc_callback::on_alloc(size);
-        callback_guard = false;
+size_t malloc_stats::reset_peak() {
+    flush_alloc();
+    return size_t(g_alloc_peak.exchange(
+        g_alloc_current.load(std::memory_order_relaxed),
+        std::memory_order_relaxed));
+}
+
+void malloc_stats::raise_peak(const size_t peak) {
+    int64_t p = g_alloc_peak.load(std::memory_order_relaxed);
+    while(int64_t(peak) > p && !g_alloc_peak.compare_exchange_weak(
+        p, int64_t(peak), std::memory_order_relaxed)) {
     }
 }
 
-inline void on_free(size_t size) {
-    if(malloc_callback::on_free && !callback_guard) {
-        callback_guard = true;
-        malloc_callback::on_free(size);
-        callback_guard = false;
+#else
+
+inline void on_alloc(void*) {
+}
+
+inline void on_free(void*) {
+}
+
+bool malloc_stats::tracked() {
+    return false;
+}
+
+size_t malloc_stats::current() {
+    return 0;
+}
+
+size_t malloc_stats::peak() {
+    // e.g., "VmHWM:     1234 kB"
+    std::ifstream f("/proc/self/status");
+    std::string key;
+    size_t kb;
+    while(f >> key) {
+        if(key == "VmHWM:" && f >> kb) return kb * 1024ULL;
     }
+    return 0;
+}
+
+size_t malloc_stats::reset_peak() {
+    return peak();
+}
+
+void malloc_stats::raise_peak(size_t) {
+}
+
+#endif
+
+// large blocks are served by mmap and are not touched yet, so the advice
+// takes effect when the pages are first written
+inline void advise_huge_pages(void* ptr, size_t size) {
+    const size_t threshold = malloc_huge_pages::threshold;
+    if(!threshold || size < threshold) return;
+
+    const uintptr_t page = malloc_huge_pages::page_size;
+    const uintptr_t begin = ((uintptr_t)ptr + page - 1) & ~(page - 1);
+    const uintptr_t end = ((uintptr_t)ptr + size) & ~(page - 1);
+    if(begin < end) {
+        madvise((void*)begin, end - begin, MADV_HUGEPAGE);
+    }
+}
+
+// counts and advises a newly allocated block
+inline void* allocated(void* ptr, size_t size) {
+    if(ptr) {
+        on_alloc(ptr);
+        advise_huge_pages(ptr, size);
+    }
+    return ptr;
 }
 
 extern "C" void* malloc(size_t size) {
@@ -40,28 +151,14 @@ extern "C" void* malloc(size_t size) {
         return NULL;
     }
 
-    void *ptr = __libc_malloc(size + sizeof(block_header_t));
-    if(!ptr) return ptr; // malloc failed
-
-    auto block = (block_header_t*)ptr;
-    block->magic = MEMBLOCK_MAGIC;
-    block->size = size;
-
-    on_alloc(size);
-
-    return (char*)ptr + sizeof(block_header_t);
+    return allocated(__libc_malloc(size), size);
 }
 
 extern "C" void free(void* ptr) {
     if(!ptr) return;
 
-    auto block = (block_header_t*)((char*)ptr - sizeof(block_header_t));
-    if(is_managed(block)) {
-        on_free(block->size);
-        __libc_free(block);
-    } else {
-        __libc_free(ptr);
-    }
+    on_free(ptr);
+    __libc_free(ptr);
 }
 
 extern "C" void* realloc(void* ptr, size_t size) {
@@ -71,30 +168,50 @@ extern "C" void* realloc(void* ptr, size_t size) {
     } else if(!ptr) {
         return malloc(size);
     } else {
-        auto block = (block_header_t*)((char*)ptr - sizeof(block_header_t));
-        if(is_managed(block)) {
-            size_t old_size = block->size;
-            void *new_ptr = __libc_realloc(block, size + sizeof(block_header_t));
+        // the old block is counted as freed even if realloc fails, so undo
+        // that in this case
+        on_free(ptr);
+        void* new_ptr = __libc_realloc(ptr, size);
+        if(!new_ptr) {
+            on_alloc(ptr);
+            return NULL;
+        }
 
-            auto new_block = (block_header_t*)new_ptr;
-            new_block->magic = MEMBLOCK_MAGIC; // just making sure
-            new_block->size = size;
+        return allocated(new_ptr, size);
+    }
+}
 
-            on_free(old_size);
-            on_alloc(size);
+extern "C" void* calloc(size_t num, size_t size) {
+    if(!num || !size) return NULL;
 
-            return (char*)new_ptr + sizeof(block_header_t);
-        } else {
-            return __libc_realloc(ptr, size);
-        }
+    // zero pages fresh from the kernel are not touched by __libc_calloc
+    return allocated(__libc_calloc(num, size), num * size);
+}
+
+extern "C" void* memalign(size_t alignment, size_t size) {
+    return allocated(__libc_memalign(alignment, size), size);
+}
+
+extern "C" void* aligned_alloc(size_t alignment, size_t size) {
+    return allocated(__libc_memalign(alignment, size), size);
+}
+
+extern "C" int posix_memalign(void** ptr, size_t alignment, size_t size) {
+    if(alignment % sizeof(void*) != 0 || (alignment & (alignment - 1)) != 0) {
+        return EINVAL;
     }
+
+    void* p = allocated(__libc_memalign(alignment, size), size);
+    if(!p) return ENOMEM;
+
+    *ptr = p;
+    return 0;
 }
 
-extern "C" void* calloc(size_t num, size_t size) {
-    size *= num;
-    if(!size) return NULL;
+extern "C" void* valloc(size_t size) {
+    return allocated(__libc_valloc(size), size);
+}
 
-    void* ptr = malloc(size);
-    memset(ptr, 0, size);
-    return ptr;
+extern "C" void* pvalloc(size_t size) {
+    return allocated(__libc_pvalloc(size), size);
 }
@@ -6,12 +6,52 @@
 
 #include <cstdlib>
 
-class malloc_callback {
+// statistics on the heap memory allocated by this process
+//
+// malloc, free, realloc, calloc and the aligned allocation functions
+// (posix_memalign, aligned_alloc, memalign, valloc and pvalloc, which also
+// serve the aligned variants of operator new) are interposed and count the
+// usable size of each block. every thread counts in its own counter, which
+// is added to the global ones only once it exceeds a small threshold, so
+// the statistics are exact for the calling thread and off by at most that
+// threshold for every other thread.
+//
+// if DISTWT_NO_MALLOC_TRACKING is defined, nothing is counted and the peak
+// is the process's peak resident set size (VmHWM) instead
+class malloc_stats {
 public:
-    static void (*on_alloc)(size_t);
-    static void (*on_free)(size_t);
+    // whether allocations are counted
+    static bool tracked();
+
+    // the number of bytes currently allocated (zero if not tracked)
+    static size_t current();
+
+    // the peak number of bytes allocated
+    static size_t peak();
+
+    // lowers the peak to the number of bytes currently allocated, so that
+    // the peak of a phase can be measured, and returns the previous peak
+    // (does nothing if not tracked)
+    static size_t reset_peak();
+
+    // raises the peak to at least the given number of bytes, e.g., to
+    // restore it after a phase has been measured
+    static void raise_peak(size_t peak);
+};
+
+// if the threshold is nonzero, the kernel is advised to back the aligned
+// interior of every block of at least this many bytes by transparent huge
+// pages of the given size
+class malloc_huge_pages {
+public:
+    static size_t threshold;
+    static size_t page_size;
 };
 
 extern "C" void* __libc_malloc(size_t);
 extern "C" void  __libc_free(void*);
 extern "C" void* __libc_realloc(void*, size_t);
+extern "C" void* __libc_calloc(size_t, size_t);
+extern "C" void* __libc_memalign(size_t, size_t);
+extern "C" void* __libc_valloc(size_t);
+extern "C" void* __libc_pvalloc(size_t);
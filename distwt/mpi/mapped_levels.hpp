@@ -0,0 +1,105 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <distwt/mpi/context.hpp>
+
+// the local level files <output><rank>.<level_extension(level)>, which are
+// created with their final size and mapped into memory up front, so that
+// the construction writes the packed words directly into the page cache
+//
+// the words have the same format as those written by the save functions of
+// the levelwise WT and the WM. the kernel may write back pages while later
+// levels are constructed, and sync merely flushes the remaining ones
+class MappedLevels {
+private:
+    size_t m_local_num;
+    std::vector<uint64_t*> m_words; // nullptr if the level is empty
+    size_t m_num_words;
+
+public:
+    inline MappedLevels(
+        const MPIContext& ctx,
+        const std::string& output,
+        std::string (*level_extension)(size_t),
+        const size_t num_levels,
+        const size_t local_num)
+        : m_local_num(local_num),
+          m_words(num_levels, nullptr),
+          m_num_words((local_num + 63ULL) / 64ULL) {
+
+        for(size_t level = 0; level < num_levels; level++) {
+            std::ostringstream ss;
+            ss << output << std::setw(4) << std::setfill('0')
+                << ctx.rank() << '.' << level_extension(level);
+            const std::string filename = ss.str();
+
+            const size_t size = m_num_words * sizeof(uint64_t);
+            const int fd = open(
+                filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+            if(fd < 0 || ftruncate(fd, off_t(size)) != 0) {
+                ctx.cout() << "failed to create " << filename << std::endl;
+                std::abort();
+            }
+
+            if(size > 0) {
+                void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                    MAP_SHARED, fd, 0);
+                if(p == MAP_FAILED) {
+                    ctx.cout() << "failed to map " << filename << std::endl;
+                    std::abort();
+                }
+                m_words[level] = (uint64_t*)p;
+            }
+
+            // the mapping remains valid after closing
+            close(fd);
+        }
+    }
+
+    inline ~MappedLevels() {
+        sync();
+    }
+
+    MappedLevels(const MappedLevels&) = delete;
+    MappedLevels& operator=(const MappedLevels&) = delete;
+
+    // writes the local bits of the given level, where bit(i) returns the
+    // i-th bit
+    template<typename bit_f>
+    void assign(const size_t level, bit_f bit) {
+        uint64_t* words = m_words[level];
+        for(size_t w = 0; w < m_num_words; w++) {
+            const size_t i0 = w * size_t(64);
+            const size_t i1 = std::min(i0 + size_t(64), m_local_num);
+
+            uint64_t word = 0;
+            for(size_t i = i0; i < i1; i++) {
+                word |= uint64_t(bool(bit(i))) << (63ULL - (i - i0));
+            }
+            words[w] = word;
+        }
+    }
+
+    // flushes all levels to their files and unmaps them
+    void sync() {
+        const size_t size = m_num_words * sizeof(uint64_t);
+        for(auto& words : m_words) {
+            if(words) {
+                msync(words, size, MS_SYNC);
+                munmap(words, size);
+                words = nullptr;
+            }
+        }
+    }
+};
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+// reusable buffer space for point-to-point messages
+//
+// send buffers are carved out of slabs, which are never moved or freed, so
+// that a buffer remains valid until recycle is called, i.e., until all
+// messages have been received. recycling keeps the slabs for the next
+// round, so after the first round, sending does not allocate any memory.
+// there is a single receive buffer, which only grows. all buffers are kept
+// until release is called
+class MessagePool {
+private:
+    static constexpr size_t min_slab_words = 1ULL << 16ULL;
+
+    std::vector<std::vector<uint64_t>> m_slabs;
+    size_t m_slab; // the slab currently carved from
+    size_t m_used; // the number of words used in the current slab
+
+    std::vector<uint64_t> m_recv;
+
+public:
+    inline MessagePool() : m_slab(0), m_used(0) {
+    }
+
+    // a send buffer of num words, valid until the next call to recycle
+    uint64_t* send_buffer(const size_t num) {
+        // advance to the first slab with enough space left
+        while(m_slab < m_slabs.size() &&
+            m_slabs[m_slab].size() - m_used < num) {
+
+            ++m_slab;
+            m_used = 0;
+        }
+
+        if(m_slab == m_slabs.size()) {
+            m_slabs.emplace_back(std::max(num, size_t(min_slab_words)));
+            m_used = 0;
+        }
+
+        uint64_t* buf = m_slabs[m_slab].data() + m_used;
+        m_used += num;
+        return buf;
+    }
+
+    // makes all send buffers available again
+    // only call this after all messages have been received!
+    inline void recycle() {
+        m_slab = 0;
+        m_used = 0;
+    }
+
+    // frees all buffers, e.g., after the last round of a phase
+    // only call this after all messages have been received!
+    inline void release() {
+        std::vector<std::vector<uint64_t>>().swap(m_slabs);
+        std::vector<uint64_t>().swap(m_recv);
+        recycle();
+    }
+
+    // the receive buffer with room for at least num words, valid until the
+    // next call
+    inline uint64_t* recv_buffer(const size_t num) {
+        if(m_recv.size() < num) m_recv.resize(num);
+        return m_recv.data();
+    }
+};
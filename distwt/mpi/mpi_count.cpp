@@ -0,0 +1,40 @@
+#include <distwt/mpi/mpi_count.hpp>
+
+mpi_count::mpi_count(MPI_Datatype type, size_t num) {
+    if(num <= mpi_count_max) {
+        m_type = type;
+        m_count = int(num);
+        m_derived = false;
+    } else {
+        // q chunks of mpi_count_max items, followed by r single items
+        const size_t q = num / mpi_count_max;
+        const size_t r = num % mpi_count_max;
+
+        MPI_Datatype chunk;
+        MPI_Type_contiguous(int(mpi_count_max), type, &chunk);
+
+        if(r == 0) {
+            MPI_Type_contiguous(int(q), chunk, &m_type);
+        } else {
+            MPI_Aint lb, extent;
+            MPI_Type_get_extent(type, &lb, &extent);
+
+            int lengths[2] = { int(q), int(r) };
+            MPI_Aint displs[2] = { 0, MPI_Aint(q * mpi_count_max) * extent };
+            MPI_Datatype types[2] = { chunk, type };
+
+            MPI_Type_create_struct(2, lengths, displs, types, &m_type);
+        }
+
+        MPI_Type_commit(&m_type);
+        MPI_Type_free(&chunk);
+
+        m_count = 1;
+        m_derived = true;
+    }
+}
+
+mpi_count::~mpi_count() {
+    // freeing is safe even if a non-blocking operation is still pending
+    if(m_derived) MPI_Type_free(&m_type);
+}
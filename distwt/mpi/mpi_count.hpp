@@ -0,0 +1,30 @@
+#pragma once
+
+#include <climits>
+#include <cstddef>
+#include <mpi.h>
+
+// the largest item count passed to a single MPI call
+constexpr size_t mpi_count_max = INT_MAX;
+
+// represents an amount of items of an MPI datatype so that it can be passed
+// to the int-based MPI interface
+//
+// if the amount exceeds mpi_count_max, a derived datatype covering all items
+// is created, so that they can be transferred using a count of one
+class mpi_count {
+private:
+    MPI_Datatype m_type;
+    int m_count;
+    bool m_derived;
+
+public:
+    mpi_count(MPI_Datatype type, size_t num);
+    ~mpi_count();
+
+    mpi_count(const mpi_count&) = delete;
+    mpi_count& operator=(const mpi_count&) = delete;
+
+    inline MPI_Datatype type() const { return m_type; }
+    inline int count() const { return m_count; }
+};
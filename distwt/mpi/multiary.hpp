@@ -0,0 +1,256 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <mpi.h>
+
+#include <tlx/math/div_ceil.hpp>
+
+#include <distwt/common/binary_io.hpp>
+#include <distwt/common/wm.hpp>
+#include <distwt/common/wt.hpp>
+#include <distwt/mpi/context.hpp>
+#include <distwt/mpi/histogram.hpp>
+
+// one level of a 2^k-ary wavelet tree or matrix
+//
+// the k-bit digits are packed into 64-bit words, most significant first, so
+// that a level takes k bits per item and is saved as is. for k=1, the format
+// equals that of a binary level
+template<size_t k>
+class PackedDigits {
+public:
+    static_assert(k >= 1 && k <= 8 && 64 % k == 0,
+        "digits must fit into a byte and pack into 64-bit words");
+
+    static constexpr size_t digits_per_word = 64 / k;
+    static constexpr uint64_t digit_mask = (uint64_t(1) << k) - 1;
+
+private:
+    std::vector<uint64_t> m_words;
+    size_t m_size;
+
+    // the shift of the i-th digit within its word
+    static inline size_t shift(const size_t i) {
+        return 64 - k * (i % digits_per_word + 1);
+    }
+
+public:
+    inline PackedDigits() : m_size(0) {
+    }
+
+    inline void resize(const size_t size) {
+        m_words.resize(tlx::div_ceil(size, digits_per_word), 0);
+        m_size = size;
+    }
+
+    inline size_t size() const { return m_size; }
+
+    inline uint8_t operator[](const size_t i) const {
+        return uint8_t((m_words[i / digits_per_word] >> shift(i)) &
+            digit_mask);
+    }
+
+    inline void set(const size_t i, const uint8_t d) {
+        uint64_t& word = m_words[i / digits_per_word];
+        word &= ~(digit_mask << shift(i));
+        word |= uint64_t(d) << shift(i);
+    }
+
+    // the packed words, the last of which may be partially used
+    inline const std::vector<uint64_t>& words() const { return m_words; }
+};
+
+template<size_t k> constexpr size_t PackedDigits<k>::digits_per_word;
+template<size_t k> constexpr uint64_t PackedDigits<k>::digit_mask;
+
+// the digit layout of a 2^k-ary wavelet tree or matrix
+//
+// symbols of the effective alphabet are padded with leading zeros to a
+// multiple of k bits, so a tree of binary height h has ceil(h/k) levels.
+// level l contains the l-th most significant digit of each symbol
+template<size_t k>
+struct MultiaryLayout {
+    using digits_t = PackedDigits<k>;
+
+    static constexpr size_t arity = size_t(1) << k;
+    static constexpr size_t digit_mask = arity - 1;
+
+    static inline size_t num_levels(const size_t height) {
+        return tlx::div_ceil(height, k);
+    }
+
+    // the digit of x on the given level of a tree with num_levels levels
+    template<typename sym_t>
+    static inline uint8_t digit(
+        const sym_t x,
+        const size_t level,
+        const size_t num_levels) {
+
+        return uint8_t(size_t(x >> (k * (num_levels - 1 - level))) &
+            digit_mask);
+    }
+
+    // the digits of x preceding the given level, i.e., its node on that
+    // level (zero-based)
+    template<typename sym_t>
+    static inline size_t prefix(
+        const sym_t x,
+        const size_t level,
+        const size_t num_levels) {
+
+        // the shift would exceed the symbol width on the first level
+        return level == 0 ? 0 : size_t(x >> (k * (num_levels - level)));
+    }
+
+    // writes the local part of each level to
+    // <output><rank>.<level_extension(level)>
+    //
+    // the levels are written as packed, so that for k=1 the format equals
+    // that of a binary level
+    static void save(
+        const MPIContext& ctx,
+        const std::vector<digits_t>& levels,
+        const std::string& output,
+        std::function<std::string(size_t)> level_extension) {
+
+        for(size_t level = 0; level < levels.size(); level++) {
+            // construct local filename
+            std::string filename;
+            {
+                std::ostringstream ss;
+                ss << output << std::setw(4) << std::setfill('0')
+                    << ctx.rank() << '.' << level_extension(level);
+                filename = ss.str();
+            }
+
+            // open file
+            MPI_File f;
+            MPI_File_open(
+                MPI_COMM_SELF,
+                filename.c_str(),
+                MPI_MODE_WRONLY | MPI_MODE_CREATE,
+                MPI_INFO_NULL,
+                &f);
+
+            // write in blocks, as MPI counts are ints
+            MPI_Status status;
+
+            const auto& words = levels[level].words();
+            const size_t max_block = size_t(1) << 24;
+            for(size_t i = 0; i < words.size(); i += max_block) {
+                const size_t num = std::min(max_block, words.size() - i);
+                MPI_File_write(f, words.data() + i, int(num), MPI_LONG_LONG,
+                    &status);
+            }
+
+            // close file
+            MPI_File_close(&f);
+        }
+    }
+
+    static inline std::string arity_extension() {
+        return "arity";
+    }
+
+    // writes the arity, so that readers know the digit width of the levels
+    static void save_arity(const std::string& filename) {
+        binary::FileWriter w(filename);
+        w.write<size_t>(size_t(arity));
+    }
+};
+
+// 2^k-ary wavelet tree in level-wise representation
+//
+// the nodes of level l are the distinct digit prefixes of length l, and the
+// level contains the digits of the symbols in the order of their node
+template<size_t k>
+class WaveletTreeMultiary : public WaveletTreeBase {
+public:
+    using layout = MultiaryLayout<k>;
+    using levels_t = std::vector<typename layout::digits_t>;
+
+    using ctor_t = std::function<
+        void(levels_t& levels, const WaveletTreeMultiary& wt)>;
+
+private:
+    levels_t m_levels;
+
+public:
+    template<typename sym_t>
+    inline WaveletTreeMultiary(
+        const Histogram<sym_t>& hist,
+        ctor_t construction_algorithm)
+        : WaveletTreeBase(hist) {
+
+        construction_algorithm(m_levels, *this);
+    }
+
+    inline size_t num_levels() const {
+        return layout::num_levels(height());
+    }
+
+    inline void save(const MPIContext& ctx, const std::string& output) {
+        layout::save(ctx, m_levels, output,
+            WaveletTreeBase::level_extension);
+    }
+};
+
+// 2^k-ary wavelet matrix
+//
+// each level contains the digits of the symbols in the order obtained by
+// stably sorting the previous level by its digits. instead of one Z value,
+// each level has the global number of occurrences of each digit
+template<size_t k>
+class WaveletMatrixMultiary : public WaveletTreeBase {
+public:
+    using layout = MultiaryLayout<k>;
+    using levels_t = std::vector<typename layout::digits_t>;
+    using z_t = std::vector<size_t>; // arity counts per level
+
+    using ctor_t = std::function<
+        void(levels_t& levels, z_t& z, const WaveletMatrixMultiary& wm)>;
+
+private:
+    levels_t m_levels;
+    z_t m_z;
+
+public:
+    template<typename sym_t>
+    inline WaveletMatrixMultiary(
+        const Histogram<sym_t>& hist,
+        ctor_t construction_algorithm)
+        : WaveletTreeBase(hist) {
+
+        m_z = z_t(num_levels() * layout::arity);
+        construction_algorithm(m_levels, m_z, *this);
+    }
+
+    inline size_t num_levels() const {
+        return layout::num_levels(height());
+    }
+
+    // the number of occurrences of the given digit on the given level
+    inline size_t z(const size_t level, const size_t digit) const {
+        return m_z[level * layout::arity + digit];
+    }
+
+    // writes the digit counts of each level
+    void save_z(const std::string& filename) const {
+        binary::FileWriter w(filename);
+        for(const size_t z : m_z) {
+            w.write<size_t>(z);
+        }
+    }
+
+    inline void save(const MPIContext& ctx, const std::string& output) {
+        layout::save(ctx, m_levels, output,
+            WaveletMatrixBase::level_extension);
+    }
+};
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <algorithm>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <distwt/mpi/context.hpp>
+
+// given the nodes that this worker holds items of as (node ID, local size)
+// pairs, replaces each size by the number of the node's items held by lower
+// ranks
+//
+// only the worker that holds a node's first global item computes the node's
+// prefix sum, so only nonzero sizes need to be sent. the pairs may be in any
+// order, but no node may occur twice
+//
+// node_sizes must answer the global offset of a node within its level, like
+// WaveletTreeBase::NodeSizes does
+template<typename node_sizes_t>
+void node_prefix_sums(
+    MPIContext& ctx,
+    const node_sizes_t& node_sizes,
+    const size_t size_per_worker,
+    std::vector<std::pair<size_t, size_t>>& local_nodes) {
+
+    const size_t num_workers = ctx.num_workers();
+
+    auto owner = [&](const size_t node_id){
+        return std::min(
+            node_sizes.offset(node_id) / size_per_worker,
+            num_workers - 1);
+    };
+
+    std::vector<std::vector<uint64_t>> requests(num_workers);
+    for(const auto& e : local_nodes) {
+        auto& req = requests[owner(e.first)];
+        req.push_back(e.first);
+        req.push_back(e.second);
+    }
+
+    // compute prefix sums for owned nodes in rank order
+    auto sizes = ctx.all_to_all(requests);
+    requests.clear();
+    {
+        std::unordered_map<uint64_t, uint64_t> sums;
+        for(auto& v : sizes) {
+            for(size_t k = 0; k < v.size(); k += 2) {
+                auto& sum = sums[v[k]];
+                const uint64_t size = v[k+1];
+                v[k/2] = sum; // replace by prefix sum, compact
+                sum += size;
+            }
+            v.resize(v.size() / 2);
+        }
+    }
+
+    // responses arrive in the order of the requests
+    auto offs = ctx.all_to_all(sizes);
+    sizes.clear();
+
+    std::vector<size_t> next(num_workers, 0);
+    for(auto& e : local_nodes) {
+        const size_t o = owner(e.first);
+        e.second = offs[o][next[o]++];
+    }
+}
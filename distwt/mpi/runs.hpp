@@ -0,0 +1,182 @@
+#pragma once
+
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <mpi.h>
+
+#include <distwt/common/bv64.hpp>
+#include <distwt/mpi/bit_vector.hpp>
+#include <distwt/mpi/bucket_exchange.hpp>
+#include <distwt/mpi/context.hpp>
+#include <distwt/mpi/even_partition.hpp>
+#include <distwt/mpi/histogram.hpp>
+
+// run-length encoding of the local part of a text: the first symbol of each
+// run (the run heads) and a bit vector marking the positions at which a run
+// starts
+//
+// symbols are pushed in text order. runs continuing the last run of the
+// previous worker are joined by calling join_boundary_run afterwards
+template<typename sym_t>
+class LocalRuns {
+private:
+    std::vector<sym_t> m_heads;
+    bv_t m_starts;
+
+public:
+    inline LocalRuns(const size_t local_num) {
+        m_starts.reserve(local_num);
+    }
+
+    inline void push(const sym_t x) {
+        const bool start = m_heads.empty() || !(x == m_heads.back());
+        if(start) m_heads.push_back(x);
+        m_starts.push_back(start);
+    }
+
+    // joins the first local run with the last run of the previous worker
+    // if they consist of the same symbol
+    //
+    // since all non-empty workers form a prefix in rank order, it suffices
+    // to receive the last symbol of the previous worker
+    void join_boundary_run(MPIContext& ctx) {
+        const size_t rank = ctx.rank();
+        std::vector<std::vector<sym_t>> last(ctx.num_workers());
+        if(!m_heads.empty() && rank + 1 < ctx.num_workers()) {
+            last[rank + 1].push_back(m_heads.back());
+        }
+
+        const auto prev = ctx.all_to_all(last);
+        if(rank > 0 && !prev[rank - 1].empty() && !m_heads.empty() &&
+            prev[rank - 1][0] == m_heads.front()) {
+
+            m_heads.erase(m_heads.begin());
+            m_starts[0] = false;
+        }
+    }
+
+    inline std::vector<sym_t>& heads() { return m_heads; }
+    inline const bv_t& starts() const { return m_starts; }
+};
+
+// redistributes the run heads of all workers so that they are partitioned
+// evenly, keeping their order, and returns the new partition
+template<typename sym_t>
+EvenPartition balance_runs(MPIContext& ctx, std::vector<sym_t>& heads) {
+    // the global number of runs and the number of runs on lower ranks
+    std::vector<size_t> num = { heads.size() };
+    std::vector<size_t> total(1);
+    ctx.all_reduce(num.data(), total.data(), 1);
+
+    ctx.ex_scan(num);
+    const size_t offs = (ctx.rank() > 0) ? num[0] : 0;
+
+    EvenPartition part(ctx, total[0]);
+
+    BucketExchange<sym_t> exchange(ctx, part.size_per_worker());
+    if(!heads.empty()) {
+        exchange.add(heads.data(), offs, heads.size());
+    }
+    exchange.send(0);
+
+    std::vector<sym_t> balanced(part.local_num());
+    exchange.receive(
+        balanced, part.local_num(), part.local_offset(), 0);
+
+    // synchronize before cleaning!
+    ctx.synchronize();
+
+    std::swap(heads, balanced);
+    return part;
+}
+
+// histogram of the run heads over the alphabet of the text
+//
+// every symbol of the text starts at least one run, so the alphabet is the
+// same as that of the text, and the effective transformation of the text
+// applies to the run heads as well
+template<typename sym_t>
+class RunHeadHistogram : public Histogram<sym_t> {
+public:
+    // given the histogram of the text and the local run heads in the
+    // effective alphabet
+    inline RunHeadHistogram(
+        MPIContext& ctx,
+        const Histogram<sym_t>& hist,
+        const std::vector<sym_t>& eheads) {
+
+        const size_t sigma = hist.size();
+
+        std::vector<size_t> local_counts(sigma, 0);
+        for(const sym_t x : eheads) {
+            ++local_counts[size_t(x)];
+        }
+
+        std::vector<size_t> counts(sigma);
+        ctx.all_reduce(local_counts.data(), counts.data(), sigma);
+
+        for(size_t i = 0; i < sigma; i++) {
+            this->m_entries.emplace_back(hist.entries[i].first, counts[i]);
+        }
+    }
+};
+
+// the bit vector marking run starts, which is written to
+// <output><rank>.<extension()> in the format of a wavelet tree level
+struct RunStarts {
+    static inline std::string extension() {
+        return "runs";
+    }
+
+    static void save(
+        const MPIContext& ctx,
+        const bv_t& starts,
+        const std::string& output) {
+
+        // construct local filename
+        std::string filename;
+        {
+            std::ostringstream ss;
+            ss << output << std::setw(4) << std::setfill('0')
+                << ctx.rank() << '.' << extension();
+            filename = ss.str();
+        }
+
+        // open file
+        MPI_File f;
+        MPI_File_open(
+            MPI_COMM_SELF,
+            filename.c_str(),
+            MPI_MODE_WRONLY | MPI_MODE_CREATE,
+            MPI_INFO_NULL,
+            &f);
+
+        // write
+        MPI_Status status;
+
+        bv64_t bitbuf;
+        size_t x = 0;
+
+        for(size_t i = 0; i < starts.size(); i++) {
+            bitbuf[63ULL - (x++)] = starts[i];
+            if(x >= 64ULL) {
+                uint64_t ull = bitbuf.to_ullong();
+                MPI_File_write(f, &ull, 1, MPI_LONG_LONG, &status);
+
+                x = 0;
+            }
+        }
+
+        if(x > 0) {
+            uint64_t ull = bitbuf.to_ullong();
+            MPI_File_write(f, &ull, 1, MPI_LONG_LONG, &status);
+        }
+
+        // close file
+        MPI_File_close(&f);
+    }
+};
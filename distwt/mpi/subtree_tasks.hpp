@@ -0,0 +1,211 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+#include <distwt/common/wt_sequential.hpp>
+#include <distwt/mpi/context.hpp>
+#include <distwt/mpi/types.hpp>
+
+//#define DBG_SUBTREE_TASKS 1
+
+// a wavelet subtree to be computed sequentially by a single worker
+//
+// the worker holds all of the subtree's symbols, in text order
+template<typename sym_t>
+struct SubtreeTask {
+    size_t node_id; // subtree root
+    size_t height;  // subtree height
+    std::vector<sym_t> text;
+
+    inline size_t work() const {
+        return text.size() * height;
+    }
+};
+
+// workers are only considered overloaded if their work exceeds the
+// average by more than this fraction
+constexpr double subtree_tasks_tolerance = 0.05;
+
+// computes the given subtree tasks of all workers in the current communicator
+//
+// before computing them sequentially, the work is balanced in rounds: each
+// round, the most loaded workers are paired with the least loaded ones. the
+// loaded worker computes the root of its largest subtree, which splits it
+// into two child subtrees, and hands one of its subtrees to its partner
+//
+// since every subtree is computed entirely by one worker, the node-based
+// merge places the bits correctly regardless of which worker computed them
+template<typename sym_t>
+void compute_subtree_tasks(
+    MPIContext& ctx,
+    wt_bits_t& bits,
+    std::vector<SubtreeTask<sym_t>>& tasks,
+    const int tag) {
+
+    const size_t p = ctx.num_workers();
+    const size_t rank = ctx.rank();
+
+    auto local_load = [&](){
+        size_t load = 0;
+        for(auto& task : tasks) load += task.work();
+        return load;
+    };
+
+    // computes the root of the given task and replaces it by its children
+    auto split = [&](const size_t i){
+        SubtreeTask<sym_t> task = std::move(tasks[i]);
+        tasks.erase(tasks.begin() + i);
+
+        const size_t n = task.text.size();
+        const size_t test = 1ULL << (task.height - 1);
+
+        auto& bv = bits[task.node_id-1];
+        bv.resize(n);
+
+        SubtreeTask<sym_t> l { 2ULL * task.node_id, task.height - 1, {} };
+        SubtreeTask<sym_t> r { 2ULL * task.node_id + 1, task.height - 1, {} };
+        for(size_t k = 0; k < n; k++) {
+            const sym_t x = task.text[k];
+            const bool b = (size_t(x) & test) != 0;
+            bv[k] = b;
+            (b ? r : l).text.push_back(x);
+        }
+
+        tasks.push_back(std::move(l));
+        tasks.push_back(std::move(r));
+    };
+
+    size_t round = 0;
+    size_t progress = 1;
+    while(p > 1) {
+        // gather loads and the progress made in the previous round
+        std::vector<size_t> loads(p + 1, 0);
+        loads[rank] = local_load();
+        loads[p] = progress;
+        ctx.all_reduce(loads);
+
+        // stop if no more progress can be made
+        if(loads[p] == 0) break;
+
+        size_t total = 0;
+        for(size_t j = 0; j < p; j++) total += loads[j];
+        const double avg = double(total) / double(p);
+
+        // pair most loaded workers with the least loaded ones
+        std::vector<size_t> order(p);
+        for(size_t j = 0; j < p; j++) order[j] = j;
+        std::sort(order.begin(), order.end(), [&](size_t a, size_t b){
+            return loads[a] < loads[b] || (loads[a] == loads[b] && a < b);
+        });
+
+        size_t partner = SIZE_MAX;
+        bool donor = false;
+        size_t num_pairs = 0;
+        for(size_t k = 0; k < p / 2; k++) {
+            const size_t d = order[p-1-k];
+            const size_t r = order[k];
+
+            if(loads[d] <= loads[r] ||
+                double(loads[d]) <= (1.0 + subtree_tasks_tolerance) * avg) {
+                break;
+            }
+
+            if(d == rank) { partner = r; donor = true; }
+            if(r == rank) { partner = d; donor = false; }
+            ++num_pairs;
+        }
+
+        // stop when balanced
+        if(num_pairs == 0) break;
+
+        ctx.cout_master() << "Balancing subtrees: round " << (round+1)
+            << ", " << num_pairs << " pair(s), max load "
+            << loads[order[p-1]] << " (avg " << avg << ") ..." << std::endl;
+
+        progress = 0;
+
+        // steal
+        std::vector<size_t> header(3, 0); // node_id, height, num
+        SubtreeTask<sym_t> out { 0, 0, {} };
+        if(partner != SIZE_MAX) {
+            if(donor) {
+                // split the largest task that has children
+                size_t largest = SIZE_MAX;
+                for(size_t i = 0; i < tasks.size(); i++) {
+                    if(tasks[i].height > 1 && (largest == SIZE_MAX ||
+                        tasks[i].work() > tasks[largest].work())) {
+
+                        largest = i;
+                    }
+                }
+
+                if(largest != SIZE_MAX) {
+                    split(largest);
+                    ++progress;
+                }
+
+                // hand over the task that balances the pair best
+                const size_t load = local_load();
+                const size_t diff = load - std::min(load, loads[partner]);
+
+                auto dist = [&](const size_t w){
+                    return std::max(2 * w, diff) - std::min(2 * w, diff);
+                };
+
+                size_t best = SIZE_MAX;
+                for(size_t i = 0; i < tasks.size(); i++) {
+                    const size_t w = tasks[i].work();
+                    if(w > 0 && w < diff && (best == SIZE_MAX ||
+                        dist(w) < dist(tasks[best].work()))) {
+
+                        best = i;
+                    }
+                }
+
+                if(best != SIZE_MAX) {
+                    out = std::move(tasks[best]);
+                    tasks.erase(tasks.begin() + best);
+
+                    header[0] = out.node_id;
+                    header[1] = out.height;
+                    header[2] = out.text.size();
+                    ++progress;
+
+                    #ifdef DBG_SUBTREE_TASKS
+                    ctx.cout() << "hand over node " << out.node_id
+                        << " (" << out.text.size() << " symbols) to #"
+                        << partner << std::endl;
+                    #endif
+                }
+
+                ctx.isend(header, partner, tag);
+                if(header[2] > 0) ctx.isend(out.text, partner, tag);
+            } else {
+                ctx.recv(header.data(), 3, partner, tag);
+                if(header[0] > 0) {
+                    SubtreeTask<sym_t> in {
+                        header[0], header[1], std::vector<sym_t>(header[2]) };
+
+                    if(header[2] > 0) {
+                        ctx.recv(in.text.data(), header[2], partner, tag);
+                    }
+                    tasks.push_back(std::move(in));
+                }
+            }
+        }
+
+        // keep the outbox until everything has been received
+        ctx.synchronize();
+        ++round;
+    }
+
+    // compute remaining subtrees sequentially
+    for(auto& task : tasks) {
+        wt_pc<sym_t, idx_t>(bits, task.text, task.node_id, task.height);
+
+        task.text.clear();
+        task.text.shrink_to_fit();
+    }
+    tasks.clear();
+}
@@ -0,0 +1,178 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include <tlx/math/div_ceil.hpp>
+
+#include <distwt/common/histogram.hpp>
+#include <distwt/common/wt.hpp>
+
+// predicted traffic (in bytes) between text partitions
+struct TrafficPrediction {
+    size_t intra;    // between partitions on the same compute node
+    size_t inter;    // between partitions on different compute nodes
+    size_t messages; // number of point-to-point messages
+
+    inline double intra_fraction() const {
+        const size_t total = intra + inter;
+        return total > 0 ? double(intra) / double(total) : 1.0;
+    }
+
+    inline TrafficPrediction& operator+=(const TrafficPrediction& other) {
+        intra += other.intra;
+        inter += other.inter;
+        messages += other.messages;
+        return *this;
+    }
+};
+
+// calls f(target, x, y) for each piece [x, y) of the global interval [a, b)
+// that falls into the same target partition, where every partition but the
+// last holds size_per_worker items
+template<typename piece_f>
+inline void for_each_target(
+    const size_t size_per_worker,
+    size_t a,
+    const size_t b,
+    piece_f f) {
+
+    while(a < b) {
+        const size_t target = a / size_per_worker;
+        const size_t z = std::min((target+1) * size_per_worker, b);
+        f(target, a, z);
+        a = z;
+    }
+}
+
+// accounts messages of the given total size sent from source to target
+//
+// like MPIContext, messages a worker sends to itself count as intra-node
+inline void predict_message(
+    TrafficPrediction& prediction,
+    const std::vector<size_t>& node_layout,
+    const size_t source,
+    const size_t target,
+    const size_t bytes,
+    const size_t messages = 1) {
+
+    if(node_layout[source] == node_layout[target]) {
+        prediction.intra += bytes;
+    } else {
+        prediction.inter += bytes;
+    }
+    prediction.messages += messages;
+}
+
+// predicts the traffic caused by each bucket redistribution round of
+// mpi-bsort and mpi-dynbsort using only the histogram
+//
+// it is assumed that each symbol's occurrences are spread uniformly over
+// the text, so that every worker holds a proportional share of each node
+// that its partition intersects
+//
+// if levels_per_round is greater than one, as for mpi-bsort, each round
+// sorts the text by the nodes levels_per_round levels below and sends the
+// bits of the levels in between along with it. a round's traffic is
+// accounted on its first level
+//
+// node_layout[i] is the compute node holding the i-th text partition
+template<typename sym_t, typename idx_t>
+std::vector<TrafficPrediction> predict_bsort_level_traffic(
+    const HistogramBase<sym_t, idx_t>& hist,
+    const std::vector<size_t>& node_layout,
+    const size_t levels_per_round = 1) {
+
+    const size_t n = hist.text_length();
+    const size_t p = node_layout.size();
+
+    const WaveletTreeBase wt(hist);
+    std::vector<TrafficPrediction> prediction(wt.height(), { 0, 0, 0 });
+    if(n == 0 || p == 0) return prediction;
+
+    const size_t size_per_worker = tlx::div_ceil(n, p);
+    const auto node_sizes = WaveletTreeBase::node_sizes(hist);
+    const size_t tau = std::max(levels_per_round, size_t(1));
+
+    // the last level does not cause any redistribution
+    for(size_t level = 0; level + 1 < wt.height(); level += tau) {
+        auto& lv = prediction[level];
+
+        // the text is sorted by the nodes span levels below, and the bits
+        // of the span-1 levels in between are sent along (approximated as
+        // going to the same targets as the items)
+        const size_t span = std::min(tau, wt.height() - 1 - level);
+        const size_t item_size = sizeof(sym_t) * 8 + (span - 1);
+
+        // targets are visited in ascending order by every source, and all
+        // slices a source sends to the same target form one message
+        std::vector<size_t> last_target(p, SIZE_MAX);
+
+        // send global interval [x, y) of the next level from source
+        auto account = [&](const size_t source, size_t x, const size_t y){
+            for_each_target(size_per_worker, x, y,
+                [&](const size_t target, const size_t a, const size_t b){
+
+                const bool first = (last_target[source] != target);
+                last_target[source] = target;
+
+                predict_message(lv, node_layout, source, target,
+                    tlx::div_ceil((b - a) * item_size, size_t(8)),
+                    first ? 1 : 0);
+            });
+        };
+
+        for(auto it = node_sizes.level_nodes(level); it.valid(); it.next()) {
+            const size_t node_size = it.size();
+            const size_t glob_node_offs = it.offset();
+
+            // descendants span levels below occupy the node's global
+            // interval in order
+            const size_t first_desc = it.node_id() << span;
+            const size_t num_desc = size_t(1) << span;
+
+            // visit all workers holding a part of the node
+            const size_t node_end = glob_node_offs + node_size;
+            size_t a = glob_node_offs;
+            while(a < node_end) {
+                const size_t source = a / size_per_worker;
+                const size_t b = std::min(
+                    (source+1) * size_per_worker, node_end);
+
+                // the worker's share of each descendant
+                const long double f0 =
+                    (long double)(a - glob_node_offs) / node_size;
+                const long double f1 =
+                    (long double)(b - glob_node_offs) / node_size;
+
+                size_t desc_offs = glob_node_offs;
+                for(size_t d = first_desc; d < first_desc + num_desc; d++) {
+                    const size_t desc_size = node_sizes.size(d);
+                    account(source,
+                        desc_offs + size_t(f0 * desc_size),
+                        desc_offs + size_t(f1 * desc_size));
+                    desc_offs += desc_size;
+                }
+
+                a = b;
+            }
+        }
+    }
+
+    return prediction;
+}
+
+// predicts the total traffic of the bucket redistribution rounds of
+// mpi-bsort and mpi-dynbsort (see predict_bsort_level_traffic)
+template<typename sym_t, typename idx_t>
+TrafficPrediction predict_bsort_traffic(
+    const HistogramBase<sym_t, idx_t>& hist,
+    const std::vector<size_t>& node_layout) {
+
+    TrafficPrediction prediction { 0, 0, 0 };
+    for(auto& lv : predict_bsort_level_traffic(hist, node_layout)) {
+        prediction += lv;
+    }
+    return prediction;
+}
@@ -0,0 +1,166 @@
+#pragma once
+
+#include <utility>
+#include <vector>
+
+#include <distwt/common/wt.hpp>
+
+#include <distwt/mpi/bit_vector.hpp>
+#include <distwt/mpi/bucket_exchange.hpp>
+#include <distwt/mpi/context.hpp>
+#include <distwt/mpi/node_prefix_sums.hpp>
+
+//#define DBG_WM_LOCAL 1
+
+// the nodes of each level (starting at the second) that a local wavelet
+// matrix holds items of, as (node ID, local size) pairs in the order in
+// which they occur in the local level bit vector
+using wm_local_runs_t = std::vector<std::vector<std::pair<size_t, size_t>>>;
+
+// constructs the wavelet matrix of the local text, which is reordered in
+// the process
+//
+// on every level, the local items are stably sorted by the bit-reversed
+// prefix of their symbols, so that the items of each node form a single run
+template<typename sym_t>
+void wm_local(
+    std::vector<bv_t>& bits,
+    wm_local_runs_t& runs,
+    std::vector<sym_t>& text,
+    const size_t height) {
+
+    const size_t n = text.size();
+
+    bits.resize(height);
+    runs.resize(height);
+
+    std::vector<sym_t> buffer(height > 1 ? n : 0);
+    for(size_t level = 0; level < height; level++) {
+        const size_t rsh = height - 1 - level;
+
+        // record the runs of the level's nodes
+        if(level > 0) {
+            const size_t first_level_node = 1ULL << level;
+            auto& level_runs = runs[level];
+
+            for(size_t i = 0; i < n; i++) {
+                const size_t node_id =
+                    first_level_node + size_t(text[i] >> (rsh + 1));
+
+                if(level_runs.empty() || level_runs.back().first != node_id) {
+                    level_runs.emplace_back(node_id, 0);
+                }
+                ++level_runs.back().second;
+            }
+        }
+
+        // compute level bit vector and count zeros
+        auto& level_bits = bits[level];
+        level_bits.resize(n);
+
+        size_t num0 = 0;
+        for(size_t i = 0; i < n; i++) {
+            const bool b = (text[i] >> rsh) & 1;
+            level_bits[i] = b;
+            num0 += b ? 0 : 1;
+        }
+
+        // stably partition by the level's bit for the next level
+        if(level + 1 < height) {
+            size_t p0 = 0, p1 = num0;
+            for(size_t i = 0; i < n; i++) {
+                const sym_t x = text[i];
+                buffer[level_bits[i] ? p1++ : p0++] = x;
+            }
+            std::swap(text, buffer);
+        }
+    }
+}
+
+// merges the local wavelet matrices of all workers into the global one,
+// where each worker receives the bits of its text partition
+//
+// the first level is already in place. on every other level, the bits of
+// each node run are sent to the workers holding their global positions,
+// which are determined by the node's offset in bit-reversed order and the
+// node's items held by lower ranks. all runs going to the same target are
+// coalesced into one message per level
+template<typename idx_t>
+void wm_merge_local(
+    MPIContext& ctx,
+    std::vector<bv_t>& bits,
+    std::vector<bv_t>& local_bits,
+    wm_local_runs_t& runs,
+    const WaveletTreeBase::NodeSizes<idx_t>& node_sizes,
+    const size_t size_per_worker) {
+
+    const size_t height = local_bits.size();
+    const size_t local_num = height > 0 ? local_bits[0].size() : 0;
+
+    bits.resize(height);
+    if(height == 0) return;
+    std::swap(bits[0], local_bits[0]); // simply move first level
+
+    // determine the items of each node run held by lower ranks
+    ctx.cout_master() << "Distributing node prefix sums ..." << std::endl;
+    std::vector<std::pair<size_t, size_t>> lower;
+    for(size_t level = 1; level < height; level++) {
+        lower.insert(lower.end(), runs[level].begin(), runs[level].end());
+    }
+    node_prefix_sums(ctx, node_sizes, size_per_worker, lower);
+
+    // distribute level bit vectors
+    ctx.cout_master() << "Distributing level bit vectors ..." << std::endl;
+
+    BucketExchange<uint8_t> exchange(ctx, size_per_worker);
+    std::vector<uint8_t> no_items;
+
+    auto lower_it = lower.begin();
+    for(size_t level = 1; level < height; level++) {
+        ctx.cout_master() << "level " << (level+1) << " ..." << std::endl;
+
+        // global offsets of the nodes of the local runs
+        std::vector<size_t> run_node_ids;
+        run_node_ids.reserve(runs[level].size());
+        for(const auto& run : runs[level]) {
+            run_node_ids.push_back(run.first);
+        }
+        const std::vector<size_t> run_node_offs =
+            node_sizes.offsets(level, run_node_ids, true);
+
+        size_t local_offs = 0;
+        for(size_t k = 0; k < runs[level].size(); k++) {
+            const size_t num = runs[level][k].second;
+
+            const size_t glob_offs = run_node_offs[k] + (lower_it++)->second;
+
+            #ifdef DBG_WM_LOCAL
+            ctx.cout() << "node " << runs[level][k].first
+                << " of level " << (level+1)
+                << ": send " << num << " bits to ["
+                << glob_offs << "," << glob_offs + num << ")" << std::endl;
+            #endif
+
+            exchange.add_bits(
+                level, local_bits[level], local_offs, glob_offs, num);
+            local_offs += num;
+        }
+
+        // bits are packed, so the local level can be discarded
+        local_bits[level].clear();
+        local_bits[level].shrink_to_fit();
+        runs[level].clear();
+        runs[level].shrink_to_fit();
+
+        exchange.send((int)level);
+
+        bits[level].resize(local_num);
+        exchange.receive(no_items, 0, ctx.rank() * size_per_worker,
+            (int)level, &bits, local_num);
+
+        // this synchronization is necessary in order to maintain the
+        // outbox buffer until all messages have been received
+        ctx.synchronize();
+        exchange.clear();
+    }
+}
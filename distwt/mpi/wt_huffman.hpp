@@ -0,0 +1,220 @@
+#pragma once
+
+#include <algorithm>
+#include <functional>
+#include <utility>
+#include <vector>
+
+#include <tlx/math/div_ceil.hpp>
+
+#include <distwt/common/huffman.hpp>
+
+#include <distwt/mpi/bit_vector.hpp>
+#include <distwt/mpi/bucket_exchange.hpp>
+#include <distwt/mpi/context.hpp>
+#include <distwt/mpi/node_prefix_sums.hpp>
+#include <distwt/mpi/wt_levelwise.hpp>
+
+//#define DBG_HUFFMAN 1
+
+// Huffman-shaped wavelet tree in level-wise representation
+//
+// since levels shrink as symbols terminate, level l is distributed
+// over the workers such that each holds level_size_per_worker(l) bits of it
+class WaveletTreeHuffman : public WaveletTreeLevelwise {
+public:
+    using ctor_t = std::function<void(bits_t& bits, const HuffmanCode& code)>;
+
+private:
+    HuffmanCode m_code;
+
+public:
+    template<typename sym_t>
+    inline WaveletTreeHuffman(
+        const Histogram<sym_t>& hist,
+        ctor_t construction_algorithm)
+        : WaveletTreeLevelwise(hist),
+          m_code(hist) {
+
+        m_height = m_code.height();
+        construction_algorithm(m_bits, m_code);
+    }
+
+    inline const HuffmanCode& code() const {
+        return m_code;
+    }
+};
+
+// the number of bits of the given level held by each worker but the last
+inline size_t level_size_per_worker(
+    const HuffmanCode& code,
+    const size_t level,
+    const size_t num_workers) {
+
+    return std::max(
+        tlx::div_ceil(code.level_size(level), num_workers), size_t(1));
+}
+
+// the number of bits of the given level held by the given worker
+inline size_t level_local_num(
+    const HuffmanCode& code,
+    const size_t level,
+    const size_t num_workers,
+    const size_t rank) {
+
+    const size_t n = code.level_size(level);
+    const size_t spw = level_size_per_worker(code, level, num_workers);
+    const size_t offs = std::min(rank * spw, n);
+    return std::min(offs + spw, n) - offs;
+}
+
+// the nodes of each level (starting at the second) that a local
+// Huffman-shaped wavelet tree holds items of, as (node ID, local size) pairs
+// in the order of the local level bit vector
+using wt_huffman_runs_t =
+    std::vector<std::vector<std::pair<size_t, size_t>>>;
+
+// constructs the Huffman-shaped wavelet tree of the local text, which is
+// reordered in the process
+//
+// on every level, the items of each node are stably partitioned into the
+// node's children, and items whose code ends are dropped
+template<typename sym_t>
+void wt_huffman_local(
+    std::vector<bv_t>& bits,
+    wt_huffman_runs_t& runs,
+    std::vector<sym_t>& text,
+    const HuffmanCode& code) {
+
+    const size_t height = code.height();
+    bits.resize(height);
+    runs.resize(height);
+    if(height == 0) return;
+
+    // the root is the only node of the first level
+    std::vector<std::pair<size_t, size_t>> level_runs = {
+        { 1, text.size() } };
+
+    std::vector<sym_t> buffer;
+    for(size_t level = 0; level < height; level++) {
+        const size_t n = text.size();
+
+        // compute level bit vector
+        auto& level_bits = bits[level];
+        level_bits.resize(n);
+        for(size_t i = 0; i < n; i++) {
+            level_bits[i] = code.bit(text[i], level);
+        }
+
+        if(level + 1 == height) break;
+
+        // partition the items of each node into its children
+        auto& next_runs = runs[level + 1];
+        buffer.resize(n);
+
+        size_t i = 0, m = 0;
+        for(const auto& run : level_runs) {
+            const size_t end = i + run.second;
+
+            size_t num[2] = { 0, 0 };
+            for(size_t j = i; j < end; j++) {
+                if(code.length(text[j]) > level + 1) ++num[level_bits[j]];
+            }
+
+            size_t pos[2] = { m, m + num[0] };
+            for(; i < end; i++) {
+                const sym_t x = text[i];
+                if(code.length(x) > level + 1) {
+                    buffer[pos[level_bits[i]]++] = x;
+                }
+            }
+
+            for(size_t b = 0; b < 2; b++) {
+                if(num[b] > 0) {
+                    next_runs.emplace_back(2 * run.first + b, num[b]);
+                }
+            }
+            m += num[0] + num[1];
+        }
+
+        buffer.resize(m);
+        std::swap(text, buffer);
+        level_runs = next_runs;
+    }
+}
+
+// merges the local Huffman-shaped wavelet trees of all workers into the
+// global levels, where the first level is already in place
+//
+// on every other level, the bits of each node run are sent to the workers
+// holding their global positions, which are determined by the node's offset
+// and the node's items held by lower ranks. all runs going to the same
+// target are coalesced into one message per level
+inline void wt_huffman_merge_local(
+    MPIContext& ctx,
+    std::vector<bv_t>& bits,
+    std::vector<bv_t>& local_bits,
+    wt_huffman_runs_t& runs,
+    const HuffmanCode& code) {
+
+    const size_t height = code.height();
+    const size_t num_workers = ctx.num_workers();
+
+    bits.resize(height);
+    if(height == 0) return;
+    std::swap(bits[0], local_bits[0]); // simply move first level
+
+    // determine the items of each node run held by lower ranks
+    ctx.cout_master() << "Distributing node prefix sums ..." << std::endl;
+    std::vector<std::pair<size_t, size_t>> lower;
+    for(size_t level = 1; level < height; level++) {
+        lower.insert(lower.end(), runs[level].begin(), runs[level].end());
+    }
+    node_prefix_sums(ctx, code,
+        level_size_per_worker(code, 0, num_workers), lower);
+
+    // distribute level bit vectors
+    ctx.cout_master() << "Distributing level bit vectors ..." << std::endl;
+
+    std::vector<uint8_t> no_items;
+    auto lower_it = lower.begin();
+    for(size_t level = 1; level < height; level++) {
+        ctx.cout_master() << "level " << (level+1) << " ..." << std::endl;
+
+        const size_t spw = level_size_per_worker(code, level, num_workers);
+        BucketExchange<uint8_t> exchange(ctx, spw);
+
+        size_t local_offs = 0;
+        for(const auto& run : runs[level]) {
+            const size_t glob_offs =
+                code.offset(run.first) + (lower_it++)->second;
+
+            #ifdef DBG_HUFFMAN
+            ctx.cout() << "node " << run.first << " of level " << (level+1)
+                << ": send " << run.second << " bits to [" << glob_offs
+                << "," << glob_offs + run.second << ")" << std::endl;
+            #endif
+
+            exchange.add_bits(
+                level, local_bits[level], local_offs, glob_offs, run.second);
+            local_offs += run.second;
+        }
+
+        local_bits[level].clear();
+        local_bits[level].shrink_to_fit();
+        runs[level].clear();
+        runs[level].shrink_to_fit();
+
+        exchange.send((int)level);
+
+        const size_t local_num =
+            level_local_num(code, level, num_workers, ctx.rank());
+        bits[level].resize(local_num);
+        exchange.receive(no_items, 0, ctx.rank() * spw,
+            (int)level, &bits, local_num);
+
+        // this synchronization is necessary in order to maintain the
+        // outbox buffer until all messages have been received
+        ctx.synchronize();
+    }
+}
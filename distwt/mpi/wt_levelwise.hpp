@@ -4,6 +4,12 @@
 #include <distwt/mpi/context.hpp>
 
 class WaveletTreeLevelwise : public WaveletTree {
+protected:
+    template<typename sym_t>
+    inline WaveletTreeLevelwise(const Histogram<sym_t>& hist)
+        : WaveletTree(hist) {
+    }
+
 public:
     template<typename sym_t>
     inline WaveletTreeLevelwise(
@@ -1,6 +1,9 @@
 #pragma once
 
+#include <algorithm>
 #include <cassert>
+#include <utility>
+#include <vector>
 
 #include <distwt/mpi/wt.hpp>
 #include <distwt/mpi/wt_levelwise.hpp>
@@ -8,9 +11,9 @@
 
 #include <distwt/mpi/context.hpp>
 #include <distwt/mpi/file_partition_reader.hpp>
+#include <distwt/mpi/node_prefix_sums.hpp>
 #include <distwt/mpi/types.hpp>
 
-#include <distwt/common/bitrev.hpp>
 #include <distwt/mpi/uint64_pack_bv64.hpp>
 
 class WaveletTreeLevelwise; // fwd
@@ -73,9 +76,10 @@ private:
         bool discard,
         bool bit_reversal) {
 
-        auto node_sizes = WaveletTreeBase::node_sizes(hist);
+        const size_t height = this->height();
+        const auto node_sizes = WaveletTreeBase::node_sizes(hist);
 
-        bits.resize(this->height());
+        bits.resize(height);
         bits[0] = m_bits[0]; // simply copy root
 
         if(discard) {
@@ -83,96 +87,101 @@ private:
             m_bits[0].shrink_to_fit();
         }
 
-        // Part 1 - Distribute local offsets for all nodes
+        // Part 1 - Distribute local offsets for nonempty nodes
         ctx.cout_master() << "Distributing node prefix sums ..." << std::endl;
 
-        const size_t num_nodes = this->num_nodes();
-        std::vector<idx_t> local_node_offs(num_nodes);
-        {
-            // compute prefix sum of local node sizes
-            for(size_t i = 0; i < num_nodes; i++) {
-                local_node_offs[i] = idx_t(m_bits[i].size());
-            }
+        const size_t bits_per_worker = input.size_per_worker();
 
-            ctx.ex_scan(local_node_offs);
+        // the nodes that this worker holds bits of, ordered by node ID,
+        // along with the number of the node's bits held by lower ranks
+        std::vector<std::pair<size_t, size_t>> local_nodes;
+        for(size_t level = 1; level < height; level++) {
+            for(auto it = node_sizes.level_nodes(level); it.valid(); it.next()) {
+                const size_t node_id = it.node_id();
+                const size_t size = m_bits[node_id-1].size();
+                if(size > 0) local_nodes.emplace_back(node_id, size);
+            }
         }
+        node_prefix_sums(ctx, node_sizes, bits_per_worker, local_nodes);
 
         // Part 2 - Distribute bits in a balanced manner
         ctx.cout_master() << "Distributing level bit vectors ..." << std::endl;
         {
-            // prepare send / receive vectors
-            const size_t bits_per_worker = input.size_per_worker();
+            auto local_node = local_nodes.begin();
 
             // note: nothing to do for the root level!
-            for(size_t level = 1; level < this->height(); level++) {
+            for(size_t level = 1; level < height; level++) {
                 ctx.cout_master() << "level " << (level+1) << " ..." << std::endl;
 
                 // do this level by level
-                const size_t num_level_nodes = 1ULL << level;
-                const size_t first_level_node = num_level_nodes;
+                const size_t first_level_node = 1ULL << level;
+
+                // compute global offsets of the level's local nodes
+                std::vector<size_t> level_node_ids;
+                for(auto it = local_node; it != local_nodes.end() &&
+                    it->first < 2ULL * first_level_node; ++it) {
+
+                    level_node_ids.push_back(it->first);
+                }
+                const std::vector<size_t> level_node_offs =
+                    node_sizes.offsets(level, level_node_ids, bit_reversal);
 
-                // allocate message buffers
-                std::vector<uint64_t*> msg_buf;
+                // message buffers are taken from the context's message pool
+                auto& pool = ctx.message_pool();
 
                 // determine which bits from this worker go to other workers
-                size_t level_node_offs = 0;
-                for(size_t i = 0; i < num_level_nodes; i++) {
-                    const size_t node_id = first_level_node +
-                        (bit_reversal ? bitrev(i, level) : i);
+                for(size_t k = 0; k < level_node_ids.size();
+                    k++, ++local_node) {
 
+                    const size_t node_id = local_node->first;
                     auto& bv = m_bits[node_id-1];
-                    if(bv.size() > 0) {
-                        const size_t glob_node_offs =
-                            level_node_offs + local_node_offs[node_id-1];
-
-                        // map range of the local node's bit vector
-                        // in global level's bit vector
-                        size_t p = glob_node_offs;
-                        const size_t q = p + bv.size();
-
-                        while(p < q) {
-                            // determine target
-                            const size_t target = p / bits_per_worker;
-
-                            // determine next boundary
-                            const size_t x = std::min(
-                                (target+1) * bits_per_worker, q);
-
-                            // send interval [p,x) to target
-                            const size_t local_offs = p - glob_node_offs;
-                            const size_t num = x - p;
-
-                            #ifdef DBG_MERGE
-                            ctx.cout() << "Send [" << p << "," << x << ") ("
-                                << num << " bits) of level " << (level+1)
-                                << " (node " << node_id << ")"
-                                << " to #" << target << std::endl;
-                            #endif
-
-                            const size_t size =
-                                bv64_pack_t::required_bufsize(num)+2;
-
-                            uint64_t* msg = new uint64_t[size];
-                            msg[0] = p;
-                            msg[1] = num;
-                            bv64_pack_t::pack(bv, local_offs, msg+2, num);
-                            msg_buf.push_back(msg);
-
-                            ctx.isend(msg, size, target, (int)level);
-
-                            // advance in node
-                            p = x;
-                        }
-
-                        if(discard) {
-                            // discard node bit vector
-                            bv.clear();
-                            bv.shrink_to_fit();
-                        }
+
+                    const size_t glob_node_offs =
+                        level_node_offs[k] + local_node->second;
+
+                    // map range of the local node's bit vector
+                    // in global level's bit vector
+                    size_t p = glob_node_offs;
+                    const size_t q = p + bv.size();
+
+                    while(p < q) {
+                        // determine target
+                        const size_t target = p / bits_per_worker;
+
+                        // determine next boundary
+                        const size_t x = std::min(
+                            (target+1) * bits_per_worker, q);
+
+                        // send interval [p,x) to target
+                        const size_t local_offs = p - glob_node_offs;
+                        const size_t num = x - p;
+
+                        #ifdef DBG_MERGE
+                        ctx.cout() << "Send [" << p << "," << x << ") ("
+                            << num << " bits) of level " << (level+1)
+                            << " (node " << node_id << ")"
+                            << " to #" << target << std::endl;
+                        #endif
+
+                        const size_t size =
+                            bv64_pack_t::required_bufsize(num)+2;
+
+                        uint64_t* msg = pool.send_buffer(size);
+                        msg[0] = p;
+                        msg[1] = num;
+                        bv64_pack_t::pack(bv, local_offs, msg+2, num);
+
+                        ctx.isend(msg, size, target, (int)level);
+
+                        // advance in node
+                        p = x;
                     }
 
-                    // advance in level
-                    level_node_offs += node_sizes[node_id-1];
+                    if(discard) {
+                        // discard node bit vector
+                        bv.clear();
+                        bv.shrink_to_fit();
+                    }
                 }
 
                 // allocate level bv
@@ -187,7 +196,7 @@ private:
                     // probe for message (blocking)
                     auto result = ctx.template probe<uint64_t>((int)level);
 
-                    uint64_t* msg = new uint64_t[result.size];
+                    uint64_t* msg = pool.recv_buffer(result.size);
                     ctx.recv(msg, result.size, result.sender, (int)level);
 
                     const size_t moffs = msg[0];
@@ -223,10 +232,11 @@ private:
                 ctx.synchronize();
 
                 // clean up
-                for(uint64_t* msg : msg_buf) {
-                    delete[] msg;
-                }
+                pool.recycle();
             }
+
+            // the buffers of the largest level are not needed anymore
+            ctx.message_pool().release();
         }
 
         if(discard) {
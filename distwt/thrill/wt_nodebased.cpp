@@ -19,15 +19,16 @@
 WaveletTreeNodebased::WaveletTreeNodebased(
     const Histogram& hist,
     thrill::Context& ctx,
-    const std::string& filename) : WaveletTree(hist) {
+    const std::string& filename)
+    : WaveletTree(hist),
+      m_node_sizes(WaveletTreeBase::node_sizes(hist)) {
 
     const size_t nodes = num_nodes();
 
     m_bits.resize(nodes);
 
-    m_node_sizes = WaveletTreeBase::node_sizes(hist);
     for(size_t i = 0; i < nodes; i++) {
-        if(m_node_sizes[i] > 0) {
+        if(m_node_sizes.size(i+1) > 0) {
             m_bits[i] = thrill::api::ReadBinary<bv64_t>(
                 ctx, filename + "*." + node_extension(i+1));
         } else {
@@ -54,7 +55,7 @@ thrill::DIA<sym_t> WaveletTreeNodebased::read_node(
             for(size_t i = 0; i < 64; ++i) {
                 emit(sym_t(x[63ULL-i]) << lsh);
             }
-        }), m_node_sizes[node_id-1])
+        }), m_node_sizes.size(node_id))
         .Collapse();
 }
 
@@ -148,7 +149,7 @@ WaveletTreeLevelwise WaveletTreeNodebased::merge(
                     });
 
                 // compute alignment data structure
-                const size_t sz = m_node_sizes[node_id-1];
+                const size_t sz = m_node_sizes.size(node_id);
                 const size_t num_blocks = tlx::div_ceil(sz, 64ULL);
 
                 blocks[i] = (i > 0) ? (blocks[i-1] + num_blocks) : num_blocks;
@@ -180,7 +181,7 @@ WaveletTreeLevelwise WaveletTreeNodebased::merge(
                     size_t block_size;
                     if(rank+1 == blocks[i]) {
                         const size_t sz_mod64 =
-                            m_node_sizes[first_level_node+i-1] % 64ULL;
+                            m_node_sizes.size(first_level_node+i) % 64ULL;
 
                         block_size = (sz_mod64 == 0ULL) ? 64ULL : sz_mod64;
                     } else {
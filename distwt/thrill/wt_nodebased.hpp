@@ -14,7 +14,7 @@ class WaveletTreeNodebased : public WaveletTree {
 private:
     using sym_index_t = std::pair<sym_t, size_t>;
 
-    std::vector<size_t> m_node_sizes;
+    WaveletTreeBase::NodeSizes<idx_t> m_node_sizes;
 
     thrill::DIA<sym_t> read_node(
         thrill::Context& ctx, size_t node_id, size_t level);
@@ -29,7 +29,8 @@ public:
     inline WaveletTreeNodebased(
         const Histogram& hist,
         ctor_t construction_algorithm)
-        : WaveletTree(hist, construction_algorithm) {
+        : WaveletTree(hist, construction_algorithm),
+          m_node_sizes(WaveletTreeBase::node_sizes(hist)) {
     }
 
     WaveletTreeNodebased(